@@ -58,6 +58,48 @@ public:
   time_duration
   routerStExpireTime() const;
 
+  string
+  routerStType() const;
+
+  size_t
+  routerStMaxEntries() const;
+
+  size_t
+  routerStMaxEntriesPerFace() const;
+
+  string
+  routerStEvictPolicy() const;
+
+  size_t
+  routerStShardCount() const;
+
+  size_t
+  routerMatchCacheSize() const;
+
+  size_t
+  routerFibFlowHashComponents() const;
+
+  string
+  routerFibFile() const;
+
+  size_t
+  routerWorkerCount() const;
+
+  time_duration
+  routerSubSummaryInterval() const;
+
+  size_t
+  routerSubSummaryBitCount() const;
+
+  size_t
+  routerSubSummaryHashCount() const;
+
+  string
+  routerSnapshotFile() const;
+
+  time_duration
+  routerSnapshotInterval() const;
+
   // RP section
   uint16_t
   rpPort() const;
@@ -44,6 +44,15 @@ enum LogLevel {
 class Log : noncopyable
 {
 public:
+  // While one is alive, INFO messages of the thread that made it are logged
+  // at DEBUG, e.g. for changes repeating ones already logged at INFO.
+  class InfoAsDebug : noncopyable
+  {
+  public:
+    InfoAsDebug();
+
+    ~InfoAsDebug();
+  };
 
   static Log& 
   getInstance();
@@ -51,6 +60,10 @@ public:
   void 
   print(LogLevel lvl, const char* format, ...);
 
+  // lets the log macros skip evaluating their arguments
+  bool
+  isEnabled(LogLevel lvl) const;
+
 private:
   ofstream      m_outStream;
   stringstream  m_logStream;
@@ -67,6 +80,10 @@ private:
 
   string 
   getLevel(LogLevel lvl);
+
+  // `lvl` for the calling thread, see InfoAsDebug
+  static LogLevel
+  effectiveLevel(LogLevel lvl);
   
   void 
   printImpl(LogLevel lvl, const char* format, va_list args);
@@ -34,15 +34,19 @@ static fcopss::Log& logger = fcopss::Log::getInstance();
 #define LOG_EXTRA_FORMAT "[%s][%s:%d] "
 
 #define ERROR(message, args...) \
-logger.print(fcopss::LogLevel::LOG_ERROR, LOG_EXTRA_FORMAT message, LOG_EXTRA, ## args)
+(logger.isEnabled(fcopss::LogLevel::LOG_ERROR) ? \
+ logger.print(fcopss::LogLevel::LOG_ERROR, LOG_EXTRA_FORMAT message, LOG_EXTRA, ## args) : void())
 
 #define WARN(message, args...)  \
-logger.print(fcopss::LogLevel::LOG_WARN, LOG_EXTRA_FORMAT message, LOG_EXTRA, ## args)
+(logger.isEnabled(fcopss::LogLevel::LOG_WARN) ? \
+ logger.print(fcopss::LogLevel::LOG_WARN, LOG_EXTRA_FORMAT message, LOG_EXTRA, ## args) : void())
 
 #define INFO(message, args...)  \
-logger.print(fcopss::LogLevel::LOG_INFO, LOG_EXTRA_FORMAT message, LOG_EXTRA, ## args)
+(logger.isEnabled(fcopss::LogLevel::LOG_INFO) ? \
+ logger.print(fcopss::LogLevel::LOG_INFO, LOG_EXTRA_FORMAT message, LOG_EXTRA, ## args) : void())
 
 #define DEBUG(message, args...) \
-logger.print(fcopss::LogLevel::LOG_DEBUG, LOG_EXTRA_FORMAT message, LOG_EXTRA, ## args)
+(logger.isEnabled(fcopss::LogLevel::LOG_DEBUG) ? \
+ logger.print(fcopss::LogLevel::LOG_DEBUG, LOG_EXTRA_FORMAT message, LOG_EXTRA, ## args) : void())
 
 #endif
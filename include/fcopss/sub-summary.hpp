@@ -0,0 +1,129 @@
+/*
+  sub-summary.hpp
+
+  Copyright (c) 2019 KOZO KEIKAKU ENGINEERING Inc.
+
+  This software is released under the MIT License
+
+  Permission is hereby granted, free of charge, to any person obtaining a copy
+  of this software and associated documentation files (the "Software"), to deal
+  in the Software without restriction, including without limitation the rights
+  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+  copies of the Software, and to permit persons to whom the Software is
+  furnished to do so, subject to the following conditions:
+
+  The above copyright notice and this permission notice shall be included in all
+  copies or substantial portions of the Software.
+
+  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+  SOFTWARE.
+*/
+#ifndef _FCOPSS_SUB_SUMMARY_HPP_
+#define _FCOPSS_SUB_SUMMARY_HPP_
+
+#include <fcopss/common.hpp>
+#include <fcopss/tlv.hpp>
+
+namespace fcopss {
+
+// Bloom filter summary of the subscriptions behind a router, sent to its
+// upstream neighbor instead of the individual Subs.
+// A summary carries either the whole filter, or the bits toggled since the
+// summary numbered `base sequence` (a delta).
+class SubSummary
+{
+public:
+
+  class Error : public Block::Error
+  {
+  public:
+    explicit
+    Error(const string& what)
+      : Block::Error(what) 
+    {
+    }
+  };
+
+  SubSummary();
+
+  explicit
+  SubSummary(const Block& wire);
+
+  template<ndn::encoding::Tag TAG>
+  size_t
+  wireEncode(ndn::encoding::EncodingImpl<TAG>& encoder) const;
+
+  const Block&
+  wireEncode() const;
+
+  void
+  wireDecode(const Block& wire);
+
+  bool
+  hasWire() const;
+
+  uint64_t
+  getSequence() const;
+
+  SubSummary&
+  setSequence(uint64_t sequence);
+
+  size_t
+  getBitCount() const;
+
+  size_t
+  getHashCount() const;
+
+  SubSummary&
+  setGeometry(size_t bitCount, size_t hashCount);
+
+  bool
+  isDelta() const;
+
+  // valid for a delta only
+  uint64_t
+  getBaseSequence() const;
+
+  // the whole filter, valid unless isDelta()
+  const vector<uint8_t>&
+  getFilter() const;
+
+  // indexes of the toggled bits, valid if isDelta()
+  const vector<uint32_t>&
+  getToggles() const;
+
+  SubSummary&
+  setFilter(const vector<uint8_t>& filter);
+
+  SubSummary&
+  setDelta(uint64_t baseSequence, const vector<uint32_t>& toggles);
+
+  bool
+  operator==(const SubSummary& other) const;
+
+  bool
+  operator!=(const SubSummary& other) const;
+
+private:
+  uint64_t m_sequence;
+  size_t m_bitCount;
+  size_t m_hashCount;
+  bool m_isDelta;
+  uint64_t m_baseSequence;
+  vector<uint8_t> m_filter;
+  vector<uint32_t> m_toggles;
+
+  mutable Block m_wire;
+};
+
+ostream&
+operator<<(ostream& os, const SubSummary& summary);
+
+} // namespace fcopss
+
+#endif // _FCOPSS_SUB_SUMMARY_HPP_
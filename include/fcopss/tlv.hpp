@@ -33,10 +33,17 @@ enum {
   Sub          = 65,
   PubToRp     = 66,
   PubFromRp    = 67,
+  SubSummary  = 68,
   Cd          = 70,
   CdComponent  = 8,  // same as NDN's Generic-Name-Component
   CdOptional  = 81,
   CdAsterisk  = 82,
+  SubSummarySequence     = 83,
+  SubSummaryBaseSequence = 84,
+  SubSummaryBitCount     = 85,
+  SubSummaryHashCount    = 86,
+  SubSummaryFilter       = 87,
+  SubSummaryToggles      = 88,
   Content     = 21  // same as NDN's Content
 };
 
@@ -92,6 +92,106 @@ Config::routerStExpireTime() const
   return duration;
 }
 
+string
+Config::routerStType() const
+{
+  return m_ptree.get("ROUTER.StType", "list");
+}
+
+size_t
+Config::routerStMaxEntries() const
+{
+  return m_ptree.get("ROUTER.StMaxEntries", size_t(0));
+}
+
+size_t
+Config::routerStMaxEntriesPerFace() const
+{
+  return m_ptree.get("ROUTER.StMaxEntriesPerFace", size_t(0));
+}
+
+string
+Config::routerStEvictPolicy() const
+{
+  return m_ptree.get("ROUTER.StEvictPolicy", "lease");
+}
+
+size_t
+Config::routerStShardCount() const
+{
+  return m_ptree.get("ROUTER.StShardCount", size_t(0));
+}
+
+size_t
+Config::routerMatchCacheSize() const
+{
+  return m_ptree.get("ROUTER.MatchCacheSize", size_t(0));
+}
+
+size_t
+Config::routerFibFlowHashComponents() const
+{
+  return m_ptree.get("ROUTER.FibFlowHashComponents", size_t(0));
+}
+
+string
+Config::routerFibFile() const
+{
+  return m_ptree.get("ROUTER.FibFile", "");
+}
+
+size_t
+Config::routerWorkerCount() const
+{
+  return m_ptree.get("ROUTER.WorkerCount", size_t(1));
+}
+
+time_duration
+Config::routerSubSummaryInterval() const
+{
+  time_duration duration(boost::posix_time::pos_infin);
+
+  if (boost::optional<long> value = m_ptree.get_optional<long>("ROUTER.SubSummaryInterval")) {
+    if (value.get() > 0) {
+      duration = boost::posix_time::seconds(value.get());
+    }
+  }
+
+  return duration;
+}
+
+size_t
+Config::routerSubSummaryBitCount() const
+{
+  return m_ptree.get("ROUTER.SubSummaryBitCount", size_t(8192));
+}
+
+size_t
+Config::routerSubSummaryHashCount() const
+{
+  return m_ptree.get("ROUTER.SubSummaryHashCount", size_t(4));
+}
+
+string
+Config::routerSnapshotFile() const
+{
+  return m_ptree.get("ROUTER.SnapshotFile", "");
+}
+
+time_duration
+Config::routerSnapshotInterval() const
+{
+  time_duration duration(boost::posix_time::pos_infin);
+
+  if (boost::optional<long> value = m_ptree.get_optional<long>("ROUTER.SnapshotInterval")) {
+    if (value.get() > 0) {
+      duration = boost::posix_time::seconds(value.get());
+    }
+  }
+
+  return duration;
+}
+
 uint16_t
 Config::rpPort() const
 {
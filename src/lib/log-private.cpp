@@ -30,6 +30,19 @@ static const int BUFSIZE = 512;
 
 namespace fcopss {
 
+// InfoAsDebug objects alive on this thread
+static thread_local int InfoAsDebugDepth = 0;
+
+Log::InfoAsDebug::InfoAsDebug()
+{
+  InfoAsDebugDepth++;
+}
+
+Log::InfoAsDebug::~InfoAsDebug()
+{
+  InfoAsDebugDepth--;
+}
+
 Log::Log()
   : m_configLogLvl(LogLevel::LOG_INFO)
   , m_filename("")
@@ -128,9 +141,20 @@ Log::getLevel(LogLevel lvl)
   return logLevel;
 }
 
+LogLevel
+Log::effectiveLevel(LogLevel lvl)
+{
+  if ((lvl == LogLevel::LOG_INFO) && (InfoAsDebugDepth > 0))
+  {
+    return LogLevel::LOG_DEBUG;
+  }
+  return lvl;
+}
+
 void 
 Log::print(LogLevel lvl, const char* format, ...)
 {
+  lvl = effectiveLevel(lvl);
   if (lvl > m_configLogLvl)
   {
     return;
@@ -142,6 +166,12 @@ Log::print(LogLevel lvl, const char* format, ...)
   va_end(args);
 }
 
+bool
+Log::isEnabled(LogLevel lvl) const
+{
+  return (effectiveLevel(lvl) <= m_configLogLvl);
+}
+
 void 
 Log::printImpl(LogLevel lvl, const char* format, va_list args)
 {
@@ -0,0 +1,258 @@
+/*
+  sub-summary.cpp
+
+  Copyright (c) 2019 KOZO KEIKAKU ENGINEERING Inc.
+
+  This software is released under the MIT License
+
+  Permission is hereby granted, free of charge, to any person obtaining a copy
+  of this software and associated documentation files (the "Software"), to deal
+  in the Software without restriction, including without limitation the rights
+  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+  copies of the Software, and to permit persons to whom the Software is
+  furnished to do so, subject to the following conditions:
+
+  The above copyright notice and this permission notice shall be included in all
+  copies or substantial portions of the Software.
+
+  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+  SOFTWARE.
+*/
+#include <sstream>
+
+#include <fcopss/sub-summary.hpp>
+
+namespace fcopss {
+
+SubSummary::SubSummary()
+  : m_sequence(0), m_bitCount(0), m_hashCount(0), m_isDelta(false), m_baseSequence(0)
+{
+}
+
+SubSummary::SubSummary(const Block& wire)
+{
+  wireDecode(wire);
+}
+
+template<ndn::encoding::Tag TAG>
+size_t
+SubSummary::wireEncode(ndn::encoding::EncodingImpl<TAG>& encoder) const
+{
+  size_t totalLength = 0;
+
+  if (m_isDelta) {
+    vector<uint8_t> toggles;
+    toggles.reserve(m_toggles.size() * 4);
+    for (auto it = m_toggles.cbegin(); it != m_toggles.cend(); it++) {
+      toggles.push_back(static_cast<uint8_t>(*it >> 24));
+      toggles.push_back(static_cast<uint8_t>(*it >> 16));
+      toggles.push_back(static_cast<uint8_t>(*it >> 8));
+      toggles.push_back(static_cast<uint8_t>(*it));
+    }
+    totalLength += ndn::encoding::prependByteArrayBlock(encoder, tlv::SubSummaryToggles,
+                                                        toggles.data(), toggles.size());
+  } else {
+    totalLength += ndn::encoding::prependByteArrayBlock(encoder, tlv::SubSummaryFilter,
+                                                        m_filter.data(), m_filter.size());
+  }
+  totalLength += ndn::encoding::prependNonNegativeIntegerBlock(encoder, tlv::SubSummaryHashCount, m_hashCount);
+  totalLength += ndn::encoding::prependNonNegativeIntegerBlock(encoder, tlv::SubSummaryBitCount, m_bitCount);
+  if (m_isDelta) {
+    totalLength += ndn::encoding::prependNonNegativeIntegerBlock(encoder, tlv::SubSummaryBaseSequence, m_baseSequence);
+  }
+  totalLength += ndn::encoding::prependNonNegativeIntegerBlock(encoder, tlv::SubSummarySequence, m_sequence);
+  totalLength += encoder.prependVarNumber(totalLength);
+  totalLength += encoder.prependVarNumber(tlv::SubSummary);
+
+  return totalLength;
+}
+
+template size_t
+SubSummary::wireEncode<ndn::encoding::EncoderTag>(ndn::encoding::EncodingImpl<ndn::encoding::EncoderTag>& encoder) const;
+
+template size_t
+SubSummary::wireEncode<ndn::encoding::EstimatorTag>(ndn::encoding::EncodingImpl<ndn::encoding::EstimatorTag>& encoder) const;
+
+const Block&
+SubSummary::wireEncode() const
+{
+  if (m_wire.hasWire()) {
+    return m_wire;
+  }
+
+  ndn::encoding::EncodingEstimator estimator;
+  size_t estimatedSize = wireEncode(estimator);
+
+  ndn::encoding::EncodingBuffer buffer(estimatedSize, 0);
+  wireEncode(buffer);
+
+  const_cast<SubSummary*>(this)->wireDecode(buffer.block());
+
+  return m_wire;
+}
+
+void
+SubSummary::wireDecode(const Block& wire)
+{
+  m_wire = wire;
+  m_wire.parse();
+
+  if (m_wire.type() != tlv::SubSummary) {
+    BOOST_THROW_EXCEPTION(Error("Unexpected TLV type when decoding SubSummary"));
+  }
+
+  m_sequence = ndn::encoding::readNonNegativeInteger(m_wire.get(tlv::SubSummarySequence));
+  m_bitCount = ndn::encoding::readNonNegativeInteger(m_wire.get(tlv::SubSummaryBitCount));
+  m_hashCount = ndn::encoding::readNonNegativeInteger(m_wire.get(tlv::SubSummaryHashCount));
+  m_filter.clear();
+  m_toggles.clear();
+
+  Block::element_const_iterator it = m_wire.find(tlv::SubSummaryToggles);
+  if (it != m_wire.elements_end()) {
+    if ((it->value_size() % 4) != 0) {
+      BOOST_THROW_EXCEPTION(Error("Invalid SubSummaryToggles length"));
+    }
+    m_isDelta = true;
+    m_baseSequence = ndn::encoding::readNonNegativeInteger(m_wire.get(tlv::SubSummaryBaseSequence));
+    const uint8_t* value = it->value();
+    for (size_t i = 0; i < it->value_size(); i += 4) {
+      m_toggles.push_back((uint32_t(value[i]) << 24) | (uint32_t(value[i + 1]) << 16) |
+                          (uint32_t(value[i + 2]) << 8) | uint32_t(value[i + 3]));
+    }
+  } else {
+    const Block& filter = m_wire.get(tlv::SubSummaryFilter);
+    if (filter.value_size() != (m_bitCount + 7) / 8) {
+      BOOST_THROW_EXCEPTION(Error("SubSummaryFilter length does not match SubSummaryBitCount"));
+    }
+    m_isDelta = false;
+    m_baseSequence = 0;
+    m_filter.assign(filter.value(), filter.value() + filter.value_size());
+  }
+}
+
+bool
+SubSummary::hasWire() const
+{
+  return m_wire.hasWire();
+}
+
+uint64_t
+SubSummary::getSequence() const
+{
+  return m_sequence;
+}
+
+SubSummary&
+SubSummary::setSequence(uint64_t sequence)
+{
+  m_wire.reset();
+
+  m_sequence = sequence;
+
+  return *this;
+}
+
+size_t
+SubSummary::getBitCount() const
+{
+  return m_bitCount;
+}
+
+size_t
+SubSummary::getHashCount() const
+{
+  return m_hashCount;
+}
+
+SubSummary&
+SubSummary::setGeometry(size_t bitCount, size_t hashCount)
+{
+  m_wire.reset();
+
+  m_bitCount = bitCount;
+  m_hashCount = hashCount;
+
+  return *this;
+}
+
+bool
+SubSummary::isDelta() const
+{
+  return m_isDelta;
+}
+
+uint64_t
+SubSummary::getBaseSequence() const
+{
+  return m_baseSequence;
+}
+
+const vector<uint8_t>&
+SubSummary::getFilter() const
+{
+  return m_filter;
+}
+
+const vector<uint32_t>&
+SubSummary::getToggles() const
+{
+  return m_toggles;
+}
+
+SubSummary&
+SubSummary::setFilter(const vector<uint8_t>& filter)
+{
+  m_wire.reset();
+
+  m_isDelta = false;
+  m_baseSequence = 0;
+  m_filter = filter;
+  m_toggles.clear();
+
+  return *this;
+}
+
+SubSummary&
+SubSummary::setDelta(uint64_t baseSequence, const vector<uint32_t>& toggles)
+{
+  m_wire.reset();
+
+  m_isDelta = true;
+  m_baseSequence = baseSequence;
+  m_filter.clear();
+  m_toggles = toggles;
+
+  return *this;
+}
+
+bool
+SubSummary::operator==(const SubSummary& other) const
+{
+  return wireEncode() == other.wireEncode();
+}
+
+bool
+SubSummary::operator!=(const SubSummary& other) const
+{
+  return !(*this == other);
+}
+
+ostream&
+operator<<(ostream& os, const SubSummary& summary)
+{
+  os << "seq=" << summary.getSequence();
+  if (summary.isDelta()) {
+    os << " base=" << summary.getBaseSequence() << " toggles=" << summary.getToggles().size();
+  } else {
+    os << " bits=" << summary.getBitCount() << " hashes=" << summary.getHashCount();
+  }
+
+  return os;
+}
+
+} // namespace fcopss
@@ -79,6 +79,9 @@ Face::onPacketReceived(Block&& packet)
     } else if (packet.type() == tlv::PubFromRp) {
       auto pub = make_shared<PubFromRp>(packet);
       m_onPubFromRpReceived(m_id, *pub);
+    } else if (packet.type() == tlv::SubSummary) {
+      // the RP returns publications on the face they came from, no ST needed
+      DEBUG("SubSummary packet received: ignored");
     } else {
       WARN("unknown packet received: TLV type=%d", packet.type());
     }
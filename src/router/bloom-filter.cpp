@@ -0,0 +1,242 @@
+/*
+  bloom-filter.cpp
+
+  Copyright (c) 2019 KOZO KEIKAKU ENGINEERING Inc.
+
+  This software is released under the MIT License
+
+  Permission is hereby granted, free of charge, to any person obtaining a copy
+  of this software and associated documentation files (the "Software"), to deal
+  in the Software without restriction, including without limitation the rights
+  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+  copies of the Software, and to permit persons to whom the Software is
+  furnished to do so, subject to the following conditions:
+
+  The above copyright notice and this permission notice shall be included in all
+  copies or substantial portions of the Software.
+
+  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+  SOFTWARE.
+*/
+#include "bloom-filter.hpp"
+
+namespace fcopss {
+namespace router {
+
+static const uint64_t FnvOffsetBasis = 14695981039346656037ULL;
+static const uint64_t FnvPrime = 1099511628211ULL;
+
+BloomFilter::BloomFilter()
+  : m_bitCount(0), m_hashCount(0)
+{
+}
+
+BloomFilter::BloomFilter(size_t bitCount, size_t hashCount)
+  : m_bitCount(bitCount), m_hashCount(hashCount), m_bits((bitCount + 7) / 8, 0)
+{
+}
+
+size_t
+BloomFilter::bitCount() const
+{
+  return m_bitCount;
+}
+
+size_t
+BloomFilter::hashCount() const
+{
+  return m_hashCount;
+}
+
+bool
+BloomFilter::isEmpty() const
+{
+  for (auto it = m_bits.cbegin(); it != m_bits.cend(); it++) {
+    if (*it != 0) {
+      return false;
+    }
+  }
+  return true;
+}
+
+void
+BloomFilter::clear()
+{
+  std::fill(m_bits.begin(), m_bits.end(), 0);
+}
+
+void
+BloomFilter::fill()
+{
+  std::fill(m_bits.begin(), m_bits.end(), 0xff);
+  if ((m_bitCount % 8) != 0) {
+    m_bits.back() = static_cast<uint8_t>((1 << (m_bitCount % 8)) - 1);
+  }
+}
+
+void
+BloomFilter::insert(uint64_t key)
+{
+  if (m_bitCount == 0) {
+    return;
+  }
+
+  // double hashing, index i = h1 + i * h2
+  uint64_t h1 = key & 0xffffffff;
+  uint64_t h2 = (key >> 32) | 1;
+  for (size_t i = 0; i < m_hashCount; i++) {
+    size_t bit = (h1 + i * h2) % m_bitCount;
+    m_bits[bit / 8] |= static_cast<uint8_t>(1 << (bit % 8));
+  }
+}
+
+bool
+BloomFilter::contains(uint64_t key) const
+{
+  if (m_bitCount == 0) {
+    return false;
+  }
+
+  uint64_t h1 = key & 0xffffffff;
+  uint64_t h2 = (key >> 32) | 1;
+  for (size_t i = 0; i < m_hashCount; i++) {
+    size_t bit = (h1 + i * h2) % m_bitCount;
+    if ((m_bits[bit / 8] & (1 << (bit % 8))) == 0) {
+      return false;
+    }
+  }
+  return true;
+}
+
+void
+BloomFilter::insert(const Cd& cd)
+{
+  insert(keyOf(cd));
+}
+
+bool
+BloomFilter::mayMatch(const Cd& cd) const
+{
+  uint64_t key = FnvOffsetBasis;
+  if (contains(key)) {
+    return true;
+  }
+  for (auto it = cd.elements().cbegin(); it != cd.elements().cend(); it++) {
+    key = mix(key, *it);
+    if (contains(key)) {
+      return true;
+    }
+  }
+  return false;
+}
+
+void
+BloomFilter::merge(const BloomFilter& other)
+{
+  if ((other.m_bitCount != m_bitCount) || (other.m_hashCount != m_hashCount)) {
+    // cannot be translated, err on the side of forwarding
+    fill();
+    return;
+  }
+
+  for (size_t i = 0; i < m_bits.size(); i++) {
+    m_bits[i] |= other.m_bits[i];
+  }
+}
+
+void
+BloomFilter::diff(const BloomFilter& other, vector<uint32_t>& toggles) const
+{
+  toggles.clear();
+  for (size_t i = 0; i < std::min(m_bits.size(), other.m_bits.size()); i++) {
+    uint8_t changed = m_bits[i] ^ other.m_bits[i];
+    for (size_t bit = 0; changed != 0; bit++, changed >>= 1) {
+      if (changed & 1) {
+        toggles.push_back(static_cast<uint32_t>(i * 8 + bit));
+      }
+    }
+  }
+}
+
+bool
+BloomFilter::toggle(const vector<uint32_t>& toggles)
+{
+  for (auto it = toggles.cbegin(); it != toggles.cend(); it++) {
+    if (*it >= m_bitCount) {
+      return false;
+    }
+  }
+
+  for (auto it = toggles.cbegin(); it != toggles.cend(); it++) {
+    m_bits[*it / 8] ^= static_cast<uint8_t>(1 << (*it % 8));
+  }
+  return true;
+}
+
+const vector<uint8_t>&
+BloomFilter::bytes() const
+{
+  return m_bits;
+}
+
+bool
+BloomFilter::assign(size_t bitCount, size_t hashCount, const vector<uint8_t>& bytes)
+{
+  if (bytes.size() != (bitCount + 7) / 8) {
+    return false;
+  }
+
+  m_bitCount = bitCount;
+  m_hashCount = hashCount;
+  m_bits = bytes;
+  return true;
+}
+
+bool
+BloomFilter::operator==(const BloomFilter& other) const
+{
+  return (m_bitCount == other.m_bitCount) && (m_hashCount == other.m_hashCount) && (m_bits == other.m_bits);
+}
+
+bool
+BloomFilter::operator!=(const BloomFilter& other) const
+{
+  return !(*this == other);
+}
+
+uint64_t
+BloomFilter::keyOf(const Cd& cd)
+{
+  uint64_t key = FnvOffsetBasis;
+  for (auto it = cd.elements().cbegin(); it != cd.elements().cend(); it++) {
+    if (it->type() != tlv::CdComponent) {
+      break;
+    }
+    key = mix(key, *it);
+  }
+  return key;
+}
+
+uint64_t
+BloomFilter::mix(uint64_t key, const Block& component)
+{
+  // FNV-1a of the value, preceded by its length so that prefixes stay distinct
+  uint32_t size = static_cast<uint32_t>(component.value_size());
+  for (size_t i = 0; i < sizeof(size); i++) {
+    key ^= static_cast<uint8_t>(size >> (i * 8));
+    key *= FnvPrime;
+  }
+  for (size_t i = 0; i < component.value_size(); i++) {
+    key ^= component.value()[i];
+    key *= FnvPrime;
+  }
+  return key;
+}
+
+} // namespace router
+} // namespace fcopss
@@ -0,0 +1,120 @@
+/*
+  bloom-filter.hpp
+
+  Copyright (c) 2019 KOZO KEIKAKU ENGINEERING Inc.
+
+  This software is released under the MIT License
+
+  Permission is hereby granted, free of charge, to any person obtaining a copy
+  of this software and associated documentation files (the "Software"), to deal
+  in the Software without restriction, including without limitation the rights
+  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+  copies of the Software, and to permit persons to whom the Software is
+  furnished to do so, subject to the following conditions:
+
+  The above copyright notice and this permission notice shall be included in all
+  copies or substantial portions of the Software.
+
+  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+  SOFTWARE.
+*/
+#ifndef _FCOPSS_ROUTER_BLOOM_FILTER_HPP_
+#define _FCOPSS_ROUTER_BLOOM_FILTER_HPP_
+
+#include <fcopss/common.hpp>
+#include <fcopss/cd.hpp>
+
+namespace fcopss {
+namespace router {
+
+// Bloom filter over CD prefixes, the payload of a SubSummary.
+//
+// A subscription is inserted as the plain components leading its CD, which
+// every matching publication CD starts with, and a publication is tested with
+// all of its prefixes. Optional groups and asterisks therefore only widen the
+// filter, they never cause a missed match.
+class BloomFilter
+{
+public:
+  BloomFilter();
+
+  BloomFilter(size_t bitCount, size_t hashCount);
+
+  size_t
+  bitCount() const;
+
+  size_t
+  hashCount() const;
+
+  bool
+  isEmpty() const;
+
+  void
+  clear();
+
+  // sets every bit, so that everything matches
+  void
+  fill();
+
+  void
+  insert(uint64_t key);
+
+  bool
+  contains(uint64_t key) const;
+
+  // key of the subscription CD
+  void
+  insert(const Cd& cd);
+
+  // true if the filter may hold a subscription matching the publication CD
+  bool
+  mayMatch(const Cd& cd) const;
+
+  // ORs in another filter, one of a different geometry fills this filter
+  void
+  merge(const BloomFilter& other);
+
+  // indexes of the bits in which the filters differ
+  void
+  diff(const BloomFilter& other, vector<uint32_t>& toggles) const;
+
+  // false if an index is out of range, the filter is unchanged then
+  bool
+  toggle(const vector<uint32_t>& toggles);
+
+  const vector<uint8_t>&
+  bytes() const;
+
+  // false if the size does not fit the geometry
+  bool
+  assign(size_t bitCount, size_t hashCount, const vector<uint8_t>& bytes);
+
+  bool
+  operator==(const BloomFilter& other) const;
+
+  bool
+  operator!=(const BloomFilter& other) const;
+
+  // key of the plain components leading a subscription CD
+  static uint64_t
+  keyOf(const Cd& cd);
+
+private:
+  static uint64_t
+  mix(uint64_t key, const Block& component);
+
+private:
+  size_t m_bitCount;
+  size_t m_hashCount;
+  vector<uint8_t> m_bits;
+};
+
+} // namespace router
+} // namespace fcopss
+
+#endif // _FCOPSS_ROUTER_BLOOM_FILTER_HPP_
@@ -0,0 +1,93 @@
+/*
+  change-log.cpp
+
+  Copyright (c) 2019 KOZO KEIKAKU ENGINEERING Inc.
+
+  This software is released under the MIT License
+
+  Permission is hereby granted, free of charge, to any person obtaining a copy
+  of this software and associated documentation files (the "Software"), to deal
+  in the Software without restriction, including without limitation the rights
+  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+  copies of the Software, and to permit persons to whom the Software is
+  furnished to do so, subject to the following conditions:
+
+  The above copyright notice and this permission notice shall be included in all
+  copies or substantial portions of the Software.
+
+  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+  SOFTWARE.
+*/
+#include "change-log.hpp"
+
+namespace fcopss {
+namespace router {
+
+ChangeLog::ChangeLog(size_t capacity)
+  : m_capacity(std::max<size_t>(capacity, 1)), m_generation(0), m_resetGeneration(0)
+{
+}
+
+uint64_t
+ChangeLog::generation() const
+{
+  return m_generation;
+}
+
+void
+ChangeLog::record(const Cd& cd)
+{
+  if (m_cds.empty()) {
+    m_cds.resize(m_capacity);
+  }
+  m_generation++;
+  m_cds[m_generation % m_capacity] = cd;
+
+  if (m_observer) {
+    m_observer(&m_cds[m_generation % m_capacity]);
+  }
+}
+
+void
+ChangeLog::reset()
+{
+  reset(m_generation + 1);
+}
+
+void
+ChangeLog::reset(uint64_t generation)
+{
+  m_generation = std::max(generation, m_generation + 1);
+  m_resetGeneration = m_generation;
+
+  if (m_observer) {
+    m_observer(nullptr);
+  }
+}
+
+bool
+ChangeLog::hasSince(uint64_t generation) const
+{
+  return (generation >= m_resetGeneration) && (generation <= m_generation) &&
+         (m_generation - generation <= m_capacity);
+}
+
+const Cd&
+ChangeLog::at(uint64_t generation) const
+{
+  return m_cds[generation % m_capacity];
+}
+
+void
+ChangeLog::setObserver(const Observer& observer)
+{
+  m_observer = observer;
+}
+
+} // namespace router
+} // namespace fcopss
@@ -0,0 +1,95 @@
+/*
+  change-log.hpp
+
+  Copyright (c) 2019 KOZO KEIKAKU ENGINEERING Inc.
+
+  This software is released under the MIT License
+
+  Permission is hereby granted, free of charge, to any person obtaining a copy
+  of this software and associated documentation files (the "Software"), to deal
+  in the Software without restriction, including without limitation the rights
+  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+  copies of the Software, and to permit persons to whom the Software is
+  furnished to do so, subject to the following conditions:
+
+  The above copyright notice and this permission notice shall be included in all
+  copies or substantial portions of the Software.
+
+  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+  SOFTWARE.
+*/
+#ifndef _FCOPSS_ROUTER_CHANGE_LOG_HPP_
+#define _FCOPSS_ROUTER_CHANGE_LOG_HPP_
+
+#include <fcopss/common.hpp>
+#include <fcopss/cd.hpp>
+
+namespace fcopss {
+namespace router {
+
+// Recent changes of an ST or a FIB, for whoever keeps results derived from it.
+//
+// Each change is recorded as the CD of the entry it added, modified or
+// removed, and moves generation() on by one.  The last `capacity` changes are
+// kept in a ring, so a reader that saw generation g can look at the changes
+// after it with at() while hasSince(g) holds, and has to start over otherwise.
+// reset() stands for a change of every entry at once, like clear().  A change
+// is recorded once the table has applied it.
+class ChangeLog final : noncopyable
+{
+public:
+  static const size_t DefaultCapacity = 1024;
+
+  // called with the CD of each change as it is recorded, nullptr for a reset()
+  using Observer = function<void(const Cd* cd)>;
+
+  explicit
+  ChangeLog(size_t capacity = DefaultCapacity);
+
+  // number of changes and resets so far
+  uint64_t
+  generation() const;
+
+  void
+  record(const Cd& cd);
+
+  // forgets the changes recorded so far
+  void
+  reset();
+
+  // reset() to `generation`, past the current one, so that tables exchanging
+  // their entries can both move past either one
+  void
+  reset(uint64_t generation);
+
+  // true if every change after `generation` is still kept
+  bool
+  hasSince(uint64_t generation) const;
+
+  // CD of the change that moved generation() to `generation`, which must be
+  // one of the changes hasSince() tells are kept
+  const Cd&
+  at(uint64_t generation) const;
+
+  void
+  setObserver(const Observer& observer);
+
+private:
+  size_t m_capacity;
+  uint64_t m_generation;
+  // generation of the last reset, changes up to it are gone
+  uint64_t m_resetGeneration;
+  // change g at g % m_capacity, allocated with the first change
+  vector<Cd> m_cds;
+  Observer m_observer;
+};
+
+} // namespace router
+} // namespace fcopss
+
+#endif // _FCOPSS_ROUTER_CHANGE_LOG_HPP_
@@ -29,6 +29,7 @@
 #include "face-manager.hpp"
 #include "fib.hpp"
 #include "st.hpp"
+#include "match-cache.hpp"
 
 #include <boost/bind.hpp>
 #include <boost/lexical_cast.hpp>
@@ -56,7 +57,10 @@ CmdServer::CmdServer(
   const time_duration& connectTimeout,
   FaceManager& faceManager,
   Fib& fib,
-  St& st)
+  St& st,
+  MatchCache& fibCache,
+  MatchCache& stCache,
+  FibLoader& fibLoader)
     : m_ioService(ioService),
       m_endPoint(tcp::v4(), ctrlPort),
       m_acceptor(m_ioService, m_endPoint, true),
@@ -67,6 +71,9 @@ CmdServer::CmdServer(
       m_faceManager(faceManager),
       m_fib(fib),
       m_st(st),
+      m_fibCache(fibCache),
+      m_stCache(stCache),
+      m_fibLoader(fibLoader),
       m_receiveTimer(ioService),
       m_connectTimer(ioService)
 {
@@ -134,6 +141,9 @@ CmdServer::handleReceive(const boost::system::error_code& error, size_t bytes_tr
       case FibAdd:
         fibAdd(arg);
         break;
+      case FibLoad:
+        fibLoad(arg);
+        break;
       case FibDel:
         if (!arg.empty()) {
           fibDel(arg);
@@ -156,6 +166,12 @@ CmdServer::handleReceive(const boost::system::error_code& error, size_t bytes_tr
       case FaceDump:
         faceDump();
         break;
+      case CacheDump:
+        cacheDump();
+        break;
+      case StStat:
+        stStat();
+        break;
       }
     } else if ((error == asio::error::eof) || (error == asio::error::connection_reset)) {
       DEBUG("%s", error.message().c_str());
@@ -190,6 +206,8 @@ CmdServer::readCmd(size_t length, CmdArg& arg)
     boost::trim_right_if(line, boost::is_any_of("\r"));
     if (line == "FIB-ADD") {
       cmdType = FibAdd;
+    } else if (line == "FIB-LOAD") {
+      cmdType = FibLoad;
     } else if (line == "FIB-DEL") {
       cmdType = FibDel;
     } else if (line == "ST-DEL") {
@@ -202,6 +220,10 @@ CmdServer::readCmd(size_t length, CmdArg& arg)
       cmdType = FibDump;
     } else if (line == "FACE-DUMP") {
       cmdType = FaceDump;
+    } else if (line == "CACHE-DUMP") {
+      cmdType = CacheDump;
+    } else if (line == "ST-STAT") {
+      cmdType = StStat;
     } else {
       string what = string("unknown control command: ") + line;
       BOOST_THROW_EXCEPTION(Error(what));
@@ -294,7 +316,7 @@ void CmdServer::fibAddUdpFace(const string& name, const string& ip, uint16_t por
     BOOST_THROW_EXCEPTION(Error("local endpoint and remote endpoint are the same"));
   }
 
-  shared_ptr<Transport> transport = UdpTransport::create(std::move(s));
+  shared_ptr<Transport> transport = UdpTransport::create(m_faceManager.pin(std::move(s)));
   m_faceManager.createFace(transport);
 
   fibAdd(name, TypeUdp, ip, port, cost);
@@ -338,7 +360,7 @@ CmdServer::handleConnect(const string& name, const string& ip, uint16_t port, ui
     tcp::endpoint local = m_connection->local_endpoint();
     tcp::endpoint remote = m_connection->remote_endpoint();
     if (local != remote) {
-      shared_ptr<Transport> transport = TcpTransport::create(std::move(*m_connection), m_receiveTimeout);
+      shared_ptr<Transport> transport = TcpTransport::create(m_faceManager.pin(std::move(*m_connection)), m_receiveTimeout);
       m_faceManager.createFace(transport);
       m_connection.reset();
       fibAdd(name, TypeTcp, ip, port, cost);
@@ -362,6 +384,46 @@ CmdServer::handleConnect(const string& name, const string& ip, uint16_t port, ui
   asyncReceive();
 }
 
+void
+CmdServer::fibLoad(const CmdArg& cmdArg)
+{
+  string path;
+
+  try {
+    path = cmdArg.at("FILE");
+  } catch (...) {
+    string what = string("illegal control command arg");
+    BOOST_THROW_EXCEPTION(Error(what));
+  }
+
+  // replied to once the new FIB is swapped in
+  m_fibLoader.load(path, [this] (const FibLoader::Result& result) { handleFibLoaded(result); });
+}
+
+void
+CmdServer::handleFibLoaded(const FibLoader::Result& result)
+{
+  if (!result.m_error.empty()) {
+    sendErr(result.m_error);
+    asyncReceive();
+    return;
+  }
+
+  stringstream ss;
+  ss << "OK" << "\r\n";
+
+  ss << "FIB-LOAD-ROUTES: " << result.m_routes << "\r\n";
+  ss << "FIB-LOAD-NEXT-HOPS: " << result.m_nextHops << "\r\n";
+  ss << "FIB-LOAD-FACES: " << result.m_faces << "\r\n";
+  ss << "FIB-LOAD-FAILED-FACES: " << result.m_failedFaces << "\r\n";
+  ss << "FIB-LOAD-MSEC: " << result.m_elapsed.total_milliseconds() << "\r\n";
+  ss << "\r\n";
+
+  sendReply(ss.str());
+
+  asyncReceive();
+}
+
 void
 CmdServer::fibDel(const CmdArg& cmdArg)
 {
@@ -524,6 +586,52 @@ CmdServer::faceDump()
   asyncReceive();
 }
 
+void
+CmdServer::cacheDump()
+{
+  // with workers, up to the last sync of their lanes
+  MatchCache::Counters fib = m_fibCache.totalCounters();
+  MatchCache::Counters st = m_stCache.totalCounters();
+
+  stringstream ss;
+  ss << "OK" << "\r\n";
+
+  ss << "FIB-CACHE-COUNT: " << fib.m_size << "\r\n";
+  ss << "FIB-CACHE-HIT: " << fib.m_hits << "\r\n";
+  ss << "FIB-CACHE-MISS: " << fib.m_misses << "\r\n";
+  ss << "ST-CACHE-COUNT: " << st.m_size << "\r\n";
+  ss << "ST-CACHE-HIT: " << st.m_hits << "\r\n";
+  ss << "ST-CACHE-MISS: " << st.m_misses << "\r\n";
+  ss << "\r\n";
+
+  sendReply(ss.str());
+
+  asyncReceive();
+}
+
+void
+CmdServer::stStat()
+{
+  size_t count = m_st.size();
+  size_t bytes = m_st.memoryUsage();
+  StCapacityCounters counters = m_st.capacityCounters();
+
+  stringstream ss;
+  ss << "OK" << "\r\n";
+
+  ss << "ST-ENTRY-COUNT: " << count << "\r\n";
+  ss << "ST-MEMORY-BYTES: " << bytes << "\r\n";
+  ss << "ST-BYTES-PER-ENTRY: " << ((count > 0) ? (bytes / count) : 0) << "\r\n";
+  ss << "ST-REJECTED-FULL: " << counters.m_rejectedFull << "\r\n";
+  ss << "ST-REJECTED-FACE-QUOTA: " << counters.m_rejectedFaceQuota << "\r\n";
+  ss << "ST-EVICTED: " << counters.m_evicted << "\r\n";
+  ss << "\r\n";
+
+  sendReply(ss.str());
+
+  asyncReceive();
+}
+
 void
 CmdServer::sendOk()
 {
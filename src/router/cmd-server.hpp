@@ -29,6 +29,7 @@
 #include <fcopss/common.hpp>
 
 #include "face.hpp"
+#include "fib-loader.hpp"
 
 namespace fcopss {
 namespace router {
@@ -38,6 +39,7 @@ using CmdArg = std::map<string, string>;
 class FaceManager;
 class Fib;
 class St;
+class MatchCache;
 
 class CmdServer final : public noncopyable
 {
@@ -61,7 +63,10 @@ public:
     const time_duration& connectTimeout,
     FaceManager& faceManager,
     Fib& fib,
-    St& st);
+    St& st,
+    MatchCache& fibCache,
+    MatchCache& stCache,
+    FibLoader& fibLoader);
 
   void
   start();
@@ -75,7 +80,10 @@ private:
     FaceDel = 4,
     StDump = 5,
     FibDump = 6,
-    FaceDump = 7
+    FaceDump = 7,
+    CacheDump = 8,
+    StStat = 9,
+    FibLoad = 10
   };
 
   void
@@ -114,6 +122,12 @@ private:
   void
   handleConnect(const string& name, const string& ip, uint16_t port, uint32_t cost, const boost::system::error_code& error);
 
+  void
+  fibLoad(const CmdArg& cmdArg);
+
+  void
+  handleFibLoaded(const FibLoader::Result& result);
+
   void
   fibDel(const CmdArg& cmdArg);
 
@@ -144,6 +158,12 @@ private:
   void
   faceDump();
 
+  void
+  cacheDump();
+
+  void
+  stStat();
+
   void
   sendOk();
 
@@ -167,6 +187,9 @@ private:
   FaceManager& m_faceManager;
   Fib& m_fib;
   St& m_st;
+  MatchCache& m_fibCache;
+  MatchCache& m_stCache;
+  FibLoader& m_fibLoader;
   boost::asio::streambuf m_receiveBuffer;
   boost::asio::deadline_timer m_receiveTimer;
   boost::asio::deadline_timer m_connectTimer;
@@ -0,0 +1,161 @@
+/*
+  compact-st-entry.cpp
+
+  Copyright (c) 2019 KOZO KEIKAKU ENGINEERING Inc.
+
+  This software is released under the MIT License
+
+  Permission is hereby granted, free of charge, to any person obtaining a copy
+  of this software and associated documentation files (the "Software"), to deal
+  in the Software without restriction, including without limitation the rights
+  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+  copies of the Software, and to permit persons to whom the Software is
+  furnished to do so, subject to the following conditions:
+
+  The above copyright notice and this permission notice shall be included in all
+  copies or substantial portions of the Software.
+
+  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+  SOFTWARE.
+*/
+#include "compact-st-entry.hpp"
+
+namespace fcopss {
+namespace router {
+
+static_assert((sizeof (void*) != 8) || (sizeof (CompactStEntry) == 112), "CompactStEntry layout grew");
+
+CompactStEntry::CompactStEntry()
+  : m_signature(0), m_lastForwarded(0), m_nextHopCount(0), m_cdSize(0)
+{
+}
+
+bool
+CompactStEntry::isFree() const
+{
+  return (m_cdSize == 0);
+}
+
+void
+CompactStEntry::assign(const Block& wire, uint64_t signature)
+{
+  clear();
+
+  m_cdSize = wire.size();
+  if (m_cdSize > InlineCdSize) {
+    m_heapCd.reset(new uint8_t[m_cdSize]);
+    memcpy(m_heapCd.get(), wire.wire(), m_cdSize);
+  } else {
+    memcpy(m_inlineCd, wire.wire(), m_cdSize);
+  }
+  m_signature = signature;
+}
+
+void
+CompactStEntry::clear()
+{
+  m_heapCd.reset();
+  m_moreNextHops.reset();
+  m_nextHopCount = 0;
+  m_cdSize = 0;
+  m_signature = 0;
+  m_lastForwarded = 0;
+}
+
+const uint8_t*
+CompactStEntry::cd() const
+{
+  return m_heapCd ? m_heapCd.get() : m_inlineCd;
+}
+
+size_t
+CompactStEntry::cdSize() const
+{
+  return m_cdSize;
+}
+
+Cd
+CompactStEntry::decodeCd() const
+{
+  bool ok;
+  Block wire;
+  tie(ok, wire) = Block::fromBuffer(cd(), cdSize());
+  return Cd(wire);
+}
+
+size_t
+CompactStEntry::nextHopCount() const
+{
+  return m_nextHopCount;
+}
+
+CompactStEntry::NextHop&
+CompactStEntry::nextHopAt(size_t i)
+{
+  return (i < InlineNextHops) ? m_nextHops[i] : (*m_moreNextHops)[i - InlineNextHops];
+}
+
+const CompactStEntry::NextHop&
+CompactStEntry::nextHopAt(size_t i) const
+{
+  return (i < InlineNextHops) ? m_nextHops[i] : (*m_moreNextHops)[i - InlineNextHops];
+}
+
+size_t
+CompactStEntry::findNextHop(const FaceId& id) const
+{
+  for (size_t i = 0; i < m_nextHopCount; i++) {
+    if (nextHopAt(i).m_faceId == id) {
+      return i;
+    }
+  }
+  return m_nextHopCount;
+}
+
+void
+CompactStEntry::addNextHop(const NextHop& nextHop)
+{
+  if (m_nextHopCount < InlineNextHops) {
+    m_nextHops[m_nextHopCount] = nextHop;
+  } else {
+    if (!m_moreNextHops) {
+      m_moreNextHops.reset(new vector<NextHop>());
+    }
+    m_moreNextHops->push_back(nextHop);
+  }
+  m_nextHopCount++;
+}
+
+void
+CompactStEntry::removeNextHopAt(size_t i)
+{
+  nextHopAt(i) = nextHopAt(m_nextHopCount - 1);
+  if (m_nextHopCount > InlineNextHops) {
+    m_moreNextHops->pop_back();
+    if (m_moreNextHops->empty()) {
+      m_moreNextHops.reset();
+    }
+  }
+  m_nextHopCount--;
+}
+
+size_t
+CompactStEntry::heapSize() const
+{
+  size_t bytes = 0;
+  if (m_heapCd) {
+    bytes += m_cdSize;
+  }
+  if (m_moreNextHops) {
+    bytes += sizeof (vector<NextHop>) + m_moreNextHops->capacity() * sizeof (NextHop);
+  }
+  return bytes;
+}
+
+} // namespace router
+} // namespace fcopss
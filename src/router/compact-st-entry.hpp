@@ -0,0 +1,125 @@
+/*
+  compact-st-entry.hpp
+
+  Copyright (c) 2019 KOZO KEIKAKU ENGINEERING Inc.
+
+  This software is released under the MIT License
+
+  Permission is hereby granted, free of charge, to any person obtaining a copy
+  of this software and associated documentation files (the "Software"), to deal
+  in the Software without restriction, including without limitation the rights
+  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+  copies of the Software, and to permit persons to whom the Software is
+  furnished to do so, subject to the following conditions:
+
+  The above copyright notice and this permission notice shall be included in all
+  copies or substantial portions of the Software.
+
+  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+  SOFTWARE.
+*/
+#ifndef _FCOPSS_ROUTER_COMPACT_ST_ENTRY_HPP_
+#define _FCOPSS_ROUTER_COMPACT_ST_ENTRY_HPP_
+
+#include <fcopss/common.hpp>
+
+#include "face.hpp"
+
+namespace fcopss {
+namespace router {
+
+// ST entry of StCompact, 112 bytes for a CD of up to InlineCdSize wire bytes
+// and up to InlineNextHops next hops.
+//
+// The CD is kept as its wire encoding and next hops as (FaceId, expiry) pairs,
+// times being whole seconds on the owning table's clock, so an entry holds no
+// Block, no set node and no timer.
+class CompactStEntry final
+{
+public:
+  using Seconds = uint32_t;
+
+  static const size_t InlineCdSize = 46;
+  static const size_t InlineNextHops = 2;
+
+  class NextHop
+  {
+  public:
+    FaceId m_faceId;
+    Seconds m_expireAt;
+    // expiry the owning table has queued for this next hop
+    Seconds m_queuedAt;
+  };
+
+public:
+  CompactStEntry();
+  CompactStEntry(CompactStEntry&& entry) = default;
+  CompactStEntry& operator=(CompactStEntry&& entry) = default;
+
+  // true if the slot holds no CD
+  bool
+  isFree() const;
+
+  void
+  assign(const Block& wire, uint64_t signature);
+
+  // frees the slot
+  void
+  clear();
+
+  const uint8_t*
+  cd() const;
+
+  size_t
+  cdSize() const;
+
+  Cd
+  decodeCd() const;
+
+  size_t
+  nextHopCount() const;
+
+  NextHop&
+  nextHopAt(size_t i);
+
+  const NextHop&
+  nextHopAt(size_t i) const;
+
+  // index of next hop `id`, nextHopCount() if there is none
+  size_t
+  findNextHop(const FaceId& id) const;
+
+  void
+  addNextHop(const NextHop& nextHop);
+
+  // moves the last next hop into slot `i`
+  void
+  removeNextHopAt(size_t i);
+
+  // heap bytes held on top of sizeof (CompactStEntry)
+  size_t
+  heapSize() const;
+
+public:
+  uint64_t m_signature;
+  // 0 if never forwarded upstream
+  Seconds m_lastForwarded;
+
+private:
+  uint32_t m_nextHopCount;
+  unique_ptr<uint8_t[]> m_heapCd;
+  unique_ptr<vector<NextHop>> m_moreNextHops;
+  NextHop m_nextHops[InlineNextHops];
+  uint16_t m_cdSize;
+  uint8_t m_inlineCd[InlineCdSize];
+};
+
+} // namespace router
+} // namespace fcopss
+
+#endif // _FCOPSS_ROUTER_COMPACT_ST_ENTRY_HPP_
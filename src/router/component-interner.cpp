@@ -0,0 +1,167 @@
+/*
+  component-interner.cpp
+
+  Copyright (c) 2019 KOZO KEIKAKU ENGINEERING Inc.
+
+  This software is released under the MIT License
+
+  Permission is hereby granted, free of charge, to any person obtaining a copy
+  of this software and associated documentation files (the "Software"), to deal
+  in the Software without restriction, including without limitation the rights
+  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+  copies of the Software, and to permit persons to whom the Software is
+  furnished to do so, subject to the following conditions:
+
+  The above copyright notice and this permission notice shall be included in all
+  copies or substantial portions of the Software.
+
+  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+  SOFTWARE.
+*/
+#include "component-interner.hpp"
+#include "memory-usage.hpp"
+
+#include <cstring>
+
+namespace fcopss {
+namespace router {
+
+ComponentInterner::ComponentInterner()
+  : m_slots(1)
+{
+}
+
+ComponentInterner::Id
+ComponentInterner::intern(const Block& component)
+{
+  auto it = m_ids.find(valueOf(component));
+  if (it != m_ids.end()) {
+    m_slots[it->second].m_refCount++;
+    return it->second;
+  }
+
+  Id id;
+  if (!m_freeIds.empty()) {
+    id = m_freeIds.back();
+    m_freeIds.pop_back();
+  } else {
+    id = m_slots.size();
+    m_slots.emplace_back();
+  }
+  Slot& slot = m_slots[id];
+  slot.m_value.assign(reinterpret_cast<const char*>(component.value()), component.value_size());
+  slot.m_refCount = 1;
+  m_ids.emplace(Value{reinterpret_cast<const uint8_t*>(slot.m_value.data()), slot.m_value.size()}, id);
+  return id;
+}
+
+void
+ComponentInterner::release(Id id)
+{
+  Slot& slot = m_slots[id];
+  if (--slot.m_refCount == 0) {
+    m_ids.erase(Value{reinterpret_cast<const uint8_t*>(slot.m_value.data()), slot.m_value.size()});
+    slot.m_value.clear();
+    m_freeIds.push_back(id);
+  }
+}
+
+ComponentInterner::Id
+ComponentInterner::find(const Block& component) const
+{
+  auto it = m_ids.find(valueOf(component));
+  if (it == m_ids.end()) {
+    return Unknown;
+  }
+  return it->second;
+}
+
+void
+ComponentInterner::intern(const Cd& cd, vector<Id>& ids)
+{
+  ids.clear();
+  for (auto it = cd.elements().cbegin(); it != cd.elements().cend(); it++) {
+    ids.push_back(intern(*it));
+  }
+}
+
+void
+ComponentInterner::release(const vector<Id>& ids)
+{
+  for (auto id = ids.cbegin(); id != ids.cend(); id++) {
+    release(*id);
+  }
+}
+
+void
+ComponentInterner::find(const Cd& cd, vector<Id>& ids) const
+{
+  ids.clear();
+  for (auto it = cd.elements().cbegin(); it != cd.elements().cend(); it++) {
+    ids.push_back(find(*it));
+  }
+}
+
+void
+ComponentInterner::clear()
+{
+  m_ids.clear();
+  m_slots.resize(1);
+  m_freeIds.clear();
+}
+
+void
+ComponentInterner::swap(ComponentInterner& other)
+{
+  m_ids.swap(other.m_ids);
+  m_slots.swap(other.m_slots);
+  m_freeIds.swap(other.m_freeIds);
+}
+
+size_t
+ComponentInterner::size() const
+{
+  return m_ids.size();
+}
+
+size_t
+ComponentInterner::memoryUsage() const
+{
+  size_t bytes = hashMapMemoryUsage(m_ids) + m_slots.size() * sizeof (Slot) + vectorMemoryUsage(m_freeIds);
+  for (auto it = m_slots.cbegin(); it != m_slots.cend(); it++) {
+    bytes += stringMemoryUsage(it->m_value);
+  }
+  return bytes;
+}
+
+ComponentInterner::Value
+ComponentInterner::valueOf(const Block& component)
+{
+  return Value{component.value(), component.value_size()};
+}
+
+size_t
+ComponentInterner::ValueHash::operator()(const Value& value) const
+{
+  // FNV-1a
+  uint64_t hash = 14695981039346656037ULL;
+  for (size_t i = 0; i < value.m_size; i++) {
+    hash ^= value.m_data[i];
+    hash *= 1099511628211ULL;
+  }
+  return hash;
+}
+
+bool
+ComponentInterner::ValueEqual::operator()(const Value& a, const Value& b) const
+{
+  return (a.m_size == b.m_size) && (memcmp(a.m_data, b.m_data, a.m_size) == 0);
+}
+
+} // namespace router
+} // namespace fcopss
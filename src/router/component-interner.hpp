@@ -0,0 +1,134 @@
+/*
+  component-interner.hpp
+
+  Copyright (c) 2019 KOZO KEIKAKU ENGINEERING Inc.
+
+  This software is released under the MIT License
+
+  Permission is hereby granted, free of charge, to any person obtaining a copy
+  of this software and associated documentation files (the "Software"), to deal
+  in the Software without restriction, including without limitation the rights
+  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+  copies of the Software, and to permit persons to whom the Software is
+  furnished to do so, subject to the following conditions:
+
+  The above copyright notice and this permission notice shall be included in all
+  copies or substantial portions of the Software.
+
+  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+  SOFTWARE.
+*/
+#ifndef _FCOPSS_ROUTER_COMPONENT_INTERNER_HPP_
+#define _FCOPSS_ROUTER_COMPONENT_INTERNER_HPP_
+
+#include <fcopss/common.hpp>
+#include <fcopss/cd.hpp>
+
+#include <deque>
+#include <unordered_map>
+
+namespace fcopss {
+namespace router {
+
+// Maps CD component values to small integer IDs.
+//
+// A table interns the components of its entries once, when they are added,
+// and translates a packet CD with find() once per lookup.  Two components
+// then have the same value iff they have the same ID, so matching compares
+// integers instead of Block values.  IDs are reference counted and reused
+// once the last entry holding them is gone.
+class ComponentInterner final : noncopyable
+{
+public:
+  using Id = uint32_t;
+
+  // ID of a value that was never interned, equal to no interned ID
+  static const Id Unknown = 0;
+
+  ComponentInterner();
+
+  // ID of the value of `component`, assigned if it is new,
+  // each call must be balanced by a release()
+  Id
+  intern(const Block& component);
+
+  void
+  release(Id id);
+
+  // ID of the value of `component`, Unknown if it is not interned
+  Id
+  find(const Block& component) const;
+
+  // per component versions of the above
+  void
+  intern(const Cd& cd, vector<Id>& ids);
+
+  void
+  release(const vector<Id>& ids);
+
+  void
+  find(const Cd& cd, vector<Id>& ids) const;
+
+  void
+  clear();
+
+  void
+  swap(ComponentInterner& other);
+
+  // number of distinct values interned
+  size_t
+  size() const;
+
+  // estimated bytes taken by the table
+  size_t
+  memoryUsage() const;
+
+private:
+  // bytes of a value, either a component being looked up or an interned slot,
+  // so that find() builds no string
+  struct Value
+  {
+    const uint8_t* m_data;
+    size_t m_size;
+  };
+
+  struct ValueHash
+  {
+    size_t
+    operator()(const Value& value) const;
+  };
+
+  struct ValueEqual
+  {
+    bool
+    operator()(const Value& a, const Value& b) const;
+  };
+
+  static Value
+  valueOf(const Block& component);
+
+private:
+  struct Slot
+  {
+    string m_value;
+    size_t m_refCount;
+  };
+
+private:
+  // keys point into the m_value of their slot
+  std::unordered_map<Value, Id, ValueHash, ValueEqual> m_ids;
+  // indexed by ID, slot Unknown is never used,
+  // a deque so that growing it does not move the values keyed by m_ids
+  std::deque<Slot> m_slots;
+  vector<Id> m_freeIds;
+};
+
+} // namespace router
+} // namespace fcopss
+
+#endif // _FCOPSS_ROUTER_COMPONENT_INTERNER_HPP_
@@ -0,0 +1,119 @@
+/*
+  epoch.cpp
+
+  Copyright (c) 2019 KOZO KEIKAKU ENGINEERING Inc.
+
+  This software is released under the MIT License
+
+  Permission is hereby granted, free of charge, to any person obtaining a copy
+  of this software and associated documentation files (the "Software"), to deal
+  in the Software without restriction, including without limitation the rights
+  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+  copies of the Software, and to permit persons to whom the Software is
+  furnished to do so, subject to the following conditions:
+
+  The above copyright notice and this permission notice shall be included in all
+  copies or substantial portions of the Software.
+
+  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+  SOFTWARE.
+*/
+#include "epoch.hpp"
+
+namespace fcopss {
+namespace router {
+
+// 0 marks a quiescent reader, epochs start at 1
+static const uint64_t Quiescent = 0;
+
+EpochDomain::ReadGuard::ReadGuard(EpochDomain& domain, size_t reader)
+  : m_epoch(domain.m_readers[reader].m_epoch)
+{
+  // sequentially consistent, so that a writer scanning the readers after
+  // unpublishing either sees this epoch or is seen by the loads that follow
+  m_epoch.store(domain.m_epoch.load());
+}
+
+EpochDomain::ReadGuard::~ReadGuard()
+{
+  m_epoch.store(Quiescent, std::memory_order_release);
+}
+
+EpochDomain::EpochDomain()
+  : m_epoch(1)
+{
+  for (size_t i = 0; i < MaxReaders; i++) {
+    m_readers[i].m_epoch.store(Quiescent);
+    m_readers[i].m_isUsed.store(false);
+  }
+}
+
+EpochDomain::~EpochDomain()
+{
+  for (auto it = m_retired.begin(); it != m_retired.end(); it++) {
+    it->second();
+  }
+}
+
+size_t
+EpochDomain::registerReader()
+{
+  for (size_t i = 0; i < MaxReaders; i++) {
+    bool isUsed = false;
+    if (m_readers[i].m_isUsed.compare_exchange_strong(isUsed, true)) {
+      return i;
+    }
+  }
+  BOOST_THROW_EXCEPTION(Error("too many epoch readers"));
+}
+
+void
+EpochDomain::unregisterReader(size_t reader)
+{
+  m_readers[reader].m_epoch.store(Quiescent);
+  m_readers[reader].m_isUsed.store(false);
+}
+
+void
+EpochDomain::retire(const function<void()>& deleter)
+{
+  // readers entering from now on see the new object
+  uint64_t epoch = m_epoch.fetch_add(1) + 1;
+  m_retired.emplace_back(epoch, deleter);
+}
+
+size_t
+EpochDomain::reclaim()
+{
+  uint64_t oldest = m_epoch.load();
+  for (size_t i = 0; i < MaxReaders; i++) {
+    uint64_t epoch = m_readers[i].m_epoch.load();
+    if ((epoch != Quiescent) && (epoch < oldest)) {
+      oldest = epoch;
+    }
+  }
+
+  // retired in epoch order, what a reader of `oldest` may see starts at the
+  // first object retired after it entered
+  size_t count = 0;
+  while (!m_retired.empty() && (m_retired.front().first <= oldest)) {
+    m_retired.front().second();
+    m_retired.pop_front();
+    count++;
+  }
+  return count;
+}
+
+size_t
+EpochDomain::retiredCount() const
+{
+  return m_retired.size();
+}
+
+} // namespace router
+} // namespace fcopss
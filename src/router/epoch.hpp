@@ -0,0 +1,146 @@
+/*
+  epoch.hpp
+
+  Copyright (c) 2019 KOZO KEIKAKU ENGINEERING Inc.
+
+  This software is released under the MIT License
+
+  Permission is hereby granted, free of charge, to any person obtaining a copy
+  of this software and associated documentation files (the "Software"), to deal
+  in the Software without restriction, including without limitation the rights
+  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+  copies of the Software, and to permit persons to whom the Software is
+  furnished to do so, subject to the following conditions:
+
+  The above copyright notice and this permission notice shall be included in all
+  copies or substantial portions of the Software.
+
+  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+  SOFTWARE.
+*/
+#ifndef _FCOPSS_ROUTER_EPOCH_HPP_
+#define _FCOPSS_ROUTER_EPOCH_HPP_
+
+#include <fcopss/common.hpp>
+
+#include <atomic>
+
+namespace fcopss {
+namespace router {
+
+// Epoch based reclamation, for data read by several threads without locks.
+//
+// A reader thread registers once and brackets every access with a ReadGuard,
+// which costs two atomic stores. The single writer thread retires what it
+// unpublished, and reclaim() frees it once no reader can still be looking at
+// it, i.e. every reader has been quiescent or entered a later epoch.
+class EpochDomain final : noncopyable
+{
+public:
+  class Error : public std::runtime_error
+  {
+  public:
+    explicit
+    Error(const string& what)
+      : std::runtime_error(what)
+    {
+    }
+  };
+
+  class ReadGuard final : noncopyable
+  {
+  public:
+    ReadGuard(EpochDomain& domain, size_t reader);
+
+    ~ReadGuard();
+
+  private:
+    std::atomic<uint64_t>& m_epoch;
+  };
+
+  static const size_t MaxReaders = 64;
+
+  EpochDomain();
+
+  // frees everything still retired, no reader may be inside a ReadGuard
+  ~EpochDomain();
+
+  // slot of the calling reader thread
+  size_t
+  registerReader();
+
+  void
+  unregisterReader(size_t reader);
+
+  // writer side, after the object was unpublished
+  void
+  retire(const function<void()>& deleter);
+
+  // writer side, frees what no reader can still see, returns the count freed
+  size_t
+  reclaim();
+
+  size_t
+  retiredCount() const;
+
+private:
+  // one cache line per reader, guards on different threads do not share lines
+  struct alignas(64) Reader
+  {
+    std::atomic<uint64_t> m_epoch;
+    std::atomic<bool> m_isUsed;
+  };
+
+private:
+  std::atomic<uint64_t> m_epoch;
+  Reader m_readers[MaxReaders];
+  list<std::pair<uint64_t, function<void()>>> m_retired;
+};
+
+// Pointer published by one writer thread and read under ReadGuards.
+template<typename T>
+class RcuPtr final : noncopyable
+{
+public:
+  explicit
+  RcuPtr(EpochDomain& domain)
+    : m_domain(domain), m_ptr(nullptr)
+  {
+  }
+
+  ~RcuPtr()
+  {
+    delete m_ptr.load();
+  }
+
+  // valid until the ReadGuard it was loaded under ends,
+  // or on the writer thread until its next publish()
+  const T*
+  get() const
+  {
+    return m_ptr.load();
+  }
+
+  void
+  publish(unique_ptr<const T> value)
+  {
+    const T* old = m_ptr.exchange(value.release());
+    if (old != nullptr) {
+      m_domain.retire([old] { delete old; });
+    }
+  }
+
+private:
+  EpochDomain& m_domain;
+  std::atomic<const T*> m_ptr;
+};
+
+} // namespace router
+} // namespace fcopss
+
+#endif // _FCOPSS_ROUTER_EPOCH_HPP_
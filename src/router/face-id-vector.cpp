@@ -0,0 +1,121 @@
+/*
+  face-id-vector.cpp
+
+  Copyright (c) 2019 KOZO KEIKAKU ENGINEERING Inc.
+
+  This software is released under the MIT License
+
+  Permission is hereby granted, free of charge, to any person obtaining a copy
+  of this software and associated documentation files (the "Software"), to deal
+  in the Software without restriction, including without limitation the rights
+  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+  copies of the Software, and to permit persons to whom the Software is
+  furnished to do so, subject to the following conditions:
+
+  The above copyright notice and this permission notice shall be included in all
+  copies or substantial portions of the Software.
+
+  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+  SOFTWARE.
+*/
+#include "face-id-vector.hpp"
+
+#include <algorithm>
+
+namespace fcopss {
+namespace router {
+
+FaceIdVector::FaceIdVector()
+  : m_size(0), m_spilled(false)
+{
+}
+
+void
+FaceIdVector::clear()
+{
+  m_size = 0;
+  m_spilled = false;
+  m_spill.clear();
+}
+
+void
+FaceIdVector::push_back(const FaceId& id)
+{
+  if (m_spilled) {
+    m_spill.push_back(id);
+  } else if (m_size < InlineCapacity) {
+    m_inline[m_size++] = id;
+  } else {
+    m_spill.assign(m_inline, m_inline + m_size);
+    m_spill.push_back(id);
+    m_spilled = true;
+  }
+}
+
+void
+FaceIdVector::assign(const FaceIdVector& faceIds)
+{
+  clear();
+  for (auto id = faceIds.begin(); id != faceIds.end(); id++) {
+    push_back(*id);
+  }
+}
+
+void
+FaceIdVector::unique()
+{
+  FaceId* first = data();
+  FaceId* last = first + size();
+  std::sort(first, last);
+  size_t size = std::unique(first, last) - first;
+
+  if (m_spilled) {
+    m_spill.resize(size);
+  } else {
+    m_size = size;
+  }
+}
+
+bool
+FaceIdVector::contains(const FaceId& id) const
+{
+  return (std::find(begin(), end(), id) != end());
+}
+
+bool
+FaceIdVector::empty() const
+{
+  return (size() == 0);
+}
+
+size_t
+FaceIdVector::size() const
+{
+  return m_spilled ? m_spill.size() : m_size;
+}
+
+const FaceId*
+FaceIdVector::begin() const
+{
+  return m_spilled ? m_spill.data() : m_inline;
+}
+
+const FaceId*
+FaceIdVector::end() const
+{
+  return begin() + size();
+}
+
+FaceId*
+FaceIdVector::data()
+{
+  return m_spilled ? m_spill.data() : m_inline;
+}
+
+} // namespace router
+} // namespace fcopss
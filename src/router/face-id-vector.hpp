@@ -0,0 +1,91 @@
+/*
+  face-id-vector.hpp
+
+  Copyright (c) 2019 KOZO KEIKAKU ENGINEERING Inc.
+
+  This software is released under the MIT License
+
+  Permission is hereby granted, free of charge, to any person obtaining a copy
+  of this software and associated documentation files (the "Software"), to deal
+  in the Software without restriction, including without limitation the rights
+  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+  copies of the Software, and to permit persons to whom the Software is
+  furnished to do so, subject to the following conditions:
+
+  The above copyright notice and this permission notice shall be included in all
+  copies or substantial portions of the Software.
+
+  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+  SOFTWARE.
+*/
+#ifndef _FCOPSS_ROUTER_FACE_ID_VECTOR_HPP_
+#define _FCOPSS_ROUTER_FACE_ID_VECTOR_HPP_
+
+#include <fcopss/common.hpp>
+
+#include "face.hpp"
+
+namespace fcopss {
+namespace router {
+
+// FaceId list filled by St::match() and Fib::match().
+//
+// The first InlineCapacity ids live inside the object, longer lists spill into
+// a vector whose capacity survives clear(), so a list reused across packets
+// stops allocating once it has seen the largest fan-out.
+class FaceIdVector final : noncopyable
+{
+public:
+  static const size_t InlineCapacity = 16;
+
+  FaceIdVector();
+
+  void
+  clear();
+
+  void
+  push_back(const FaceId& id);
+
+  // replaces the content with a copy of `faceIds`
+  void
+  assign(const FaceIdVector& faceIds);
+
+  // sorts the ids and drops duplicates
+  void
+  unique();
+
+  bool
+  contains(const FaceId& id) const;
+
+  bool
+  empty() const;
+
+  size_t
+  size() const;
+
+  const FaceId*
+  begin() const;
+
+  const FaceId*
+  end() const;
+
+private:
+  FaceId*
+  data();
+
+private:
+  FaceId m_inline[InlineCapacity];
+  size_t m_size;
+  bool m_spilled;
+  vector<FaceId> m_spill;
+};
+
+} // namespace router
+} // namespace fcopss
+
+#endif // _FCOPSS_ROUTER_FACE_ID_VECTOR_HPP_
@@ -24,6 +24,11 @@
   SOFTWARE.
 */
 #include "face-manager.hpp"
+#include "worker.hpp"
+
+#include <cerrno>
+
+#include <unistd.h>
 
 #include <fcopss/log.hpp>
 
@@ -33,7 +38,7 @@ namespace fcopss {
 namespace router {
 
 FaceManager::FaceManager(io_service& ioService)
-  : m_ioService(ioService), m_faceSerial(100)
+  : m_ioService(ioService), m_faceSerial(100), m_generation(0), m_nextWorker(0)
 {
 }
 
@@ -42,17 +47,71 @@ FaceManager::setEventHandler(
   const SubReceivedCallback& onSubReceived,
   const PubToRpReceivedCallback& onPubToRpReceived,
   const PubFromRpReceivedCallback& onPubFromRpReceived,
+  const SubSummaryReceivedCallback& onSubSummaryReceived,
   const FaceShutdownCallback& onFaceShutdown)
 {
   m_onSubReceived = onSubReceived;
   m_onPubToRpReceived = onPubToRpReceived;
   m_onPubFromRpReceived = onPubFromRpReceived;
+  m_onSubSummaryReceived = onSubSummaryReceived;
   m_onFaceShutdown = onFaceShutdown;
 }
 
+void
+FaceManager::setWorkers(const vector<Worker*>& workers)
+{
+  m_workers = workers;
+}
+
+tcp::socket
+FaceManager::pin(tcp::socket&& s)
+{
+  Worker* worker = nextWorker();
+  if (worker == nullptr) {
+    return std::move(s);
+  }
+
+  int fd = ::dup(s.native_handle());
+  if (fd < 0) {
+    BOOST_THROW_EXCEPTION(boost::system::system_error(errno, boost::system::system_category(), "dup"));
+  }
+  boost::system::error_code ec;
+  s.close(ec);
+
+  tcp::socket pinned(worker->getIoService());
+  pinned.assign(tcp::v4(), fd);
+  return pinned;
+}
+
+udp::socket
+FaceManager::pin(udp::socket&& s)
+{
+  Worker* worker = nextWorker();
+  if (worker == nullptr) {
+    return std::move(s);
+  }
+
+  int fd = ::dup(s.native_handle());
+  if (fd < 0) {
+    BOOST_THROW_EXCEPTION(boost::system::system_error(errno, boost::system::system_category(), "dup"));
+  }
+  boost::system::error_code ec;
+  s.close(ec);
+
+  udp::socket pinned(worker->getIoService());
+  pinned.assign(udp::v4(), fd);
+  return pinned;
+}
+
 shared_ptr<Face>
 FaceManager::createFace(const shared_ptr<Transport>& transport)
 {
+  if (Worker::current() != nullptr) {
+    m_ioService.post([this, transport] { createFace(transport); });
+    return nullptr;
+  }
+
+  Worker* worker = findWorker(transport->getIoService());
   FaceId id = createFaceId();
   shared_ptr<Face> face = Face::create(
                             id,
@@ -60,19 +119,26 @@ FaceManager::createFace(const shared_ptr<Transport>& transport)
                             m_onSubReceived,
                             m_onPubToRpReceived,
                             m_onPubFromRpReceived,
+                            m_onSubSummaryReceived,
                             m_onFaceShutdown,
-                            m_ioService);
+                            m_ioService,
+                            worker);
 
   transport->attach(face);
 
   m_faceTable[id] = face;
+  m_generation++;
 
   INFO("FaceID=%llu Type=%s Local=%s:%hu Remote=%s:%hu added",
        face->getId(), face->getType().c_str(),
        face->getLocalIp().c_str(), face->getLocalPort(),
        face->getRemoteIp().c_str(), face->getRemotePort());
 
-  transport->start();
+  if (worker != nullptr) {
+    worker->getIoService().post([transport] { transport->start(); });
+  } else {
+    transport->start();
+  }
 
   return face;
 }
@@ -81,6 +147,7 @@ void
 FaceManager::remove(const FaceId& faceId)
 {
   m_faceTable.erase(faceId);
+  m_generation++;
 
   INFO("FaceID=%llu removed", faceId);
 }
@@ -124,6 +191,18 @@ FaceManager::dump(vector<string>& lines) const
   }
 }
 
+const FaceTable&
+FaceManager::getFaceTable() const
+{
+  return m_faceTable;
+}
+
+uint64_t
+FaceManager::generation() const
+{
+  return m_generation;
+}
+
 FaceId
 FaceManager::createFaceId()
 {
@@ -131,5 +210,27 @@ FaceManager::createFaceId()
   return m_faceSerial;
 }
 
+Worker*
+FaceManager::nextWorker()
+{
+  if (m_workers.empty()) {
+    return nullptr;
+  }
+  Worker* worker = m_workers[m_nextWorker % m_workers.size()];
+  m_nextWorker++;
+  return worker;
+}
+
+Worker*
+FaceManager::findWorker(io_service& ioService) const
+{
+  for (auto worker = m_workers.cbegin(); worker != m_workers.cend(); worker++) {
+    if (&(*worker)->getIoService() == &ioService) {
+      return *worker;
+    }
+  }
+  return nullptr;
+}
+
 } // namespace router
 } // namespace fcopss
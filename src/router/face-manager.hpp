@@ -35,6 +35,8 @@
 namespace fcopss {
 namespace router {
 
+class Worker;
+
 using FaceTable = std::map<FaceId, shared_ptr<Face>>;
 
 class FaceManager final : noncopyable
@@ -47,9 +49,24 @@ public:
     const SubReceivedCallback& onSubReceived,
     const PubToRpReceivedCallback& onPubToRpReceived,
     const PubFromRpReceivedCallback& onPubFromRpReceived,
+    const SubSummaryReceivedCallback& onSubSummaryReceived,
     const FaceShutdownCallback& onFaceShutdown
   );
 
+  // faces get pinned to these, none to keep every face on the control io_service
+  void
+  setWorkers(const vector<Worker*>& workers);
+
+  // moves a socket opened on the control io_service to the next worker in turn,
+  // its face is then pinned to that worker
+  tcp::socket
+  pin(tcp::socket&& s);
+
+  udp::socket
+  pin(udp::socket&& s);
+
+  // control thread, a transport accepted by a worker gets its face later on
+  // the control thread and nullptr is returned
   shared_ptr<Face>
   createFace(const shared_ptr<Transport>& transport);
 
@@ -65,20 +82,37 @@ public:
   void
   dump(vector<string>& lines) const;
 
+  const FaceTable&
+  getFaceTable() const;
+
+  // changes whenever a face is added or removed
+  uint64_t
+  generation() const;
+
 private:
   FaceId
   createFaceId();
 
+  Worker*
+  nextWorker();
+
+  Worker*
+  findWorker(io_service& ioService) const;
+
 private:
   io_service& m_ioService;
 
   SubReceivedCallback m_onSubReceived;
   PubToRpReceivedCallback m_onPubToRpReceived;
   PubFromRpReceivedCallback m_onPubFromRpReceived;
+  SubSummaryReceivedCallback m_onSubSummaryReceived;
   FaceShutdownCallback m_onFaceShutdown;
 
   FaceId m_faceSerial;
   FaceTable m_faceTable;
+  uint64_t m_generation;
+  vector<Worker*> m_workers;
+  size_t m_nextWorker;
 };
 
 } // namespace router
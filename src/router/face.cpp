@@ -24,6 +24,7 @@
   SOFTWARE.
 */
 #include "face.hpp"
+#include "worker.hpp"
 
 #include <fcopss/log.hpp>
 
@@ -37,10 +38,13 @@ Face::create(
     const SubReceivedCallback& onSubReceived,
     const PubToRpReceivedCallback& onPubToRpReceived,
     const PubFromRpReceivedCallback& onPubFromRpReceived,
+    const SubSummaryReceivedCallback& onSubSummaryReceived,
     const FaceShutdownCallback& onFaceShutdown,
-    boost::asio::io_service& ioService)
+    boost::asio::io_service& ioService,
+    Worker* worker)
 {
-  return shared_ptr<Face>(new Face(id, transport, onSubReceived, onPubToRpReceived, onPubFromRpReceived, onFaceShutdown, ioService));
+  return shared_ptr<Face>(new Face(id, transport, onSubReceived, onPubToRpReceived, onPubFromRpReceived,
+                                   onSubSummaryReceived, onFaceShutdown, ioService, worker));
 }
 
 Face::Face(
@@ -49,15 +53,19 @@ Face::Face(
     const SubReceivedCallback& onSubReceived,
     const PubToRpReceivedCallback& onPubToRpReceived,
     const PubFromRpReceivedCallback& onPubFromRpReceived,
+    const SubSummaryReceivedCallback& onSubSummaryReceived,
     const FaceShutdownCallback& onFaceShutdown,
-    boost::asio::io_service& ioService)
+    boost::asio::io_service& ioService,
+    Worker* worker)
       : m_id(id),
         m_transport(transport),
         m_onSubReceived(onSubReceived),
         m_onPubToRpReceived(onPubToRpReceived),
         m_onPubFromRpReceived(onPubFromRpReceived),
+        m_onSubSummaryReceived(onSubSummaryReceived),
         m_onFaceShutdown(onFaceShutdown),
-        m_ioService(ioService)
+        m_ioService(ioService),
+        m_worker(worker)
 {
   m_type = transport->getType();
   m_localIp = transport->getLocalIp();
@@ -67,24 +75,51 @@ Face::Face(
 }
 
 void
-Face::onPacketReceived(Block&& packet)
+Face::onPacketsReceived(vector<Block>& packets)
 {
-  try {
-    if (packet.type() == tlv::Sub) {
-      auto sub = make_shared<Sub>(packet);
-      m_onSubReceived(m_id, *sub);
-    } else if (packet.type() == tlv::PubToRp) {
-      auto pub = make_shared<PubToRp>(packet);
-      m_onPubToRpReceived(m_id, *pub);
-    } else if (packet.type() == tlv::PubFromRp) {
-      auto pub = make_shared<PubFromRp>(packet);
-      m_onPubFromRpReceived(m_id, *pub);
-    } else {
-      WARN("unknown packet received: TLV type=%d", packet.type());
+  for (auto packet = packets.begin(); packet != packets.end(); packet++) {
+    try {
+      if (packet->type() == tlv::PubFromRp) {
+        m_pubFromRps.emplace_back(*packet);
+        continue;
+      }
+
+      // keep the arrival order, e.g. a Sub must reach the ST before the Pubs after it
+      flushPubFromRps();
+
+      if (packet->type() == tlv::Sub) {
+        auto sub = make_shared<Sub>(*packet);
+        m_onSubReceived(m_id, *sub);
+      } else if (packet->type() == tlv::PubToRp) {
+        auto pub = make_shared<PubToRp>(*packet);
+        m_onPubToRpReceived(m_id, *pub);
+      } else if (packet->type() == tlv::SubSummary) {
+        auto summary = make_shared<SubSummary>(*packet);
+        m_onSubSummaryReceived(m_id, *summary);
+      } else {
+        WARN("unknown packet received: TLV type=%d", packet->type());
+      }
+    } catch (const runtime_error& e) {
+      ERROR("%s", e.what());
     }
+  }
+
+  flushPubFromRps();
+}
+
+void
+Face::flushPubFromRps()
+{
+  if (m_pubFromRps.empty()) {
+    return;
+  }
+
+  try {
+    m_onPubFromRpReceived(m_id, m_pubFromRps);
   } catch (const runtime_error& e) {
     ERROR("%s", e.what());
   }
+  m_pubFromRps.clear();
 }
 
 void
@@ -96,6 +131,11 @@ Face::onTransportShutdown()
 void
 Face::shutdown()
 {
+  if ((m_worker != nullptr) && (Worker::current() != m_worker)) {
+    shared_ptr<Transport> transport = m_transport;
+    m_worker->getIoService().post([transport] { transport->shutdown(); });
+    return;
+  }
   m_transport->shutdown();
 }
 
@@ -103,20 +143,37 @@ void
 Face::send(const Sub& sub)
 {
   Block packet(sub.wireEncode());
-  m_transport->send(std::move(packet));
+  send(std::move(packet));
 }
 
 void
 Face::send(const PubToRp& pub)
 {
   Block packet(pub.wireEncode());
-  m_transport->send(std::move(packet));
+  send(std::move(packet));
 }
 
 void
 Face::send(const PubFromRp& pub)
 {
   Block packet(pub.wireEncode());
+  send(std::move(packet));
+}
+
+void
+Face::send(const SubSummary& summary)
+{
+  Block packet(summary.wireEncode());
+  send(std::move(packet));
+}
+
+void
+Face::send(Block&& packet)
+{
+  if ((m_worker != nullptr) && (Worker::current() != m_worker)) {
+    m_worker->send(m_transport, std::move(packet));
+    return;
+  }
   m_transport->send(std::move(packet));
 }
 
@@ -30,16 +30,21 @@
 #include <fcopss/sub.hpp>
 #include <fcopss/pub-to-rp.hpp>
 #include <fcopss/pub-from-rp.hpp>
+#include <fcopss/sub-summary.hpp>
 
 #include "transport.hpp"
 
 namespace fcopss {
 namespace router {
 
+class Worker;
+
 using FaceId = uint64_t;
 using SubReceivedCallback = function<void(const FaceId&, const Sub&)>;
 using PubToRpReceivedCallback = function<void(const FaceId&, const PubToRp&)>;
-using PubFromRpReceivedCallback = function<void(const FaceId&, const PubFromRp&)>; 
+// back-to-back PubFromRp packets are delivered together, so they can be matched as a batch
+using PubFromRpReceivedCallback = function<void(const FaceId&, const vector<PubFromRp>&)>;
+using SubSummaryReceivedCallback = function<void(const FaceId&, const SubSummary&)>;
 using FaceShutdownCallback = function<void(FaceId)>; 
 
 class Face final : public noncopyable
@@ -52,12 +57,15 @@ public:
     const SubReceivedCallback& onSubReceived,
     const PubToRpReceivedCallback& onPubToRpReceived,
     const PubFromRpReceivedCallback& onPubFromRpReceived,
+    const SubSummaryReceivedCallback& onSubSummaryReceived,
     const FaceShutdownCallback& onFaceShutdown,
-    boost::asio::io_service& ioService
+    boost::asio::io_service& ioService,
+    Worker* worker
   );
 
+  // packets read by one transport receive, dispatched in order
   void
-  onPacketReceived(Block&& packet);
+  onPacketsReceived(vector<Block>& packets);
 
   void
   onTransportShutdown();
@@ -74,6 +82,9 @@ public:
   void
   send(const PubFromRp& pub);
 
+  void
+  send(const SubSummary& summary);
+
   const FaceId&
   getId() const;
 
@@ -102,16 +113,26 @@ private:
     const SubReceivedCallback& onSubReceived,
     const PubToRpReceivedCallback& onPubToRpReceived,
     const PubFromRpReceivedCallback& onPubFromRpReceived,
+    const SubSummaryReceivedCallback& onSubSummaryReceived,
     const FaceShutdownCallback& onFaceShutdown,
-    boost::asio::io_service& ioService
+    boost::asio::io_service& ioService,
+    Worker* worker
   );
 
+  void
+  flushPubFromRps();
+
+  // on the thread of the transport, through the queue of its worker from other threads
+  void
+  send(Block&& packet);
+
 private:
   FaceId m_id;
   shared_ptr<Transport> m_transport;
   SubReceivedCallback m_onSubReceived;
   PubToRpReceivedCallback m_onPubToRpReceived;
   PubFromRpReceivedCallback m_onPubFromRpReceived;
+  SubSummaryReceivedCallback m_onSubSummaryReceived;
   FaceShutdownCallback m_onFaceShutdown;
   string m_type;
   string m_localIp;
@@ -119,6 +140,10 @@ private:
   string m_remoteIp;
   uint16_t m_remotePort;
   boost::asio::io_service& m_ioService;
+  // worker the transport is pinned to, nullptr if it runs on m_ioService
+  Worker* m_worker;
+  // consecutive PubFromRp packets not yet dispatched
+  vector<PubFromRp> m_pubFromRps;
 };
 
 } // namespace router
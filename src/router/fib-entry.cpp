@@ -25,6 +25,8 @@
 */
 #include "fib-entry.hpp"
 
+#include <algorithm>
+
 namespace fcopss {
 namespace router {
 
@@ -78,18 +80,20 @@ FibEntry::NextHop::toString() const
 
 
 FibEntry::FibEntry()
+  : m_equalCostCount(0)
 {
 }
 
 FibEntry::FibEntry(const Cd& cd)
-  : m_cd(cd)
+  : m_cd(cd), m_equalCostCount(0)
 {
 }
 
 FibEntry::FibEntry(const Cd& cd, const NextHop& nextHop)
-   : m_cd(cd)
+   : m_cd(cd), m_equalCostCount(0)
 {
   m_nextHops.insert(nextHop);
+  rankNextHops();
 }
 
 bool
@@ -104,6 +108,35 @@ FibEntry::operator!=(const FibEntry& fibEntry) const
   return !operator==(fibEntry);
 }
 
+void
+FibEntry::rankNextHops()
+{
+  m_rankedNextHops.assign(m_nextHops.cbegin(), m_nextHops.cend());
+  // stable, equal costs stay in FaceId order
+  std::stable_sort(m_rankedNextHops.begin(), m_rankedNextHops.end(),
+                   [](const NextHop& lhs, const NextHop& rhs) {
+                     return (lhs.m_cost < rhs.m_cost);
+                   });
+
+  m_equalCostCount = 0;
+  while ((m_equalCostCount < m_rankedNextHops.size()) &&
+         (m_rankedNextHops[m_equalCostCount].m_cost == m_rankedNextHops.front().m_cost)) {
+    m_equalCostCount++;
+  }
+}
+
+const FibEntry::NextHop&
+FibEntry::bestNextHop() const
+{
+  return m_rankedNextHops.front();
+}
+
+const FibEntry::NextHop&
+FibEntry::flowNextHop(uint64_t flowHash) const
+{
+  return m_rankedNextHops[flowHash % m_equalCostCount];
+}
+
 string
 FibEntry::toString() const
 {
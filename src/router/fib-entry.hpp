@@ -29,7 +29,9 @@
 #include <fcopss/common.hpp>
 
 #include "face.hpp"
+#include "component-interner.hpp"
 
+#include <map>
 #include <set>
 
 namespace fcopss {
@@ -72,12 +74,32 @@ public:
   bool operator!=(const FibEntry& fibEntry) const;
 
 public:
+  // recomputes m_rankedNextHops, whenever m_nextHops changed
+  void
+  rankNextHops();
+
+  // least cost next hop, m_nextHops may not be empty
+  const NextHop&
+  bestNextHop() const;
+
+  // one of the m_equalCostCount least cost next hops, picked by `flowHash`
+  const NextHop&
+  flowNextHop(uint64_t flowHash) const;
+
   string
   toString() const;
  
 public:
   Cd m_cd;
   std::set<NextHop> m_nextHops;
+  // m_nextHops by increasing cost, then FaceId : the best one, then the backups
+  vector<NextHop> m_rankedNextHops;
+  // leading m_rankedNextHops sharing the least cost, the ECMP group
+  size_t m_equalCostCount;
+  // IDs of the m_cd components in the FIB interner
+  vector<ComponentInterner::Id> m_componentIds;
+  // FaceId -> packets of this entry forwarded to that next hop, by Fib::countForwarded()
+  mutable std::map<FaceId, uint64_t> m_forwardedCounts;
 };
 
 } // namespace router
@@ -0,0 +1,212 @@
+/*
+  fib-file.cpp
+
+  Copyright (c) 2019 KOZO KEIKAKU ENGINEERING Inc.
+
+  This software is released under the MIT License
+
+  Permission is hereby granted, free of charge, to any person obtaining a copy
+  of this software and associated documentation files (the "Software"), to deal
+  in the Software without restriction, including without limitation the rights
+  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+  copies of the Software, and to permit persons to whom the Software is
+  furnished to do so, subject to the following conditions:
+
+  The above copyright notice and this permission notice shall be included in all
+  copies or substantial portions of the Software.
+
+  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+  SOFTWARE.
+*/
+
+#include "fib-file.hpp"
+
+#include <map>
+#include <unordered_map>
+
+#include <boost/algorithm/string.hpp>
+#include <boost/lexical_cast.hpp>
+#include <boost/property_tree/ptree.hpp>
+#include <boost/property_tree/ini_parser.hpp>
+
+namespace fcopss {
+namespace router {
+
+using namespace boost::property_tree;
+
+FibFile::FibFile(const string& path, uint16_t defaultPort)
+  : m_nextHopCount(0)
+{
+  ptree tree;
+  try {
+    read_ini(path, tree);
+  } catch (const ini_parser_error& e) {
+    BOOST_THROW_EXCEPTION(Error(e.message() + " (line=" + std::to_string(e.line()) + ")"));
+  }
+
+  // file FaceId -> Protocol and Remote
+  std::unordered_map<string, std::pair<string, string>> specs;
+  for (size_t y = 0; ; y++) {
+    string suffix = std::to_string(y);
+    boost::optional<string> id = tree.get_optional<string>("FACES.FaceId" + suffix);
+    if (!id) {
+      break;
+    }
+    boost::optional<string> protocol = tree.get_optional<string>("FACES.Protocol" + suffix);
+    boost::optional<string> remote = tree.get_optional<string>("FACES.Remote" + suffix);
+    if (!protocol || !remote) {
+      BOOST_THROW_EXCEPTION(Error("FIB file error (Protocol or Remote missing for FaceId" + suffix + ")"));
+    }
+    specs[boost::trim_copy(*id)] = std::make_pair(*protocol, *remote);
+  }
+
+  // file FaceId -> index in m_faces
+  std::unordered_map<string, size_t> faces;
+  // "type ip:port" -> index in m_faces, so a remote listed twice gets one face
+  std::map<string, size_t> remotes;
+
+  vector<string> ids;
+  vector<string> costs;
+  for (size_t x = 0; ; x++) {
+    string suffix = std::to_string(x);
+    boost::optional<string> name = tree.get_optional<string>("FIB.Name" + suffix);
+    if (!name) {
+      if (x == 0) {
+        BOOST_THROW_EXCEPTION(Error("FIB file error (Name nothing)"));
+      }
+      break;
+    }
+    boost::optional<string> nextHops = tree.get_optional<string>("FIB.NextHop" + suffix);
+    boost::optional<string> costList = tree.get_optional<string>("FIB.Cost" + suffix);
+    if (!nextHops || !costList) {
+      BOOST_THROW_EXCEPTION(Error("FIB file error (NextHop or Cost missing for Name" + suffix + ")"));
+    }
+    splitCsv(*nextHops, ids);
+    splitCsv(*costList, costs);
+    if (ids.size() != costs.size()) {
+      BOOST_THROW_EXCEPTION(Error("FIB file error (NextHop and Cost count differ for Name" + suffix + ")"));
+    }
+
+    Route route;
+    try {
+      route.m_cd = Cd(*name);
+    } catch (...) {
+      BOOST_THROW_EXCEPTION(Error("FIB file error (illegal Name" + suffix + ": " + *name + ")"));
+    }
+
+    for (size_t i = 0; i < ids.size(); i++) {
+      auto face = faces.find(ids[i]);
+      if (face == faces.end()) {
+        auto spec = specs.find(ids[i]);
+        if (spec == specs.end()) {
+          BOOST_THROW_EXCEPTION(Error("No match [FACES] section data for [FIB] FaceID " + ids[i]));
+        }
+        Face parsed = parseFace(spec->second.first, spec->second.second, defaultPort);
+        string key = parsed.m_type + " " + parsed.m_ip + ":" + std::to_string(parsed.m_port);
+        auto remote = remotes.find(key);
+        if (remote == remotes.end()) {
+          remote = remotes.emplace(key, m_faces.size()).first;
+          m_faces.push_back(parsed);
+        }
+        face = faces.emplace(ids[i], remote->second).first;
+      }
+
+      NextHop nextHop;
+      nextHop.m_face = face->second;
+      try {
+        nextHop.m_cost = boost::lexical_cast<uint32_t>(costs[i]);
+      } catch (const boost::bad_lexical_cast&) {
+        BOOST_THROW_EXCEPTION(Error("FIB file error (illegal Cost" + suffix + ": " + costs[i] + ")"));
+      }
+      route.m_nextHops.push_back(nextHop);
+    }
+
+    m_nextHopCount += route.m_nextHops.size();
+    m_routes.push_back(std::move(route));
+  }
+}
+
+const vector<FibFile::Face>&
+FibFile::faces() const
+{
+  return m_faces;
+}
+
+const vector<FibFile::Route>&
+FibFile::routes() const
+{
+  return m_routes;
+}
+
+size_t
+FibFile::nextHopCount() const
+{
+  return m_nextHopCount;
+}
+
+void
+FibFile::splitCsv(const string& csv, vector<string>& values)
+{
+  string trimmed = csv;
+  trimmed.erase(std::remove_if(trimmed.begin(), trimmed.end(), [](char c) { return isspace(c); }),
+                trimmed.end());
+
+  boost::split(values, trimmed, boost::is_any_of(","));
+  for (auto it = values.cbegin(); it != values.cend(); it++) {
+    if (it->empty()) {
+      BOOST_THROW_EXCEPTION(Error("FIB file error (empty value in " + csv + ")"));
+    }
+  }
+}
+
+FibFile::Face
+FibFile::parseFace(const string& protocol, const string& remote, uint16_t defaultPort)
+{
+  Face face;
+
+  face.m_type = boost::to_lower_copy(boost::trim_copy(protocol));
+  if ((face.m_type != "tcp") && (face.m_type != "udp")) {
+    BOOST_THROW_EXCEPTION(Error("FIB file error (illegal Protocol: " + protocol + ")"));
+  }
+
+  vector<string> peer;
+  boost::split(peer, boost::trim_copy(remote), boost::is_any_of(":"));
+  if ((peer.size() != 1) && (peer.size() != 2)) {
+    BOOST_THROW_EXCEPTION(Error("FIB file error (illegal Remote: " + remote + ")"));
+  }
+  face.m_port = defaultPort;
+  if (peer.size() == 2) {
+    try {
+      face.m_port = boost::lexical_cast<uint16_t>(peer[1]);
+    } catch (const boost::bad_lexical_cast&) {
+      BOOST_THROW_EXCEPTION(Error("FIB file error (illegal Remote: " + remote + ")"));
+    }
+  }
+
+  boost::system::error_code error;
+  boost::asio::ip::address_v4::from_string(peer[0], error);
+  if (!error) {
+    face.m_ip = peer[0];
+    return face;
+  }
+
+  io_service ioService;
+  tcp::resolver resolver(ioService);
+  tcp::resolver::query query(tcp::v4(), peer[0], std::to_string(face.m_port),
+                             boost::asio::ip::resolver_query_base::numeric_service);
+  tcp::resolver::iterator it = resolver.resolve(query, error);
+  if (error || (it == tcp::resolver::iterator())) {
+    BOOST_THROW_EXCEPTION(Error("cannot resolve host name " + peer[0]));
+  }
+  face.m_ip = it->endpoint().address().to_string();
+
+  return face;
+}
+
+} // namespace router
+} // namespace fcopss
@@ -0,0 +1,110 @@
+/*
+  fib-file.hpp
+
+  Copyright (c) 2019 KOZO KEIKAKU ENGINEERING Inc.
+
+  This software is released under the MIT License
+
+  Permission is hereby granted, free of charge, to any person obtaining a copy
+  of this software and associated documentation files (the "Software"), to deal
+  in the Software without restriction, including without limitation the rights
+  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+  copies of the Software, and to permit persons to whom the Software is
+  furnished to do so, subject to the following conditions:
+
+  The above copyright notice and this permission notice shall be included in all
+  copies or substantial portions of the Software.
+
+  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+  SOFTWARE.
+*/
+#ifndef _FCOPSS_ROUTER_FIB_FILE_HPP_
+#define _FCOPSS_ROUTER_FIB_FILE_HPP_
+
+#include <fcopss/common.hpp>
+#include <fcopss/cd.hpp>
+
+namespace fcopss {
+namespace router {
+
+// FIB file, the format of conf/fib.conf.sample:
+//
+//   [FIB]                       [FACES]
+//   Name<x>=/a                  FaceId<y>=270
+//   NextHop<x>=270,271          Protocol<y>=tcp
+//   Cost<x>=0,10                Remote<y>=192.168.0.1[:9876]
+//
+// x and y count from 0 and end at the first missing one.  FaceIds of the file
+// only tie [FIB] to [FACES], they are not router FaceIds.  [FACES] is indexed
+// once, so reading takes time linear in the file size.
+class FibFile final : noncopyable
+{
+public:
+  class Error : public std::runtime_error
+  {
+  public:
+    explicit
+    Error(const string& what)
+      : std::runtime_error(what)
+    {
+    }
+  };
+
+  class Face
+  {
+  public:
+    string m_type;
+    string m_ip;
+    uint16_t m_port;
+  };
+
+  class NextHop
+  {
+  public:
+    // index in faces()
+    size_t m_face;
+    uint32_t m_cost;
+  };
+
+  class Route
+  {
+  public:
+    Cd m_cd;
+    vector<NextHop> m_nextHops;
+  };
+
+  // remotes without a port get `defaultPort`, host names are resolved
+  FibFile(const string& path, uint16_t defaultPort);
+
+  // faces used by some route, each remote once
+  const vector<Face>&
+  faces() const;
+
+  const vector<Route>&
+  routes() const;
+
+  size_t
+  nextHopCount() const;
+
+private:
+  static void
+  splitCsv(const string& csv, vector<string>& values);
+
+  static Face
+  parseFace(const string& protocol, const string& remote, uint16_t defaultPort);
+
+private:
+  vector<Face> m_faces;
+  vector<Route> m_routes;
+  size_t m_nextHopCount;
+};
+
+} // namespace router
+} // namespace fcopss
+
+#endif // _FCOPSS_ROUTER_FIB_FILE_HPP_
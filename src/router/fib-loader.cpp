@@ -0,0 +1,315 @@
+/*
+  fib-loader.cpp
+
+  Copyright (c) 2019 KOZO KEIKAKU ENGINEERING Inc.
+
+  This software is released under the MIT License
+
+  Permission is hereby granted, free of charge, to any person obtaining a copy
+  of this software and associated documentation files (the "Software"), to deal
+  in the Software without restriction, including without limitation the rights
+  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+  copies of the Software, and to permit persons to whom the Software is
+  furnished to do so, subject to the following conditions:
+
+  The above copyright notice and this permission notice shall be included in all
+  copies or substantial portions of the Software.
+
+  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+  SOFTWARE.
+*/
+
+#include "fib-loader.hpp"
+#include "tcp-transport.hpp"
+#include "udp-transport.hpp"
+#include "face-manager.hpp"
+#include "fib.hpp"
+
+#include <boost/bind.hpp>
+
+#include <fcopss/log.hpp>
+
+namespace asio = boost::asio;
+namespace placeholders = boost::asio::placeholders;
+
+using reuse_address = boost::asio::socket_base::reuse_address;
+using reuse_port = boost::asio::detail::socket_option::boolean<SOL_SOCKET, SO_REUSEPORT>;
+
+namespace fcopss {
+namespace router {
+
+FibLoader::Result::Result()
+  : m_routes(0), m_nextHops(0), m_faces(0), m_failedFaces(0), m_elapsed(0, 0, 0, 0)
+{
+}
+
+FibLoader::FibLoader(
+  io_service& ioService,
+  uint16_t routerPort,
+  const time_duration& receiveTimeout,
+  const time_duration& connectTimeout,
+  FaceManager& faceManager,
+  Fib& fib,
+  const SwappedCallback& onSwapped)
+    : m_ioService(ioService),
+      m_routerPort(routerPort),
+      m_receiveTimeout(receiveTimeout),
+      m_connectTimeout(connectTimeout),
+      m_faceManager(faceManager),
+      m_fib(fib),
+      m_onSwapped(onSwapped),
+      m_connectTimer(ioService)
+{
+}
+
+FibLoader::~FibLoader()
+{
+  if (m_thread.joinable()) {
+    m_thread.join();
+  }
+}
+
+void
+FibLoader::load(const string& path, const LoadedCallback& onLoaded)
+{
+  if (isLoading()) {
+    BOOST_THROW_EXCEPTION(Error("FIB load already in progress"));
+  }
+
+  m_onLoaded = onLoaded;
+  m_startedAt = boost::posix_time::microsec_clock::universal_time();
+  m_result = Result();
+  INFO("FIB load from %s", path.c_str());
+
+  uint16_t defaultPort = m_routerPort;
+  m_thread = std::thread([this, path, defaultPort] {
+    shared_ptr<FibFile> file;
+    string error;
+    try {
+      file = make_shared<FibFile>(path, defaultPort);
+    } catch (const std::exception& e) {
+      error = e.what();
+    }
+    m_ioService.post(boost::bind(&FibLoader::onRead, this, file, error));
+  });
+}
+
+bool
+FibLoader::isLoading() const
+{
+  return static_cast<bool>(m_onLoaded);
+}
+
+void
+FibLoader::onRead(shared_ptr<FibFile> file, const string& error)
+{
+  m_thread.join();
+
+  if (!error.empty()) {
+    finish(error);
+    return;
+  }
+
+  m_file = file;
+  m_faces.assign(m_file->faces().size(), nullptr);
+  m_result.m_faces = m_faces.size();
+
+  for (size_t i = 0; i < m_faces.size(); i++) {
+    const FibFile::Face& face = m_file->faces()[i];
+    m_faces[i] = m_faceManager.find(face.m_type, face.m_ip, face.m_port);
+    if (m_faces[i]) {
+      continue;
+    }
+    if (face.m_type == "udp") {
+      openUdpFace(i);
+    } else {
+      connectTcpFace(i);
+    }
+  }
+
+  if (m_connecting.empty()) {
+    onFacesOpened();
+  } else {
+    m_connectTimer.expires_from_now(m_connectTimeout);
+    m_connectTimer.async_wait(boost::bind(&FibLoader::onConnectTimeout, this, placeholders::error));
+  }
+}
+
+void
+FibLoader::openUdpFace(size_t index)
+{
+  const FibFile::Face& face = m_file->faces()[index];
+
+  try {
+    udp::socket s(m_ioService);
+    s.open(udp::v4());
+    s.set_option(reuse_address(true));
+    s.set_option(reuse_port(true));
+    s.bind(udp::endpoint(udp::v4(), m_routerPort));
+    s.connect(udp::endpoint(asio::ip::address::from_string(face.m_ip), face.m_port));
+
+    if (s.local_endpoint() == s.remote_endpoint()) {
+      WARN("FIB load face udp %s:%hu not opened: local endpoint and remote endpoint are the same",
+           face.m_ip.c_str(), face.m_port);
+      return;
+    }
+
+    shared_ptr<Transport> transport = UdpTransport::create(m_faceManager.pin(std::move(s)));
+    m_faces[index] = m_faceManager.createFace(transport);
+  } catch (const boost::system::system_error& e) {
+    WARN("FIB load face udp %s:%hu not opened: %s", face.m_ip.c_str(), face.m_port, e.what());
+  }
+}
+
+void
+FibLoader::connectTcpFace(size_t index)
+{
+  const FibFile::Face& face = m_file->faces()[index];
+  auto socket = make_shared<tcp::socket>(m_ioService);
+
+  try {
+    socket->open(tcp::v4());
+    socket->set_option(reuse_address(true));
+    socket->set_option(reuse_port(true));
+    socket->bind(tcp::endpoint(tcp::v4(), m_routerPort));
+    socket->async_connect(
+      tcp::endpoint(asio::ip::address::from_string(face.m_ip), face.m_port),
+      boost::bind(&FibLoader::onTcpConnected, this, index, socket, placeholders::error));
+    m_connecting[index] = socket;
+  } catch (const boost::system::system_error& e) {
+    WARN("FIB load face tcp %s:%hu not opened: %s", face.m_ip.c_str(), face.m_port, e.what());
+  }
+}
+
+void
+FibLoader::onTcpConnected(size_t index, shared_ptr<tcp::socket> socket, const boost::system::error_code& error)
+{
+  // closed by onConnectTimeout()
+  auto it = m_connecting.find(index);
+  if ((it == m_connecting.end()) || (it->second != socket)) {
+    return;
+  }
+  m_connecting.erase(it);
+
+  const FibFile::Face& face = m_file->faces()[index];
+  if (error) {
+    WARN("FIB load face tcp %s:%hu not opened: %s", face.m_ip.c_str(), face.m_port, error.message().c_str());
+  } else if (socket->local_endpoint() == socket->remote_endpoint()) {
+    WARN("FIB load face tcp %s:%hu not opened: local endpoint and remote endpoint are the same",
+         face.m_ip.c_str(), face.m_port);
+    boost::system::error_code ec;
+    socket->close(ec);
+  } else {
+    shared_ptr<Transport> transport = TcpTransport::create(m_faceManager.pin(std::move(*socket)), m_receiveTimeout);
+    m_faces[index] = m_faceManager.createFace(transport);
+  }
+
+  if (m_connecting.empty()) {
+    m_connectTimer.cancel();
+    onFacesOpened();
+  }
+}
+
+void
+FibLoader::onConnectTimeout(const boost::system::error_code& error)
+{
+  // the last connect may have completed after the timer expired
+  if (error || m_connecting.empty()) {
+    return;
+  }
+
+  for (auto it = m_connecting.begin(); it != m_connecting.end(); it++) {
+    const FibFile::Face& face = m_file->faces()[it->first];
+    WARN("FIB load face tcp %s:%hu not opened: connect timeout", face.m_ip.c_str(), face.m_port);
+    boost::system::error_code ec;
+    it->second->close(ec);
+  }
+  m_connecting.clear();
+
+  onFacesOpened();
+}
+
+void
+FibLoader::onFacesOpened()
+{
+  vector<FaceId> faceIds(m_faces.size());
+  vector<bool> isOpened(m_faces.size());
+  for (size_t i = 0; i < m_faces.size(); i++) {
+    isOpened[i] = static_cast<bool>(m_faces[i]);
+    if (isOpened[i]) {
+      faceIds[i] = m_faces[i]->getId();
+    } else {
+      m_result.m_failedFaces++;
+    }
+  }
+
+  shared_ptr<const FibFile> file = m_file;
+  size_t flowHashComponents = m_fib.flowHashComponents();
+  m_thread = std::thread([this, file, faceIds, isOpened, flowHashComponents] {
+    auto fib = make_shared<Fib>(flowHashComponents);
+    size_t routes = 0;
+    size_t nextHops = 0;
+    for (auto route = file->routes().cbegin(); route != file->routes().cend(); route++) {
+      size_t added = 0;
+      for (auto nextHop = route->m_nextHops.cbegin(); nextHop != route->m_nextHops.cend(); nextHop++) {
+        if (isOpened[nextHop->m_face]) {
+          fib->add(route->m_cd, faceIds[nextHop->m_face], nextHop->m_cost);
+          added++;
+        }
+      }
+      routes += (added > 0) ? 1 : 0;
+      nextHops += added;
+    }
+    m_ioService.post(boost::bind(&FibLoader::onBuilt, this, fib, routes, nextHops));
+  });
+}
+
+void
+FibLoader::onBuilt(shared_ptr<Fib> fib, size_t routes, size_t nextHops)
+{
+  m_thread.join();
+
+  // faces that went down while the table was built
+  for (auto face = m_faces.cbegin(); face != m_faces.cend(); face++) {
+    if (*face && !m_faceManager.find((*face)->getId())) {
+      fib->remove((*face)->getId());
+    }
+  }
+
+  m_fib.swap(*fib);
+  // `fib` now holds the previous table
+  m_onSwapped(*fib);
+
+  m_result.m_routes = routes;
+  m_result.m_nextHops = nextHops;
+  finish("");
+}
+
+void
+FibLoader::finish(const string& error)
+{
+  m_result.m_error = error;
+  m_result.m_elapsed = boost::posix_time::microsec_clock::universal_time() - m_startedAt;
+  m_file.reset();
+  m_faces.clear();
+
+  if (error.empty()) {
+    INFO("FIB loaded in %lldms: %lu routes, %lu next hops, %lu faces, %lu faces not opened",
+         (long long)m_result.m_elapsed.total_milliseconds(), m_result.m_routes, m_result.m_nextHops,
+         m_result.m_faces, m_result.m_failedFaces);
+  } else {
+    WARN("FIB load failed, FIB left as it was: %s", error.c_str());
+  }
+
+  LoadedCallback onLoaded;
+  onLoaded.swap(m_onLoaded);
+  onLoaded(m_result);
+}
+
+} // namespace router
+} // namespace fcopss
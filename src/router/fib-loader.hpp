@@ -0,0 +1,152 @@
+/*
+  fib-loader.hpp
+
+  Copyright (c) 2019 KOZO KEIKAKU ENGINEERING Inc.
+
+  This software is released under the MIT License
+
+  Permission is hereby granted, free of charge, to any person obtaining a copy
+  of this software and associated documentation files (the "Software"), to deal
+  in the Software without restriction, including without limitation the rights
+  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+  copies of the Software, and to permit persons to whom the Software is
+  furnished to do so, subject to the following conditions:
+
+  The above copyright notice and this permission notice shall be included in all
+  copies or substantial portions of the Software.
+
+  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+  SOFTWARE.
+*/
+#ifndef _FCOPSS_ROUTER_FIB_LOADER_HPP_
+#define _FCOPSS_ROUTER_FIB_LOADER_HPP_
+
+#include <fcopss/common.hpp>
+
+#include "face.hpp"
+#include "fib-file.hpp"
+
+#include <map>
+#include <thread>
+
+namespace fcopss {
+namespace router {
+
+class FaceManager;
+class Fib;
+
+// Replaces the whole FIB with the routes of a FibFile.
+//
+// The file is read and the new table is built on a thread of their own, so
+// the io_service keeps forwarding with the current FIB meanwhile.  Faces of
+// the file that do not exist yet are opened on the io_service, TCP ones all
+// connected at once under one connect timeout.  The new table is then swapped
+// into the FIB the Forwarder uses in one step, never leaving it half loaded,
+// and the Forwarder is told so it can move the ST upstream.  Next hops whose
+// face could not be opened are left out.  One load runs at a time.
+class FibLoader final : noncopyable
+{
+public:
+  class Error : public std::runtime_error
+  {
+  public:
+    explicit
+    Error(const string& what)
+      : std::runtime_error(what)
+    {
+    }
+  };
+
+  class Result
+  {
+  public:
+    Result();
+
+  public:
+    // empty if the FIB was replaced, else the reason it was left as it was
+    string m_error;
+    size_t m_routes;
+    size_t m_nextHops;
+    size_t m_faces;
+    size_t m_failedFaces;
+    time_duration m_elapsed;
+  };
+
+  using LoadedCallback = function<void(const Result&)>;
+  // called on the io_service right after the swap with the FIB replaced
+  using SwappedCallback = function<void(const Fib& previous)>;
+
+  FibLoader(
+    io_service& ioService,
+    uint16_t routerPort,
+    const time_duration& receiveTimeout,
+    const time_duration& connectTimeout,
+    FaceManager& faceManager,
+    Fib& fib,
+    const SwappedCallback& onSwapped
+  );
+
+  ~FibLoader();
+
+  // `onLoaded` is called on the io_service once the FIB was replaced or the load failed
+  void
+  load(const string& path, const LoadedCallback& onLoaded);
+
+  bool
+  isLoading() const;
+
+private:
+  void
+  onRead(shared_ptr<FibFile> file, const string& error);
+
+  void
+  openUdpFace(size_t index);
+
+  void
+  connectTcpFace(size_t index);
+
+  void
+  onTcpConnected(size_t index, shared_ptr<tcp::socket> socket, const boost::system::error_code& error);
+
+  void
+  onConnectTimeout(const boost::system::error_code& error);
+
+  void
+  onFacesOpened();
+
+  void
+  onBuilt(shared_ptr<Fib> fib, size_t routes, size_t nextHops);
+
+  void
+  finish(const string& error);
+
+private:
+  io_service& m_ioService;
+  uint16_t m_routerPort;
+  time_duration m_receiveTimeout;
+  time_duration m_connectTimeout;
+  FaceManager& m_faceManager;
+  Fib& m_fib;
+  SwappedCallback m_onSwapped;
+  deadline_timer m_connectTimer;
+  std::thread m_thread;
+  // state of the running load
+  LoadedCallback m_onLoaded;
+  boost::posix_time::ptime m_startedAt;
+  shared_ptr<FibFile> m_file;
+  // index in m_file->faces() -> face, nullptr while not opened
+  vector<shared_ptr<Face>> m_faces;
+  // index in m_file->faces() -> socket still connecting
+  std::map<size_t, shared_ptr<tcp::socket>> m_connecting;
+  Result m_result;
+};
+
+} // namespace router
+} // namespace fcopss
+
+#endif // _FCOPSS_ROUTER_FIB_LOADER_HPP_
@@ -27,70 +27,121 @@
 
 #include <fcopss/log.hpp>
 
+#include <algorithm>
+
 namespace fcopss {
 namespace router {
 
+// FNV-1a offset basis and prime
+static const uint64_t PrefixHashSeed = 14695981039346656037ULL;
+static const uint64_t PrefixHashPrime = 1099511628211ULL;
+
+Fib::Fib(size_t flowHashComponents)
+  : m_flowHashComponents(flowHashComponents)
+{
+}
+
 void
 Fib::add(const string& name, const FaceId& faceId, uint32_t cost)
 {
-  Cd cd(name);
+  add(Cd(name), faceId, cost);
+}
+
+void
+Fib::add(const Cd& cd, const FaceId& faceId, uint32_t cost)
+{
   FibEntry::NextHop nextHop(faceId, cost);
 
-  auto it = std::find_if(m_fib.begin(), m_fib.end(), [&](FibEntry& entry) { return entry.m_cd == cd; });
+  auto it = find(cd);
   if (it != m_fib.end()) {
     it->m_nextHops.erase(nextHop);
     it->m_nextHops.insert(nextHop);
+    it->rankNextHops();
+    m_changes.record(cd);
     INFO("FIB entry FaceID=%llu CD=%s already exists, update entry", faceId, cd.toUri().c_str());
   } else {
     FibEntry entry(cd, nextHop);
+    m_interner.intern(cd, entry.m_componentIds);
     m_fib.push_back(entry);
+    it = std::prev(m_fib.end());
+    m_index.emplace(keyOf(cd), it);
+    indexPrefix(it);
+    m_changes.record(cd);
     INFO("FIB entry FaceID=%llu CD=%s not exists, create entry", faceId, cd.toUri().c_str());
   }
+  m_faceIndex[faceId].insert(&*it);
 }
 
 void
 Fib::remove(const string& name, const FaceId& faceId)
 {
-  Cd cd(name);
+  remove(Cd(name), faceId);
+}
 
-  auto it = std::find_if(m_fib.begin(), m_fib.end(), [&](FibEntry& entry) { return entry.m_cd == cd; });
+void
+Fib::remove(const Cd& cd, const FaceId& faceId)
+{
+  auto it = find(cd);
   if (it != m_fib.end()) {
-    FibEntry::NextHop nextHop(faceId);
-    if (it->m_nextHops.erase(nextHop) > 0) {
-      INFO("FIB entry FaceID=%llu CD=%s remoeved", faceId, cd.toUri().c_str());
-    }
-    if (it->m_nextHops.empty()) {
-      m_fib.erase(it);
-    }
+    removeNextHop(it, faceId);
   }
 }
 
 void
 Fib::remove(const string& name)
 {
-  Cd cd(name);
+  remove(Cd(name));
+}
 
-  auto it = std::find_if(m_fib.begin(), m_fib.end(), [&](FibEntry& entry) { return entry.m_cd == cd; });
+void
+Fib::remove(const Cd& cd)
+{
+  auto it = find(cd);
   if (it != m_fib.end()) {
+    m_changes.record(cd);
     INFO("FIB entry CD=%s remoeved", cd.toUri().c_str());
-    m_fib.erase(it);
+    for (auto nextHop = it->m_nextHops.cbegin(); nextHop != it->m_nextHops.cend(); nextHop++) {
+      unindexFace(nextHop->m_faceId, *it);
+    }
+    erase(it);
   }
 }
 
 void
 Fib::remove(const FaceId& faceId)
 {
-  FibEntry::NextHop nextHop(faceId);
+  vector<const FibEntry*> rerouted;
+  remove(faceId, rerouted);
+}
 
-  auto it = m_fib.begin();
-  while (it != m_fib.end()) {
-    if (it->m_nextHops.erase(nextHop) > 0) {
-      INFO("FIB entry FaceID=%llu CD=%s remoeved", faceId, it->m_cd.toUri().c_str());
+void
+Fib::remove(const FaceId& faceId, vector<const FibEntry*>& rerouted)
+{
+  rerouted.clear();
+
+  auto face = m_faceIndex.find(faceId);
+  if (face == m_faceIndex.end()) {
+    return;
+  }
+
+  // removeNextHop() updates the index as it goes
+  vector<list<FibEntry>::iterator> entries;
+  for (auto entry = face->second.cbegin(); entry != face->second.cend(); entry++) {
+    entries.push_back(find((*entry)->m_cd));
+  }
+  for (auto it = entries.begin(); it != entries.end(); it++) {
+    bool isRerouted = false;
+    if ((*it)->m_nextHops.size() > 1) {
+      for (size_t i = 0; i < (*it)->m_equalCostCount; i++) {
+        isRerouted = isRerouted || ((*it)->m_rankedNextHops[i].m_faceId == faceId);
+      }
     }
-    if (it->m_nextHops.empty()) {
-      it = m_fib.erase(it);
-    } else {
-      it++;
+
+    removeNextHop(*it, faceId);
+    if (isRerouted) {
+      rerouted.push_back(&**it);
+      INFO("FIB entry CD=%s rerouted to FaceID=%llu",
+           (*it)->m_cd.toUri().c_str(), (*it)->bestNextHop().m_faceId);
     }
   }
 }
@@ -98,42 +149,270 @@ Fib::remove(const FaceId& faceId)
 void
 Fib::clear()
 {
+  m_faceIndex.clear();
+  m_countedEntries.clear();
+  m_index.clear();
+  m_prefixes.clear();
+  m_lengthCounts.clear();
   m_fib.clear();
+  m_interner.clear();
+  m_changes.reset();
   INFO("all FIB entry remoeved");
 }
 
-set<FaceId>
-Fib::match(const Cd& cd) const
+void
+Fib::swap(Fib& other)
+{
+  // list iterators and entry addresses stay valid across std::list::swap(),
+  // so the indexes are swapped as they are
+  m_fib.swap(other.m_fib);
+  m_index.swap(other.m_index);
+  m_faceIndex.swap(other.m_faceIndex);
+  m_countedEntries.swap(other.m_countedEntries);
+  m_prefixes.swap(other.m_prefixes);
+  m_lengthCounts.swap(other.m_lengthCounts);
+  m_interner.swap(other.m_interner);
+
+  uint64_t generation = std::max(m_changes.generation(), other.m_changes.generation()) + 1;
+  m_changes.reset(generation);
+  other.m_changes.reset(generation);
+}
+
+const FibEntry*
+Fib::match(const Cd& cd, FaceIdVector& faceIds) const
 {
-  set<FaceId> faceIds;
+  faceIds.clear();
+
+  auto longest = longestPrefixOf(cd);
+  if (longest != m_fib.cend()) {
+    const FibEntry::NextHop& nextHop = (longest->m_equalCostCount == 1) ?
+      longest->bestNextHop() : longest->flowNextHop(flowHashOf(cd, m_flowHashComponents));
+    faceIds.push_back(nextHop.m_faceId);
+    DEBUG("Packet CD=%s : FIB entry match FaceID=%llu CD=%s",
+          cd.toUri().c_str(), nextHop.m_faceId, longest->m_cd.toUri().c_str());
+  }
 
-  ssize_t size = -1;
-  auto longest = m_fib.cend();
+  if (faceIds.empty()) {
+    DEBUG("Packet CD=%s : FIB entry no match", cd.toUri().c_str());
+    return nullptr;
+  }
+  return &*longest;
+}
 
-  for (auto it = m_fib.cbegin(); it != m_fib.cend(); it++) {
-    if (it->m_cd.isPrefixOf(cd)) { 
-      if (size < ssize_t(it->m_cd.size())) {
-        size = it->m_cd.size();
-        longest = it;
+const FibEntry*
+Fib::findEntry(const Cd& cd) const
+{
+  auto it = m_index.find(keyOf(cd));
+  return (it != m_index.end()) ? &*it->second : nullptr;
+}
+
+const FibEntry*
+Fib::findLongestPrefix(const Cd& cd) const
+{
+  auto longest = longestPrefixOf(cd);
+  return (longest != m_fib.cend()) ? &*longest : nullptr;
+}
+
+void
+Fib::matchBatch(const Cd* const cds[], FaceIdVector* const faceIds[], size_t count) const
+{
+  // a lookup touches a few hash buckets, there is no walk to share
+  for (size_t i = 0; i < count; i++) {
+    match(*cds[i], *faceIds[i]);
+  }
+}
+
+list<FibEntry>::const_iterator
+Fib::longestPrefixOf(const Cd& cd) const
+{
+  if (m_lengthCounts.empty()) {
+    return m_fib.cend();
+  }
+
+  m_interner.find(cd, m_inputIds);
+
+  // a prefix holding a value no entry has cannot match
+  size_t depth = std::min(cd.size(), m_lengthCounts.size() - 1);
+  m_inputHashes.resize(depth + 1);
+  m_inputHashes[0] = PrefixHashSeed;
+  for (size_t i = 0; i < depth; i++) {
+    if (m_inputIds[i] == ComponentInterner::Unknown) {
+      depth = i;
+      break;
+    }
+    m_inputHashes[i + 1] = extendHash(m_inputHashes[i], m_inputIds[i], cd.elements()[i].type());
+  }
+
+  for (size_t length = depth + 1; length-- > 0; ) {
+    if (m_lengthCounts[length] == 0) {
+      continue;
+    }
+    auto range = m_prefixes.equal_range(m_inputHashes[length]);
+    for (auto it = range.first; it != range.second; it++) {
+      if ((it->second->m_componentIds.size() == length) && isPrefixOf(*it->second, cd, m_inputIds)) {
+        return it->second;
       }
     }
   }
+  return m_fib.cend();
+}
 
-  if (longest != m_fib.cend()) {
-    auto nextHop = std::min_element(longest->m_nextHops.begin(), longest->m_nextHops.end(),
-                                    [](const FibEntry::NextHop& lhs, const FibEntry::NextHop& rhs) {
-                                      return (lhs.m_cost < rhs.m_cost);
-                                    });
-    faceIds.insert(nextHop->m_faceId);
-    INFO("Packet CD=%s : FIB entry match FaceID=%llu CD=%s",
-         cd.toUri().c_str(), nextHop->m_faceId, longest->m_cd.toUri().c_str());
+string
+Fib::keyOf(const Cd& cd)
+{
+  const Block& wire = cd.wireEncode();
+  return string(reinterpret_cast<const char*>(wire.wire()), wire.size());
+}
+
+list<FibEntry>::iterator
+Fib::find(const Cd& cd)
+{
+  auto it = m_index.find(keyOf(cd));
+  if (it == m_index.end()) {
+    return m_fib.end();
   }
+  return it->second;
+}
 
-  if (faceIds.size() == 0) {
-    INFO("Packet CD=%s : FIB entry no match", cd.toUri().c_str());
+void
+Fib::removeNextHop(list<FibEntry>::iterator it, const FaceId& faceId)
+{
+  FibEntry::NextHop nextHop(faceId);
+  if (it->m_nextHops.erase(nextHop) > 0) {
+    unindexFace(faceId, *it);
+    it->m_forwardedCounts.erase(faceId);
+    m_changes.record(it->m_cd);
+    INFO("FIB entry FaceID=%llu CD=%s remoeved", faceId, it->m_cd.toUri().c_str());
+  }
+  if (it->m_nextHops.empty()) {
+    erase(it);
+  } else {
+    it->rankNextHops();
   }
+}
 
-  return faceIds;
+void
+Fib::erase(list<FibEntry>::iterator it)
+{
+  unindexPrefix(it);
+  m_countedEntries.erase(&*it);
+  m_interner.release(it->m_componentIds);
+  m_index.erase(keyOf(it->m_cd));
+  m_fib.erase(it);
+}
+
+bool
+Fib::isPrefixOf(const FibEntry& entry, const Cd& cd, const vector<ComponentInterner::Id>& ids)
+{
+  const vector<ComponentInterner::Id>& entryIds = entry.m_componentIds;
+  if (entryIds.size() > ids.size()) {
+    return false;
+  }
+  if (!std::equal(entryIds.begin(), entryIds.end(), ids.begin())) {
+    return false;
+  }
+
+  // IDs are per value, a prefix also has the same component types
+  for (size_t i = 0; i < entryIds.size(); i++) {
+    if (entry.m_cd.elements()[i].type() != cd.elements()[i].type()) {
+      return false;
+    }
+  }
+  return true;
+}
+
+uint64_t
+Fib::extendHash(uint64_t hash, ComponentInterner::Id id, uint32_t type)
+{
+  return (hash ^ ((uint64_t(type) << 32) | id)) * PrefixHashPrime;
+}
+
+uint64_t
+Fib::prefixHashOf(const FibEntry& entry)
+{
+  uint64_t hash = PrefixHashSeed;
+  for (size_t i = 0; i < entry.m_componentIds.size(); i++) {
+    hash = extendHash(hash, entry.m_componentIds[i], entry.m_cd.elements()[i].type());
+  }
+  return hash;
+}
+
+void
+Fib::indexPrefix(list<FibEntry>::iterator it)
+{
+  m_prefixes.emplace(prefixHashOf(*it), it);
+
+  size_t length = it->m_componentIds.size();
+  if (m_lengthCounts.size() <= length) {
+    m_lengthCounts.resize(length + 1, 0);
+  }
+  m_lengthCounts[length]++;
+}
+
+void
+Fib::unindexPrefix(list<FibEntry>::iterator it)
+{
+  auto range = m_prefixes.equal_range(prefixHashOf(*it));
+  for (auto prefix = range.first; prefix != range.second; prefix++) {
+    if (prefix->second == it) {
+      m_prefixes.erase(prefix);
+      break;
+    }
+  }
+
+  m_lengthCounts[it->m_componentIds.size()]--;
+  while (!m_lengthCounts.empty() && (m_lengthCounts.back() == 0)) {
+    m_lengthCounts.pop_back();
+  }
+}
+
+void
+Fib::unindexFace(const FaceId& faceId, const FibEntry& entry)
+{
+  auto face = m_faceIndex.find(faceId);
+  if (face != m_faceIndex.end()) {
+    face->second.erase(&entry);
+    if (face->second.empty()) {
+      m_faceIndex.erase(face);
+    }
+  }
+}
+
+uint64_t
+Fib::generation() const
+{
+  return m_changes.generation();
+}
+
+const ChangeLog&
+Fib::changes() const
+{
+  return m_changes;
+}
+
+bool
+Fib::affects(const Cd& changed, const Cd& cd)
+{
+  // only the prefixes of a CD take part in its longest prefix match
+  return changed.isPrefixOf(cd);
+}
+
+void
+Fib::getEntries(vector<const FibEntry*>& entries) const
+{
+  entries.clear();
+  for (auto it = m_fib.cbegin(); it != m_fib.cend(); it++) {
+    entries.push_back(&*it);
+  }
+}
+
+void
+Fib::getFaceIds(vector<FaceId>& faceIds) const
+{
+  faceIds.clear();
+  for (auto it = m_faceIndex.cbegin(); it != m_faceIndex.cend(); it++) {
+    faceIds.push_back(it->first);
+  }
 }
 
 void
@@ -141,8 +420,76 @@ Fib::dump(vector<string>& lines) const
 {
   lines.clear();
   for (auto it = m_fib.cbegin(); it != m_fib.cend(); it++) {
-    lines.push_back(it->toString());
+    stringstream ss;
+    ss << it->toString();
+
+    if (it->m_equalCostCount > 1) {
+      ss << " ECMP=";
+      for (size_t i = 0; i < it->m_equalCostCount; i++) {
+        const FaceId& faceId = it->m_rankedNextHops[i].m_faceId;
+        auto count = it->m_forwardedCounts.find(faceId);
+        ss << "[" << faceId << ":" << ((count != it->m_forwardedCounts.end()) ? count->second : 0) << "]";
+      }
+    }
+    lines.push_back(ss.str());
+  }
+}
+
+void
+Fib::countForwarded(const FibEntry& entry, const FaceId& faceId, uint64_t count)
+{
+  if (entry.m_forwardedCounts.empty()) {
+    m_countedEntries.insert(&entry);
+  }
+  entry.m_forwardedCounts[faceId] += count;
+}
+
+void
+Fib::takeForwardedCounts(vector<ForwardedCount>& counts)
+{
+  counts.clear();
+  for (auto entry = m_countedEntries.cbegin(); entry != m_countedEntries.cend(); entry++) {
+    const auto& entryCounts = (*entry)->m_forwardedCounts;
+    for (auto count = entryCounts.cbegin(); count != entryCounts.cend(); count++) {
+      counts.emplace_back((*entry)->m_cd, count->first, count->second);
+    }
+    (*entry)->m_forwardedCounts.clear();
+  }
+  m_countedEntries.clear();
+}
+
+void
+Fib::addForwardedCounts(const vector<ForwardedCount>& counts)
+{
+  for (auto count = counts.cbegin(); count != counts.cend(); count++) {
+    auto it = find(std::get<0>(*count));
+    if (it != m_fib.end()) {
+      countForwarded(*it, std::get<1>(*count), std::get<2>(*count));
+    }
+  }
+}
+
+size_t
+Fib::flowHashComponents() const
+{
+  return m_flowHashComponents;
+}
+
+uint64_t
+Fib::flowHashOf(const Cd& cd, size_t components)
+{
+  size_t count = ((components == 0) || (components > cd.size())) ? cd.size() : components;
+
+  // values only, a Sub and the publications it matches hash alike on a plain prefix
+  uint64_t hash = PrefixHashSeed;
+  for (size_t i = 0; i < count; i++) {
+    const Block& component = cd.elements()[i];
+    for (size_t j = 0; j < component.value_size(); j++) {
+      hash = (hash ^ component.value()[j]) * PrefixHashPrime;
+    }
+    hash = (hash ^ component.value_size()) * PrefixHashPrime;
   }
+  return hash;
 }
 
 } // namespace router
@@ -29,36 +29,186 @@
 #include <fcopss/common.hpp>
 
 #include "fib-entry.hpp"
+#include "change-log.hpp"
+#include "face-id-vector.hpp"
+
+#include <unordered_map>
+#include <unordered_set>
 
 namespace fcopss {
 namespace router {
 
+// CD of a FIB entry, one of its next hops and packets forwarded to it
+using ForwardedCount = std::tuple<Cd, FaceId, uint64_t>;
+
+// Longest prefix match FIB.
+//
+// Every entry is also indexed by a hash of its component IDs and types in a
+// hash table holding all prefix lengths, and the number of entries of each
+// length is kept.  A CD hashes all its prefixes in one pass, then probes only
+// the lengths some entry has, longest first, so a match costs at most one
+// probe per component whatever the number of entries.
+//
+// When several next hops share the least cost, match() spreads CDs over them
+// by a hash of the leading components of the CD, so packets of one CD always
+// take the same next hop and stay in order.
 class Fib final : noncopyable
 {
 public:
+  // `flowHashComponents` leading CD components pick among equal-cost next hops, 0 for all
+  explicit
+  Fib(size_t flowHashComponents = 0);
+
   void
   add(const string& name, const FaceId& faceId, uint32_t cost);
 
+  void
+  add(const Cd& cd, const FaceId& faceId, uint32_t cost);
+
   void
   remove(const string& name, const FaceId& faceId);
 
+  void
+  remove(const Cd& cd, const FaceId& faceId);
+
   void
   remove(const string& name);
 
+  void
+  remove(const Cd& cd);
+
   void
   remove(const FaceId& faceId);
 
+  // remove(faceId), `rerouted` gets the surviving entries `faceId` was in the
+  // ECMP group of, which now use their backup next hops
+  void
+  remove(const FaceId& faceId, vector<const FibEntry*>& rerouted);
+
   void
   clear();
 
-  set<FaceId>
-  match(const Cd& cd) const;
+  // exchanges the entries of the two FIBs in O(1), forwarded packet counters
+  // go along with their entries, and both generations move past either one so
+  // no cached match survives
+  void
+  swap(Fib& other);
+
+  // returns the entry used, nullptr if there is none
+  const FibEntry*
+  match(const Cd& cd, FaceIdVector& faceIds) const;
+
+  // entry of exactly `cd`, nullptr if there is none
+  const FibEntry*
+  findEntry(const Cd& cd) const;
+
+  // entry match() uses for `cd`, nullptr if there is none
+  const FibEntry*
+  findLongestPrefix(const Cd& cd) const;
+
+  // *faceIds[i] gets the result of match(*cds[i])
+  void
+  matchBatch(const Cd* const cds[], FaceIdVector* const faceIds[], size_t count) const;
+
+  // changes whenever the result of match() may change, changes().generation()
+  uint64_t
+  generation() const;
+
+  // every entry added, modified or removed, in order
+  const ChangeLog&
+  changes() const;
+
+  // true if a change of the entry `changed` may change the result of match(cd)
+  static bool
+  affects(const Cd& changed, const Cd& cd);
+
+  // all entries, valid until the FIB is next modified
+  void
+  getEntries(vector<const FibEntry*>& entries) const;
+
+  // faces appearing as next hop of some entry
+  void
+  getFaceIds(vector<FaceId>& faceIds) const;
 
   void
   dump(vector<string>& lines) const;
 
+  // counts `count` packets forwarded to next hop `faceId` of `entry`, an entry
+  // of this FIB as returned by match(), shown by dump() to check the ECMP split
+  void
+  countForwarded(const FibEntry& entry, const FaceId& faceId, uint64_t count = 1);
+
+  // moves the counts made since the last call into `counts`, the entries of
+  // this FIB go back to 0, for a replica counting on behalf of another FIB
+  void
+  takeForwardedCounts(vector<ForwardedCount>& counts);
+
+  // adds `counts` taken from a replica to the entries still here
+  void
+  addForwardedCounts(const vector<ForwardedCount>& counts);
+
+  size_t
+  flowHashComponents() const;
+
+  // hash of the values of the first `components` components of `cd`, all if 0
+  static uint64_t
+  flowHashOf(const Cd& cd, size_t components);
+
+private:
+  static string
+  keyOf(const Cd& cd);
+
+  list<FibEntry>::iterator
+  find(const Cd& cd);
+
+  void
+  erase(list<FibEntry>::iterator it);
+
+  // Cd::isPrefixOf() over interned components, `ids` from m_interner.find()
+  static bool
+  isPrefixOf(const FibEntry& entry, const Cd& cd, const vector<ComponentInterner::Id>& ids);
+
+  // hash of a prefix extended by one component, from PrefixHashSeed for the empty one
+  static uint64_t
+  extendHash(uint64_t hash, ComponentInterner::Id id, uint32_t type);
+
+  static uint64_t
+  prefixHashOf(const FibEntry& entry);
+
+  // longest entry that is a prefix of `cd`, m_fib.cend() if there is none
+  list<FibEntry>::const_iterator
+  longestPrefixOf(const Cd& cd) const;
+
+  void
+  indexPrefix(list<FibEntry>::iterator it);
+
+  void
+  unindexPrefix(list<FibEntry>::iterator it);
+
+  void
+  removeNextHop(list<FibEntry>::iterator it, const FaceId& faceId);
+
+  void
+  unindexFace(const FaceId& faceId, const FibEntry& entry);
+
 private:
   list<FibEntry> m_fib;
+  // CD wire encoding -> entry in m_fib
+  std::unordered_map<string, list<FibEntry>::iterator> m_index;
+  // FaceId -> entries having it as next hop, so a face is removed in O(its entries)
+  std::unordered_map<FaceId, std::set<const FibEntry*>> m_faceIndex;
+  // prefixHashOf() -> entries of that hash
+  std::unordered_multimap<uint64_t, list<FibEntry>::iterator> m_prefixes;
+  // number of entries of each length, without trailing zeros
+  vector<size_t> m_lengthCounts;
+  ChangeLog m_changes;
+  size_t m_flowHashComponents;
+  // entries whose m_forwardedCounts is not empty
+  std::unordered_set<const FibEntry*> m_countedEntries;
+  ComponentInterner m_interner;
+  // scratch for match() and matchBatch(), reused across packets
+  mutable vector<ComponentInterner::Id> m_inputIds;
+  mutable vector<uint64_t> m_inputHashes;
 };
 
 } // namespace router
@@ -27,36 +27,116 @@
 #include "face-manager.hpp"
 #include "fib.hpp"
 #include "st.hpp"
+#include "st-entry.hpp"
+#include "match-cache.hpp"
+#include "sub-summary-table.hpp"
+#include "rcu-tables.hpp"
+#include "worker.hpp"
+
+#include <algorithm>
 
 #include <fcopss/log.hpp>
 
 namespace fcopss {
 namespace router {
 
-Forwarder::Forwarder(io_service& ioService, Fib& fib, St& st, FaceManager& faceManager)
-  : m_ioService(ioService), m_fib(fib), m_st(st), m_faceManager(faceManager)
+// most time worker replicas lag behind changes made outside the Forwarder
+static const boost::posix_time::milliseconds SyncInterval(10);
+
+Forwarder::Batch::Batch()
+  : m_faceIds(new FaceIdVector[MaxMatchBatch])
+{
+}
+
+Forwarder::Forwarder(io_service& ioService, Fib& fib, St& st, FaceManager& faceManager,
+                     MatchCache& fibCache, MatchCache& stCache,
+                     SubSummaryTable& subSummaries, const time_duration& subSummaryInterval,
+                     RcuTables* tables, const vector<Worker*>& workers)
+  : m_ioService(ioService), m_fib(fib), m_st(st), m_faceManager(faceManager),
+    m_fibCache(fibCache), m_stCache(stCache),
+    m_subSummaries(subSummaries), m_subSummaryInterval(subSummaryInterval),
+    m_subSummaryTimer(ioService),
+    m_tables(tables),
+    m_syncTimer(ioService),
+    m_isSyncPosted(false)
 {
+  if (m_tables != nullptr) {
+    for (auto worker = workers.cbegin(); worker != workers.cend(); worker++) {
+      m_lanes.emplace_back(new Lane());
+      m_lanes.back()->m_ioService = &(*worker)->getIoService();
+      m_lanes.back()->m_reader = m_tables->registerReader();
+      m_lanes.back()->m_stCache.reset(new MatchCache(m_stCache.capacity(), &St::affects));
+      m_lanes.back()->m_fibCache.reset(new MatchCache(m_fibCache.capacity(), &Fib::affects));
+    }
+  }
+
   m_faceManager.setEventHandler(
     std::bind(&Forwarder::onSubReceived, this, _1, _2),
     std::bind(&Forwarder::onPubToRpReceived, this, _1, _2),
     std::bind(&Forwarder::onPubFromRpReceived, this, _1, _2),
+    std::bind(&Forwarder::onSubSummaryReceived, this, _1, _2),
     std::bind(&Forwarder::onFaceShutdown, this, _1)
   );
 }
 
+Forwarder::~Forwarder()
+{
+  for (auto lane = m_lanes.cbegin(); lane != m_lanes.cend(); lane++) {
+    m_tables->unregisterReader((*lane)->m_reader);
+  }
+}
+
+void
+Forwarder::start()
+{
+  if (isSummarizing()) {
+    startSubSummaryTimer();
+  }
+  if (m_tables != nullptr) {
+    startSyncTimer();
+  }
+}
+
 void
 Forwarder::onSubReceived(const FaceId& faceId, const Sub& sub)
 {
+  if (currentLane() != nullptr) {
+    m_ioService.post(std::bind(&Forwarder::onSubReceived, this, faceId, sub));
+    return;
+  }
+
   INFO("Sub packet received from FaceID=%lld CD=%s", faceId, sub.getCd().toUri().c_str());
   bool doneForward = false;
 
   bool doForward;
   Cd cd;
   tie(doForward, cd) = m_st.add(sub.getCd(), faceId);
+  postSync();
+
+  if (isSummarizing()) {
+    INFO("Sub packet CD=%s left to SubSummary", sub.getCd().toUri().c_str());
+    return;
+  }
+
+  m_outFaceIds.clear();
   if (doForward) {
+    matchFib(cd, m_outFaceIds);
+  } else if (cd != sub.getCd()) {
+    // covered by an ST entry already forwarded upstream,
+    // still forward toward the faces the covering CD did not go to
+    matchFib(cd, m_coveringFaceIds);
+    matchFib(sub.getCd(), m_subFaceIds);
+    for (auto id = m_subFaceIds.begin(); id != m_subFaceIds.end(); id++) {
+      if (!m_coveringFaceIds.contains(*id)) {
+        m_outFaceIds.push_back(*id);
+      }
+    }
+    cd = sub.getCd();
+  }
+
+  if (!m_outFaceIds.empty()) {
     Sub subToForward(cd);
-    set<FaceId> outFaceIds = m_fib.match(cd);
-    for (auto id = outFaceIds.begin(); id != outFaceIds.end(); id++) {
+    for (auto id = m_outFaceIds.begin(); id != m_outFaceIds.end(); id++) {
       shared_ptr<Face> face = m_faceManager.find(*id);
       if (face) {
         face->send(subToForward);
@@ -74,42 +154,105 @@ Forwarder::onSubReceived(const FaceId& faceId, const Sub& sub)
 void
 Forwarder::onPubToRpReceived(const FaceId& faceId, const PubToRp& pub)
 {
-  INFO("Pub to RP packet received from FaceID=%lld CD=%s", faceId, pub.getCd().toUri().c_str());
+  DEBUG("Pub to RP packet received from FaceID=%lld CD=%s", faceId, pub.getCd().toUri().c_str());
   bool doneForward = false;
 
-  set<FaceId> outFaceIds = m_fib.match(pub.getCd());
+  Lane* lane = currentLane();
+  FaceIdVector& outFaceIds = (lane != nullptr) ? lane->m_outFaceIds : m_outFaceIds;
+  const FibEntry* fibEntry;
+  if (lane != nullptr) {
+    m_tables->catchUp(lane->m_reader);
+    fibEntry = matchFib(m_tables->getFib(lane->m_reader), *lane->m_fibCache, pub.getCd(), outFaceIds);
+  } else {
+    fibEntry = matchFib(m_fib, m_fibCache, pub.getCd(), outFaceIds);
+  }
   for (auto id = outFaceIds.begin(); id != outFaceIds.end(); id++) {
-    shared_ptr<Face> face = m_faceManager.find(*id);
+    shared_ptr<Face> face = findFace(lane, *id);
     if (face) {
       face->send(pub);
-      INFO("Pub to RP packet CD=%s forwarding to FaceID=%llu", pub.getCd().toUri().c_str(), face->getId());
+      countForwarded(lane, *fibEntry, *id);
+      DEBUG("Pub to RP packet CD=%s forwarding to FaceID=%llu", pub.getCd().toUri().c_str(), face->getId());
       doneForward = true;
     }
   }
 
   if (!doneForward) {
-    INFO("Pub to RP packet CD=%s NOT forwarding", pub.getCd().toUri().c_str());
+    DEBUG("Pub to RP packet CD=%s NOT forwarding", pub.getCd().toUri().c_str());
+  }
+}
+
+void
+Forwarder::onPubFromRpReceived(const FaceId& faceId, const vector<PubFromRp>& pubs)
+{
+  Lane* lane = currentLane();
+  const St* st = &m_st;
+  MatchCache* cache = &m_stCache;
+  Batch* batch = &m_batch;
+  if (lane != nullptr) {
+    // the whole packet is matched against the replica as of now
+    m_tables->catchUp(lane->m_reader);
+    st = &m_tables->getSt(lane->m_reader);
+    cache = lane->m_stCache.get();
+    batch = &lane->m_batch;
+  }
+
+  for (size_t first = 0; first < pubs.size(); first += MaxMatchBatch) {
+    size_t count = std::min(pubs.size() - first, MaxMatchBatch);
+
+    batch->m_cds.clear();
+    for (size_t i = first; i < first + count; i++) {
+      DEBUG("Pub from RP packet received from FaceID=%lld CD=%s", faceId, pubs[i].getCd().toUri().c_str());
+      batch->m_cds.push_back(&pubs[i].getCd());
+    }
+
+    matchBatch(*st, *cache, *batch);
+    for (size_t i = 0; i < count; i++) {
+      forwardPubFromRp(lane, pubs[first + i], batch->m_faceIds[i]);
+    }
   }
 }
 
 void
-Forwarder::onPubFromRpReceived(const FaceId& faceId, const PubFromRp& pub)
+Forwarder::forwardPubFromRp(Lane* lane, const PubFromRp& pub, FaceIdVector& outFaceIds)
 {
-  INFO("Pub from RP packet received from FaceID=%lld CD=%s", faceId, pub.getCd().toUri().c_str());
   bool doneForward = false;
 
-  set<FaceId> outFaceIds = m_st.match(pub.getCd());
+  if (lane != nullptr) {
+    m_tables->matchSubSummaries(lane->m_reader, pub.getCd(), outFaceIds);
+  } else {
+    m_subSummaries.match(pub.getCd(), outFaceIds);
+  }
+  outFaceIds.unique();
   for (auto id = outFaceIds.begin(); id != outFaceIds.end(); id++) {
-    shared_ptr<Face> face = m_faceManager.find(*id);
+    shared_ptr<Face> face = findFace(lane, *id);
     if (face) {
       face->send(pub);
-      INFO("Pub from RP packet CD=%s forwarding to FaceID=%llu", pub.getCd().toUri().c_str(), face->getId());
+      DEBUG("Pub from RP packet CD=%s forwarding to FaceID=%llu", pub.getCd().toUri().c_str(), face->getId());
       doneForward = true;
     }
   }
 
   if (!doneForward) {
-    INFO("Pub from RP packet CD=%s NOT forwarding", pub.getCd().toUri().c_str());
+    DEBUG("Pub from RP packet CD=%s NOT forwarding", pub.getCd().toUri().c_str());
+  }
+}
+
+void
+Forwarder::onSubSummaryReceived(const FaceId& faceId, const SubSummary& summary)
+{
+  if (currentLane() != nullptr) {
+    m_ioService.post(std::bind(&Forwarder::onSubSummaryReceived, this, faceId, summary));
+    return;
+  }
+
+  INFO("SubSummary packet received from FaceID=%llu seq=%llu %s",
+       faceId, summary.getSequence(), summary.isDelta() ? "delta" : "full");
+
+  bool isUpdated = m_subSummaries.update(faceId, summary);
+  postSync();
+  if (!isUpdated) {
+    INFO("SubSummary packet seq=%llu from FaceID=%llu dropped, waiting for a full summary",
+         summary.getSequence(), faceId);
   }
 }
 
@@ -119,8 +262,303 @@ Forwarder::onFaceShutdown(FaceId faceId)
   INFO("FaceID=%llu shutdown, removing from tables", faceId);
 
   m_st.remove(faceId);
-  m_fib.remove(faceId);
+  m_fib.remove(faceId, m_reroutedEntries);
+  m_subSummaries.remove(faceId);
   m_faceManager.remove(faceId);
+  postSync();
+
+  if (!m_reroutedEntries.empty()) {
+    reroute(m_reroutedEntries);
+  }
+}
+
+void
+Forwarder::onFibSwapped(const Fib& previous)
+{
+  postSync();
+
+  if (isSummarizing()) {
+    // upstream routers get their full summary now rather than at the next interval
+    sendSubSummaries();
+    return;
+  }
+
+  // ST entries are suppressed until half their lease is over, so the ones
+  // whose upstream moved would not reach their new next hop before then
+  size_t count = 0;
+  m_st.forEachEntry([&] (const Cd& cd, const FaceIdVector&) {
+    previous.match(cd, m_subFaceIds);
+    matchFib(cd, m_outFaceIds);
+    if ((m_subFaceIds.size() == m_outFaceIds.size()) &&
+        std::equal(m_outFaceIds.begin(), m_outFaceIds.end(), m_subFaceIds.begin())) {
+      return;
+    }
+
+    Sub sub(cd);
+    for (auto id = m_outFaceIds.begin(); id != m_outFaceIds.end(); id++) {
+      shared_ptr<Face> face = m_faceManager.find(*id);
+      if (face) {
+        face->send(sub);
+        DEBUG("Sub packet CD=%s re-forwarded to FaceID=%llu", cd.toUri().c_str(), face->getId());
+        count++;
+      }
+    }
+  });
+  INFO("FIB swapped : Subs re-forwarded=%lu", count);
+}
+
+void
+Forwarder::reroute(const vector<const FibEntry*>& rerouted)
+{
+  if (isSummarizing()) {
+    // backups get their full summary now rather than at the next interval
+    sendSubSummaries();
+    return;
+  }
+
+  std::set<const FibEntry*> entries(rerouted.cbegin(), rerouted.cend());
+
+  size_t count = 0;
+  m_st.forEachEntry([&] (const Cd& cd, const FaceIdVector&) {
+    if (entries.count(m_fib.findLongestPrefix(cd)) == 0) {
+      return;
+    }
+
+    // the ECMP group shrank, every CD of the entry may have moved
+    matchFib(cd, m_outFaceIds);
+    Sub sub(cd);
+    for (auto id = m_outFaceIds.begin(); id != m_outFaceIds.end(); id++) {
+      shared_ptr<Face> face = m_faceManager.find(*id);
+      if (face) {
+        face->send(sub);
+        INFO("Sub packet CD=%s rerouted to FaceID=%llu", cd.toUri().c_str(), face->getId());
+        count++;
+      }
+    }
+  });
+  INFO("FIB entries rerouted : entries=%lu, Subs=%lu", rerouted.size(), count);
+}
+
+void
+Forwarder::matchFib(const Cd& cd, FaceIdVector& faceIds)
+{
+  matchFib(m_fib, m_fibCache, cd, faceIds);
+}
+
+void
+Forwarder::matchSt(const Cd& cd, FaceIdVector& faceIds)
+{
+  matchCached(m_st, m_stCache, cd, faceIds);
+}
+
+template<typename Table>
+void
+Forwarder::matchCached(const Table& table, MatchCache& cache, const Cd& cd, FaceIdVector& faceIds)
+{
+  if (!cache.find(cd, table.changes(), faceIds)) {
+    table.match(cd, faceIds);
+    cache.insert(cd, table.changes(), faceIds);
+  }
+}
+
+const FibEntry*
+Forwarder::matchFib(const Fib& fib, MatchCache& cache, const Cd& cd, FaceIdVector& faceIds)
+{
+  const FibEntry* entry = nullptr;
+  if (!cache.find(cd, fib.changes(), faceIds, entry)) {
+    entry = fib.match(cd, faceIds);
+    cache.insert(cd, fib.changes(), faceIds, entry);
+  }
+  return entry;
+}
+
+template<typename Table>
+void
+Forwarder::matchBatch(const Table& table, MatchCache& cache, Batch& batch)
+{
+  batch.m_missCds.clear();
+  batch.m_missFaceIds.clear();
+  for (size_t i = 0; i < batch.m_cds.size(); i++) {
+    if (!cache.find(*batch.m_cds[i], table.changes(), batch.m_faceIds[i])) {
+      batch.m_missCds.push_back(batch.m_cds[i]);
+      batch.m_missFaceIds.push_back(&batch.m_faceIds[i]);
+    }
+  }
+
+  if (batch.m_missCds.empty()) {
+    return;
+  }
+
+  table.matchBatch(batch.m_missCds.data(), batch.m_missFaceIds.data(), batch.m_missCds.size());
+  for (size_t i = 0; i < batch.m_missCds.size(); i++) {
+    cache.insert(*batch.m_missCds[i], table.changes(), *batch.m_missFaceIds[i]);
+  }
+}
+
+bool
+Forwarder::isSummarizing() const
+{
+  return !m_subSummaryInterval.is_pos_infinity();
+}
+
+void
+Forwarder::startSubSummaryTimer()
+{
+  m_subSummaryTimer.expires_from_now(m_subSummaryInterval);
+  m_subSummaryTimer.async_wait(std::bind(&Forwarder::onSubSummaryTimer, this, _1));
+}
+
+void
+Forwarder::onSubSummaryTimer(const boost::system::error_code& error)
+{
+  if (error) {
+    return;
+  }
+
+  sendSubSummaries();
+  startSubSummaryTimer();
+}
+
+void
+Forwarder::sendSubSummaries()
+{
+  // the filter for an upstream face holds the ST entries a Sub would have been
+  // forwarded to it for, and everything summarized by the other faces
+  std::map<FaceId, BloomFilter> filters;
+
+  m_fib.getFaceIds(m_fibFaceIds);
+  for (auto id = m_fibFaceIds.cbegin(); id != m_fibFaceIds.cend(); id++) {
+    filters.emplace(*id, m_subSummaries.makeFilter());
+  }
+
+  // the ST entries are matched against the FIB MaxMatchBatch at a time
+  auto summarize = [&] {
+    m_batch.m_cds.clear();
+    for (auto cd = m_summaryCds.cbegin(); cd != m_summaryCds.cend(); cd++) {
+      m_batch.m_cds.push_back(&*cd);
+    }
+
+    matchBatch(m_fib, m_fibCache, m_batch);
+    for (size_t i = 0; i < m_batch.m_cds.size(); i++) {
+      for (auto id = m_batch.m_faceIds[i].begin(); id != m_batch.m_faceIds[i].end(); id++) {
+        auto filter = filters.find(*id);
+        if (filter != filters.end()) {
+          filter->second.insert(*m_batch.m_cds[i]);
+        }
+      }
+    }
+    m_summaryCds.clear();
+  };
+
+  m_st.forEachEntry([&] (const Cd& cd, const FaceIdVector&) {
+    m_summaryCds.push_back(cd);
+    if (m_summaryCds.size() == MaxMatchBatch) {
+      summarize();
+    }
+  });
+  summarize();
+
+  for (auto it = filters.begin(); it != filters.end(); it++) {
+    SubSummary summary;
+    m_subSummaries.mergeReceived(it->second, it->first);
+    if (!m_subSummaries.makeSummary(it->first, it->second, summary)) {
+      continue;
+    }
+    shared_ptr<Face> face = m_faceManager.find(it->first);
+    if (face) {
+      face->send(summary);
+      INFO("SubSummary packet seq=%llu %s forwarding to FaceID=%llu",
+           summary.getSequence(), summary.isDelta() ? "delta" : "full", face->getId());
+    }
+  }
+}
+
+Forwarder::Lane*
+Forwarder::currentLane()
+{
+  Worker* worker = Worker::current();
+  return (worker != nullptr) ? m_lanes[worker->getIndex()].get() : nullptr;
+}
+
+shared_ptr<Face>
+Forwarder::findFace(Lane* lane, const FaceId& faceId) const
+{
+  if (lane != nullptr) {
+    return m_tables->findFace(lane->m_reader, faceId);
+  }
+  return m_faceManager.find(faceId);
+}
+
+void
+Forwarder::countForwarded(Lane* lane, const FibEntry& entry, const FaceId& faceId)
+{
+  if (lane != nullptr) {
+    m_tables->countForwarded(lane->m_reader, entry, faceId);
+  } else {
+    m_fib.countForwarded(entry, faceId);
+  }
+}
+
+void
+Forwarder::postSync()
+{
+  if ((m_tables == nullptr) || m_isSyncPosted) {
+    return;
+  }
+  // after the handlers already queued, a burst of Subs makes one update
+  m_isSyncPosted = true;
+  m_ioService.post([this] { sync(); });
+}
+
+void
+Forwarder::sync()
+{
+  m_isSyncPosted = false;
+  m_tables->sync();
+
+  // also when nothing changed, a worker seeing no Pubs would otherwise keep
+  // every update from being freed and the counts of a busy one would wait
+  for (auto lane = m_lanes.cbegin(); lane != m_lanes.cend(); lane++) {
+    Lane* current = lane->get();
+    current->m_ioService->post([this, current] { syncLane(*current); });
+  }
+}
+
+void
+Forwarder::syncLane(Lane& lane)
+{
+  m_tables->catchUp(lane.m_reader);
+
+  vector<ForwardedCount> counts;
+  m_tables->takeForwardedCounts(lane.m_reader, counts);
+  size_t reader = lane.m_reader;
+  MatchCache::Counters fibCounters = lane.m_fibCache->counters();
+  MatchCache::Counters stCounters = lane.m_stCache->counters();
+  m_ioService.post([this, counts, reader, fibCounters, stCounters] {
+    if (!counts.empty()) {
+      m_fib.addForwardedCounts(counts);
+    }
+    m_fibCache.setLaneCounters(reader, fibCounters);
+    m_stCache.setLaneCounters(reader, stCounters);
+  });
+}
+
+void
+Forwarder::startSyncTimer()
+{
+  m_syncTimer.expires_from_now(SyncInterval);
+  m_syncTimer.async_wait(std::bind(&Forwarder::onSyncTimer, this, _1));
+}
+
+void
+Forwarder::onSyncTimer(const boost::system::error_code& error)
+{
+  if (error) {
+    return;
+  }
+
+  sync();
+  startSyncTimer();
 }
 
 } // namespace router
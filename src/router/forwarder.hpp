@@ -29,6 +29,7 @@
 #include <fcopss/common.hpp>
 
 #include "face.hpp"
+#include "face-id-vector.hpp"
 
 namespace fcopss {
 namespace router {
@@ -36,11 +37,35 @@ namespace router {
 class FaceManager;
 class Fib;
 class St;
-
+class MatchCache;
+class SubSummaryTable;
+class StEntry;
+class FibEntry;
+class RcuTables;
+class Worker;
+
+// With workers, Pubs are matched on the worker thread that received them
+// against the replicas of `tables`, through caches and batches of their own,
+// while Subs, SubSummaries and face shutdowns are handed to the control
+// thread, the only one changing the ST, FIB, SubSummaries and faces.  A Pub
+// right behind a Sub may then miss the ST entry of that Sub, replicas follow
+// the tables within 10 ms.
 class Forwarder final : noncopyable
 {
 public:
-  Forwarder(io_service&, Fib& fib, St& st, FaceManager& faceManager);
+  // Subs are summarized upstream every `subSummaryInterval` instead of being
+  // forwarded, unless it is infinite.
+  // `tables` is nullptr when everything runs on the control thread, else it
+  // has a reader for each of the `workers`.
+  Forwarder(io_service&, Fib& fib, St& st, FaceManager& faceManager,
+            MatchCache& fibCache, MatchCache& stCache,
+            SubSummaryTable& subSummaries, const time_duration& subSummaryInterval,
+            RcuTables* tables, const vector<Worker*>& workers);
+
+  ~Forwarder();
+
+  void
+  start();
 
   void
   onSubReceived(const FaceId& faceId, const Sub& sub);
@@ -49,16 +74,139 @@ public:
   onPubToRpReceived(const FaceId& faceId, const PubToRp& pub);
   
   void
-  onPubFromRpReceived(const FaceId& faceId, const PubFromRp& pub);
+  onPubFromRpReceived(const FaceId& faceId, const vector<PubFromRp>& pubs);
+
+  void
+  onSubSummaryReceived(const FaceId& faceId, const SubSummary& summary);
 
   void
   onFaceShutdown(FaceId faceId);
 
+  // the FIB was replaced by a loaded one, `previous` holds the old routes
+  void
+  onFibSwapped(const Fib& previous);
+
+private:
+  // most CDs matched by one St/Fib matchBatch() call
+  static const size_t MaxMatchBatch = 64;
+
+  // CDs matched together by matchBatch()
+  struct Batch
+  {
+    Batch();
+
+    vector<const Cd*> m_cds;
+    // m_faceIds[i] gets the match of m_cds[i]
+    unique_ptr<FaceIdVector[]> m_faceIds;
+    vector<const Cd*> m_missCds;
+    vector<FaceIdVector*> m_missFaceIds;
+  };
+
+  // forwarding state of one worker
+  struct Lane
+  {
+    // of the worker, the lane catches up with the tables there
+    io_service* m_ioService;
+    size_t m_reader;
+    // results from the replicas, as large as the control thread caches
+    unique_ptr<MatchCache> m_stCache;
+    unique_ptr<MatchCache> m_fibCache;
+    Batch m_batch;
+    FaceIdVector m_outFaceIds;
+  };
+
+  // lane of the calling worker, nullptr on the control thread
+  Lane*
+  currentLane();
+
+  shared_ptr<Face>
+  findFace(Lane* lane, const FaceId& faceId) const;
+
+  // `entry` of the FIB the lane matches on
+  void
+  countForwarded(Lane* lane, const FibEntry& entry, const FaceId& faceId);
+
+  // `outFaceIds` holds the ST match of the Pub, the SubSummary match is added
+  void
+  forwardPubFromRp(Lane* lane, const PubFromRp& pub, FaceIdVector& outFaceIds);
+
+  // re-forwards upstream the ST entries matching FIB entries rerouted to their backup next hops
+  void
+  reroute(const vector<const FibEntry*>& rerouted);
+
+  void
+  matchFib(const Cd& cd, FaceIdVector& faceIds);
+
+  void
+  matchSt(const Cd& cd, FaceIdVector& faceIds);
+
+  template<typename Table>
+  static void
+  matchCached(const Table& table, MatchCache& cache, const Cd& cd, FaceIdVector& faceIds);
+
+  // returns the FIB entry of the match, cached next to the result
+  static const FibEntry*
+  matchFib(const Fib& fib, MatchCache& cache, const Cd& cd, FaceIdVector& faceIds);
+
+  // only the CDs of `batch` missing from `cache` reach the table
+  template<typename Table>
+  static void
+  matchBatch(const Table& table, MatchCache& cache, Batch& batch);
+
+  bool
+  isSummarizing() const;
+
+  void
+  startSubSummaryTimer();
+
+  void
+  onSubSummaryTimer(const boost::system::error_code& error);
+
+  void
+  sendSubSummaries();
+
+  // control thread, brings the replicas of the workers up to date soon after a change
+  void
+  postSync();
+
+  void
+  sync();
+
+  // worker thread, catches up with the tables and hands over the lane counts
+  void
+  syncLane(Lane& lane);
+
+  void
+  startSyncTimer();
+
+  void
+  onSyncTimer(const boost::system::error_code& error);
+
 private:
   io_service& m_ioService;
   Fib& m_fib;
   St& m_st;
   FaceManager& m_faceManager;
+  MatchCache& m_fibCache;
+  MatchCache& m_stCache;
+  SubSummaryTable& m_subSummaries;
+  time_duration m_subSummaryInterval;
+  deadline_timer m_subSummaryTimer;
+  // match results, reused across packets
+  FaceIdVector m_outFaceIds;
+  FaceIdVector m_coveringFaceIds;
+  FaceIdVector m_subFaceIds;
+  // CDs of the ST entries in the current sendSubSummaries() batch
+  vector<Cd> m_summaryCds;
+  vector<FaceId> m_fibFaceIds;
+  vector<const FibEntry*> m_reroutedEntries;
+  Batch m_batch;
+  RcuTables* m_tables;
+  // indexed by Worker::getIndex()
+  vector<unique_ptr<Lane>> m_lanes;
+  // also catches changes made outside the Forwarder, by control commands and ST expiry
+  deadline_timer m_syncTimer;
+  bool m_isSyncPosted;
 };
 
 } // namespace router
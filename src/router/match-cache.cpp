@@ -0,0 +1,233 @@
+/*
+  match-cache.cpp
+
+  Copyright (c) 2019 KOZO KEIKAKU ENGINEERING Inc.
+
+  This software is released under the MIT License
+
+  Permission is hereby granted, free of charge, to any person obtaining a copy
+  of this software and associated documentation files (the "Software"), to deal
+  in the Software without restriction, including without limitation the rights
+  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+  copies of the Software, and to permit persons to whom the Software is
+  furnished to do so, subject to the following conditions:
+
+  The above copyright notice and this permission notice shall be included in all
+  copies or substantial portions of the Software.
+
+  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+  SOFTWARE.
+*/
+#include "match-cache.hpp"
+
+#include <fcopss/log.hpp>
+
+#include <cstring>
+
+namespace fcopss {
+namespace router {
+
+MatchCache::Counters::Counters()
+  : m_size(0), m_hits(0), m_misses(0)
+{
+}
+
+MatchCache::MatchCache(size_t capacity, Affects affects)
+  : m_capacity(capacity), m_affects(affects), m_hits(0), m_misses(0)
+{
+}
+
+bool
+MatchCache::isEnabled() const
+{
+  return (m_capacity > 0);
+}
+
+size_t
+MatchCache::capacity() const
+{
+  return m_capacity;
+}
+
+bool
+MatchCache::find(const Cd& cd, const ChangeLog& changes, FaceIdVector& faceIds)
+{
+  Entry* entry = findEntry(cd, changes);
+  if (entry == nullptr) {
+    return false;
+  }
+
+  hit(cd, *entry, faceIds);
+  return true;
+}
+
+bool
+MatchCache::find(const Cd& cd, const ChangeLog& changes, FaceIdVector& faceIds,
+                 const FibEntry*& fibEntry)
+{
+  Entry* entry = findEntry(cd, changes);
+  if (entry == nullptr) {
+    return false;
+  }
+  if ((entry->m_fibEntry == nullptr) && !entry->m_faceIds.empty()) {
+    m_misses++;
+    return false;
+  }
+
+  hit(cd, *entry, faceIds);
+  fibEntry = entry->m_fibEntry;
+  return true;
+}
+
+MatchCache::Entry*
+MatchCache::findEntry(const Cd& cd, const ChangeLog& changes)
+{
+  if (!isEnabled()) {
+    return nullptr;
+  }
+
+  const Block& wire = cd.wireEncode();
+  auto it = m_entries.find(hashOf(wire));
+  if ((it == m_entries.end()) ||
+      (it->second.m_wire.size() != wire.size()) ||
+      (memcmp(it->second.m_wire.data(), wire.wire(), wire.size()) != 0)) {
+    m_misses++;
+    return nullptr;
+  }
+
+  if (it->second.m_generation != changes.generation()) {
+    if (!isUnaffected(cd, it->second.m_generation, changes)) {
+      m_entries.erase(it);
+      m_misses++;
+      return nullptr;
+    }
+    it->second.m_generation = changes.generation();
+  }
+  return &it->second;
+}
+
+void
+MatchCache::hit(const Cd& cd, const Entry& entry, FaceIdVector& faceIds)
+{
+  faceIds.clear();
+  for (auto id = entry.m_faceIds.cbegin(); id != entry.m_faceIds.cend(); id++) {
+    faceIds.push_back(*id);
+  }
+  m_hits++;
+  DEBUG("Packet CD=%s : match cache hit", cd.toUri().c_str());
+}
+
+void
+MatchCache::insert(const Cd& cd, const ChangeLog& changes, const FaceIdVector& faceIds)
+{
+  insert(cd, changes, faceIds, nullptr);
+}
+
+void
+MatchCache::insert(const Cd& cd, const ChangeLog& changes, const FaceIdVector& faceIds,
+                   const FibEntry* fibEntry)
+{
+  if (!isEnabled()) {
+    return;
+  }
+
+  if (m_entries.size() >= m_capacity) {
+    DEBUG("match cache entries=%lu : flush", m_entries.size());
+    m_entries.clear();
+  }
+
+  const Block& wire = cd.wireEncode();
+  Entry& entry = m_entries[hashOf(wire)];
+  entry.m_wire.assign(reinterpret_cast<const char*>(wire.wire()), wire.size());
+  entry.m_faceIds.assign(faceIds.begin(), faceIds.end());
+  entry.m_fibEntry = fibEntry;
+  entry.m_generation = changes.generation();
+}
+
+void
+MatchCache::clear()
+{
+  m_entries.clear();
+}
+
+size_t
+MatchCache::size() const
+{
+  return m_entries.size();
+}
+
+uint64_t
+MatchCache::hits() const
+{
+  return m_hits;
+}
+
+uint64_t
+MatchCache::misses() const
+{
+  return m_misses;
+}
+
+MatchCache::Counters
+MatchCache::counters() const
+{
+  Counters counters;
+  counters.m_size = m_entries.size();
+  counters.m_hits = m_hits;
+  counters.m_misses = m_misses;
+  return counters;
+}
+
+void
+MatchCache::setLaneCounters(size_t lane, const Counters& counters)
+{
+  m_laneCounters[lane] = counters;
+}
+
+MatchCache::Counters
+MatchCache::totalCounters() const
+{
+  Counters total = counters();
+  for (auto it = m_laneCounters.cbegin(); it != m_laneCounters.cend(); it++) {
+    total.m_size += it->second.m_size;
+    total.m_hits += it->second.m_hits;
+    total.m_misses += it->second.m_misses;
+  }
+  return total;
+}
+
+bool
+MatchCache::isUnaffected(const Cd& cd, uint64_t generation, const ChangeLog& changes) const
+{
+  if ((changes.generation() - generation > MaxReplayedChanges) || !changes.hasSince(generation)) {
+    return false;
+  }
+
+  for (uint64_t g = generation + 1; g <= changes.generation(); g++) {
+    if (m_affects(changes.at(g), cd)) {
+      return false;
+    }
+  }
+  return true;
+}
+
+uint64_t
+MatchCache::hashOf(const Block& wire)
+{
+  // FNV-1a
+  uint64_t hash = 14695981039346656037ULL;
+  const uint8_t* bytes = wire.wire();
+  for (size_t i = 0; i < wire.size(); i++) {
+    hash ^= bytes[i];
+    hash *= 1099511628211ULL;
+  }
+  return hash;
+}
+
+} // namespace router
+} // namespace fcopss
@@ -0,0 +1,160 @@
+/*
+  match-cache.hpp
+
+  Copyright (c) 2019 KOZO KEIKAKU ENGINEERING Inc.
+
+  This software is released under the MIT License
+
+  Permission is hereby granted, free of charge, to any person obtaining a copy
+  of this software and associated documentation files (the "Software"), to deal
+  in the Software without restriction, including without limitation the rights
+  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+  copies of the Software, and to permit persons to whom the Software is
+  furnished to do so, subject to the following conditions:
+
+  The above copyright notice and this permission notice shall be included in all
+  copies or substantial portions of the Software.
+
+  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+  SOFTWARE.
+*/
+#ifndef _FCOPSS_ROUTER_MATCH_CACHE_HPP_
+#define _FCOPSS_ROUTER_MATCH_CACHE_HPP_
+
+#include <fcopss/common.hpp>
+
+#include "face.hpp"
+#include "face-id-vector.hpp"
+#include "change-log.hpp"
+
+#include <map>
+#include <unordered_map>
+
+namespace fcopss {
+namespace router {
+
+class FibEntry;
+
+// Cache of match results keyed by a hash of the CD wire encoding.
+//
+// Each result is tagged with the table generation it was computed at.  A hit
+// on an older result replays the table changes since then, and the result
+// stands if none of them affects its CD, so one Sub only drops the results it
+// may change.  A result older than MaxReplayedChanges changes, or than the
+// changes the table still keeps, is dropped.  The whole cache is dropped when
+// it is full.  A capacity of 0 disables the cache.
+class MatchCache final : noncopyable
+{
+public:
+  // St::affects or Fib::affects, for the table the results come from
+  using Affects = bool (*)(const Cd& changed, const Cd& cd);
+
+  static const uint64_t MaxReplayedChanges = 64;
+
+  class Counters
+  {
+  public:
+    Counters();
+
+  public:
+    size_t m_size;
+    uint64_t m_hits;
+    uint64_t m_misses;
+  };
+
+  MatchCache(size_t capacity, Affects affects);
+
+  bool
+  isEnabled() const;
+
+  size_t
+  capacity() const;
+
+  // `changes` of the table the result comes from
+  bool
+  find(const Cd& cd, const ChangeLog& changes, FaceIdVector& faceIds);
+
+  // also gets the FIB entry the result was matched on, a result with next hops
+  // inserted without its entry is a miss
+  bool
+  find(const Cd& cd, const ChangeLog& changes, FaceIdVector& faceIds,
+       const FibEntry*& fibEntry);
+
+  // `faceIds` matched at changes.generation()
+  void
+  insert(const Cd& cd, const ChangeLog& changes, const FaceIdVector& faceIds);
+
+  // `fibEntry` returned by Fib::match(); it stands as long as the result does,
+  // since erasing it is a change that affects the result
+  void
+  insert(const Cd& cd, const ChangeLog& changes, const FaceIdVector& faceIds,
+         const FibEntry* fibEntry);
+
+  void
+  clear();
+
+  size_t
+  size() const;
+
+  uint64_t
+  hits() const;
+
+  uint64_t
+  misses() const;
+
+  Counters
+  counters() const;
+
+  // counters of the cache worker `lane` keeps in front of its replica of the
+  // same table, replacing the ones that lane handed over before
+  void
+  setLaneCounters(size_t lane, const Counters& counters);
+
+  // counters() plus those of every lane
+  Counters
+  totalCounters() const;
+
+  // key of a CD, a hash of its wire encoding
+  static uint64_t
+  hashOf(const Block& wire);
+
+private:
+  class Entry
+  {
+  public:
+    string m_wire;
+    vector<FaceId> m_faceIds;
+    const FibEntry* m_fibEntry;
+    uint64_t m_generation;
+  };
+
+  // the result of `cd` if it still stands, nullptr on a miss
+  Entry*
+  findEntry(const Cd& cd, const ChangeLog& changes);
+
+  void
+  hit(const Cd& cd, const Entry& entry, FaceIdVector& faceIds);
+
+  // true if no change after `generation` affects the result of `cd`
+  bool
+  isUnaffected(const Cd& cd, uint64_t generation, const ChangeLog& changes) const;
+
+private:
+  size_t m_capacity;
+  Affects m_affects;
+  // on a hash collision the later CD replaces the earlier one
+  std::unordered_map<uint64_t, Entry> m_entries;
+  uint64_t m_hits;
+  uint64_t m_misses;
+  std::map<size_t, Counters> m_laneCounters;
+};
+
+} // namespace router
+} // namespace fcopss
+
+#endif // _FCOPSS_ROUTER_MATCH_CACHE_HPP_
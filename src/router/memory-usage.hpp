@@ -0,0 +1,71 @@
+/*
+  memory-usage.hpp
+
+  Copyright (c) 2019 KOZO KEIKAKU ENGINEERING Inc.
+
+  This software is released under the MIT License
+
+  Permission is hereby granted, free of charge, to any person obtaining a copy
+  of this software and associated documentation files (the "Software"), to deal
+  in the Software without restriction, including without limitation the rights
+  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+  copies of the Software, and to permit persons to whom the Software is
+  furnished to do so, subject to the following conditions:
+
+  The above copyright notice and this permission notice shall be included in all
+  copies or substantial portions of the Software.
+
+  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+  SOFTWARE.
+*/
+#ifndef _FCOPSS_ROUTER_MEMORY_USAGE_HPP_
+#define _FCOPSS_ROUTER_MEMORY_USAGE_HPP_
+
+#include <fcopss/common.hpp>
+
+namespace fcopss {
+namespace router {
+
+// Estimated heap bytes of standard containers, for St::memoryUsage().
+// They assume libstdc++ node layouts and ignore allocator overhead.
+
+inline size_t
+stringMemoryUsage(const string& s)
+{
+  // short strings live inside the object
+  return (s.capacity() > 15) ? (s.capacity() + 1) : 0;
+}
+
+template<typename Vector>
+size_t
+vectorMemoryUsage(const Vector& v)
+{
+  return v.capacity() * sizeof (typename Vector::value_type);
+}
+
+// buckets, and nodes holding the value, a next pointer and the cached hash
+template<typename HashMap>
+size_t
+hashMapMemoryUsage(const HashMap& map)
+{
+  return map.bucket_count() * sizeof (void*) +
+         map.size() * (sizeof (typename HashMap::value_type) + 2 * sizeof (void*));
+}
+
+// red-black tree nodes holding the value, three links and the color
+template<typename TreeMap>
+size_t
+treeMemoryUsage(const TreeMap& map)
+{
+  return map.size() * (sizeof (typename TreeMap::value_type) + 4 * sizeof (void*));
+}
+
+} // namespace router
+} // namespace fcopss
+
+#endif // _FCOPSS_ROUTER_MEMORY_USAGE_HPP_
@@ -0,0 +1,203 @@
+/*
+  rcu-bench.cpp
+
+  Copyright (c) 2019 KOZO KEIKAKU ENGINEERING Inc.
+
+  This software is released under the MIT License
+
+  Permission is hereby granted, free of charge, to any person obtaining a copy
+  of this software and associated documentation files (the "Software"), to deal
+  in the Software without restriction, including without limitation the rights
+  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+  copies of the Software, and to permit persons to whom the Software is
+  furnished to do so, subject to the following conditions:
+
+  The above copyright notice and this permission notice shall be included in all
+  copies or substantial portions of the Software.
+
+  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+  SOFTWARE.
+*/
+#include "rcu-tables.hpp"
+#include "st.hpp"
+#include "fib.hpp"
+#include "match-cache.hpp"
+#include "face-manager.hpp"
+#include "timer-wheel.hpp"
+
+#include <chrono>
+#include <cstdio>
+#include <mutex>
+#include <thread>
+
+// Thread scaling of Pub matching, with and without worker replicas.
+//
+//   rcu-bench [StType] [entries] [max threads] [seconds]
+//
+// Fills an ST of StType, then for 1 to `max threads` threads matches Pub CDs
+// on every thread at once, first against the one ST behind a mutex, then each
+// thread against its replica from RcuTables, then as a Forwarder worker does,
+// through a MatchCache of its own in front of the replica.  Meanwhile the
+// control thread renews a Sub every millisecond and syncs every 10 ms, as the
+// Forwarder does.  Run with FCOPSS_LOG_LEVEL=WARN, the ST logs each renewal at
+// INFO; replicas log the changes they apply at DEBUG only.
+
+using namespace fcopss;
+using namespace fcopss::router;
+
+using Clock = std::chrono::steady_clock;
+
+// first components the entries are spread over
+static const size_t Groups = 100;
+static const FaceId FaceCount = 16;
+static const size_t PubCount = 4096;
+
+static Cd
+entryCd(size_t i)
+{
+  return Cd("/bench/" + std::to_string(i % Groups) + "/" + std::to_string(i / Groups));
+}
+
+// `match` runs on `threadCount` threads for `seconds` while the control thread
+// calls `renew` every millisecond and `sync` every 10, returns matches per
+// second
+static double
+measure(size_t threadCount, double seconds, const vector<Cd>& pubs,
+        const function<void(size_t thread, const Cd& cd, FaceIdVector& faceIds)>& match,
+        const function<void(size_t i)>& renew, const function<void()>& sync)
+{
+  std::atomic<bool> isStopping(false);
+  vector<uint64_t> counts(threadCount, 0);
+  vector<std::thread> threads;
+  for (size_t t = 0; t < threadCount; t++) {
+    threads.emplace_back([&, t] {
+      FaceIdVector faceIds;
+      uint64_t count = 0;
+      for (size_t i = t; !isStopping.load(std::memory_order_relaxed); i++) {
+        match(t, pubs[i % pubs.size()], faceIds);
+        count++;
+      }
+      counts[t] = count;
+    });
+  }
+
+  Clock::time_point start = Clock::now();
+  Clock::time_point end = start + std::chrono::microseconds(static_cast<int64_t>(seconds * 1e6));
+  for (size_t i = 0; Clock::now() < end; i++) {
+    std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    renew(i);
+    if (i % 10 == 9) {
+      sync();
+    }
+  }
+  isStopping.store(true);
+  for (auto thread = threads.begin(); thread != threads.end(); thread++) {
+    thread->join();
+  }
+  double elapsed = std::chrono::duration<double>(Clock::now() - start).count();
+
+  uint64_t total = 0;
+  for (auto count = counts.cbegin(); count != counts.cend(); count++) {
+    total += *count;
+  }
+  return total / elapsed;
+}
+
+int
+main(int argc, char* argv[])
+{
+  string stType = (argc > 1) ? argv[1] : "list";
+  size_t entryCount = (argc > 2) ? std::stoul(argv[2]) : 10000;
+  size_t maxThreads = (argc > 3) ? std::stoul(argv[3]) : std::max(std::thread::hardware_concurrency(), 4u);
+  double seconds = (argc > 4) ? std::stod(argv[4]) : 2.0;
+  if (maxThreads > EpochDomain::MaxReaders) {
+    maxThreads = EpochDomain::MaxReaders;
+  }
+
+  io_service ioService;
+  TimerWheel timerWheel(ioService, boost::posix_time::seconds(1));
+  FaceManager faceManager(ioService);
+  time_duration forever(boost::posix_time::pos_infin);
+
+  unique_ptr<St> st = St::create(stType, timerWheel, forever, StCapacity(), 4);
+  Fib fib;
+  // none received, Pubs go by the ST alone
+  SubSummaryTable subSummaries(8192, 4);
+  for (size_t i = 0; i < entryCount; i++) {
+    st->add(entryCd(i), 1 + (i % FaceCount));
+  }
+
+  vector<Cd> pubs;
+  size_t matched = 0;
+  FaceIdVector faceIds;
+  for (size_t i = 0; i < PubCount; i++) {
+    pubs.emplace_back(entryCd((i * 7919) % entryCount).toUri() + "/data");
+    st->match(pubs.back(), faceIds);
+    matched += faceIds.size();
+  }
+  std::printf("ST type=%s entries=%lu pubs=%lu fan-out=%.2f cores=%u\n", stType.c_str(), st->size(),
+              pubs.size(), static_cast<double>(matched) / pubs.size(), std::thread::hardware_concurrency());
+  std::printf("%-8s %18s %18s %18s\n", "threads", "mutex matches/s", "replica matches/s", "cached matches/s");
+
+  // a Sub of the same entry leaves and comes back, the ST keeps its size
+  auto renew = [&] (size_t i) {
+    Cd cd = entryCd((i * 104729) % entryCount);
+    FaceId face = 1 + (((i * 104729) % entryCount) % FaceCount);
+    st->remove(cd, face);
+    st->add(cd, face);
+  };
+
+  for (size_t threadCount = 1; threadCount <= maxThreads; threadCount *= 2) {
+    std::mutex mutex;
+    double shared = measure(threadCount, seconds, pubs,
+      [&] (size_t, const Cd& cd, FaceIdVector& faceIds) {
+        std::lock_guard<std::mutex> lock(mutex);
+        st->match(cd, faceIds);
+      },
+      [&] (size_t i) {
+        std::lock_guard<std::mutex> lock(mutex);
+        renew(i);
+      },
+      [] {});
+
+    RcuTables tables(*st, fib, subSummaries, faceManager, stType, timerWheel);
+    vector<size_t> readers;
+    for (size_t t = 0; t < threadCount; t++) {
+      readers.push_back(tables.registerReader());
+    }
+    double replicated = measure(threadCount, seconds, pubs,
+      [&] (size_t thread, const Cd& cd, FaceIdVector& faceIds) {
+        tables.matchSt(readers[thread], cd, faceIds);
+      },
+      renew,
+      [&] { tables.sync(); });
+
+    vector<unique_ptr<MatchCache>> caches;
+    for (size_t t = 0; t < threadCount; t++) {
+      caches.emplace_back(new MatchCache(PubCount, &St::affects));
+    }
+    double cached = measure(threadCount, seconds, pubs,
+      [&] (size_t thread, const Cd& cd, FaceIdVector& faceIds) {
+        tables.catchUp(readers[thread]);
+        const St& replica = tables.getSt(readers[thread]);
+        if (!caches[thread]->find(cd, replica.changes(), faceIds)) {
+          replica.match(cd, faceIds);
+          caches[thread]->insert(cd, replica.changes(), faceIds);
+        }
+      },
+      renew,
+      [&] { tables.sync(); });
+    for (auto reader = readers.cbegin(); reader != readers.cend(); reader++) {
+      tables.unregisterReader(*reader);
+    }
+
+    std::printf("%-8lu %18.0f %18.0f %18.0f\n", threadCount, shared, replicated, cached);
+  }
+
+  return 0;
+}
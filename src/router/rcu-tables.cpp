@@ -0,0 +1,370 @@
+/*
+  rcu-tables.cpp
+
+  Copyright (c) 2019 KOZO KEIKAKU ENGINEERING Inc.
+
+  This software is released under the MIT License
+
+  Permission is hereby granted, free of charge, to any person obtaining a copy
+  of this software and associated documentation files (the "Software"), to deal
+  in the Software without restriction, including without limitation the rights
+  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+  copies of the Software, and to permit persons to whom the Software is
+  furnished to do so, subject to the following conditions:
+
+  The above copyright notice and this permission notice shall be included in all
+  copies or substantial portions of the Software.
+
+  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+  SOFTWARE.
+*/
+#include "rcu-tables.hpp"
+
+#include <fcopss/log.hpp>
+
+#include <unordered_set>
+
+namespace fcopss {
+namespace router {
+
+// the replicas expire nothing themselves, the expiries of the ST reach them as
+// updates, so they never arm a timer of the shared wheel
+static const time_duration Forever(boost::posix_time::pos_infin);
+
+static string
+keyOf(const Cd& cd)
+{
+  const Block& wire = cd.wireEncode();
+  return string(reinterpret_cast<const char*>(wire.wire()), wire.size());
+}
+
+RcuTables::Update::Update(uint64_t sequence)
+  : m_sequence(sequence)
+  , m_isStReset(false)
+  , m_isFibReset(false)
+  , m_next(nullptr)
+{
+}
+
+RcuTables::RcuTables(const St& st, const Fib& fib, const SubSummaryTable& subSummaries,
+                     const FaceManager& faceManager, const string& stType, TimerWheel& timerWheel)
+  : m_st(st)
+  , m_fib(fib)
+  , m_subSummaries(subSummaries)
+  , m_faceManager(faceManager)
+  , m_stType((stType == "sharded") ? "list" : stType)
+  , m_timerWheel(timerWheel)
+  , m_stGeneration(st.generation())
+  , m_fibGeneration(fib.generation())
+  , m_subSummaryFilters(m_epochs)
+  , m_subSummaryGeneration(subSummaries.generation())
+  , m_faces(m_epochs)
+  , m_faceGeneration(faceManager.generation())
+{
+  m_updates.emplace_back(new Update(0));
+
+  unique_ptr<SubSummaryFilters> filters(new SubSummaryFilters());
+  m_subSummaries.getReceivedFilters(*filters);
+  m_subSummaryFilters.publish(unique_ptr<const SubSummaryFilters>(filters.release()));
+  m_faces.publish(unique_ptr<const FaceTable>(new FaceTable(m_faceManager.getFaceTable())));
+}
+
+bool
+RcuTables::sync()
+{
+  bool isPublished = false;
+
+  unique_ptr<Update> update(new Update(m_updates.back()->m_sequence + 1));
+  collectSt(*update);
+  collectFib(*update);
+  if (update->m_isStReset || update->m_isFibReset ||
+      !update->m_stEntries.empty() || !update->m_fibEntries.empty()) {
+    DEBUG("tables update %llu published : ST entries=%lu%s, FIB entries=%lu%s",
+          update->m_sequence, update->m_stEntries.size(), update->m_isStReset ? " (all)" : "",
+          update->m_fibEntries.size(), update->m_isFibReset ? " (all)" : "");
+    m_updates.back()->m_next.store(update.get(), std::memory_order_release);
+    m_updates.push_back(std::move(update));
+    isPublished = true;
+  }
+  if (m_subSummaryGeneration != m_subSummaries.generation()) {
+    unique_ptr<SubSummaryFilters> filters(new SubSummaryFilters());
+    m_subSummaries.getReceivedFilters(*filters);
+    DEBUG("SubSummary filters republished : faces=%lu", filters->size());
+    m_subSummaryFilters.publish(unique_ptr<const SubSummaryFilters>(filters.release()));
+    m_subSummaryGeneration = m_subSummaries.generation();
+    isPublished = true;
+  }
+  if (m_faceGeneration != m_faceManager.generation()) {
+    m_faces.publish(unique_ptr<const FaceTable>(new FaceTable(m_faceManager.getFaceTable())));
+    m_faceGeneration = m_faceManager.generation();
+    DEBUG("face table republished : faces=%lu", m_faces.get()->size());
+    isPublished = true;
+  }
+
+  // a reader follows the update it applied last to the next ones,
+  // so only the updates before it can go
+  uint64_t oldest = m_updates.back()->m_sequence;
+  for (size_t i = 0; i < EpochDomain::MaxReaders; i++) {
+    if (m_replicas[i]) {
+      oldest = std::min(oldest, m_replicas[i]->m_sequence.load(std::memory_order_acquire));
+    }
+  }
+  while (m_updates.front()->m_sequence < oldest) {
+    m_updates.pop_front();
+  }
+
+  m_epochs.reclaim();
+
+  return isPublished;
+}
+
+size_t
+RcuTables::registerReader()
+{
+  size_t reader = m_epochs.registerReader();
+
+  unique_ptr<Replica> replica(new Replica());
+  replica->m_st = St::create(m_stType, m_timerWheel, Forever, StCapacity(), 0);
+  replica->m_fib.reset(new Fib(m_fib.flowHashComponents()));
+  replica->m_update = m_updates.back().get();
+  replica->m_sequence.store(replica->m_update->m_sequence);
+
+  // changes made since the last sync() come again with the next one
+  Update tables(replica->m_update->m_sequence);
+  dumpSt(tables);
+  dumpFib(tables);
+  apply(tables, *replica);
+
+  m_replicas[reader] = std::move(replica);
+  return reader;
+}
+
+void
+RcuTables::unregisterReader(size_t reader)
+{
+  m_replicas[reader].reset();
+  m_epochs.unregisterReader(reader);
+}
+
+bool
+RcuTables::catchUp(size_t reader)
+{
+  Replica& replica = *m_replicas[reader];
+  const Update* next = replica.m_update->m_next.load(std::memory_order_acquire);
+  if (next == nullptr) {
+    return false;
+  }
+
+  while (next != nullptr) {
+    apply(*next, replica);
+    replica.m_update = next;
+    next = next->m_next.load(std::memory_order_acquire);
+  }
+  replica.m_sequence.store(replica.m_update->m_sequence, std::memory_order_release);
+  return true;
+}
+
+const St&
+RcuTables::getSt(size_t reader) const
+{
+  return *m_replicas[reader]->m_st;
+}
+
+const Fib&
+RcuTables::getFib(size_t reader) const
+{
+  return *m_replicas[reader]->m_fib;
+}
+
+void
+RcuTables::matchSt(size_t reader, const Cd& cd, FaceIdVector& faceIds)
+{
+  catchUp(reader);
+  m_replicas[reader]->m_st->match(cd, faceIds);
+}
+
+void
+RcuTables::matchFib(size_t reader, const Cd& cd, FaceIdVector& faceIds)
+{
+  catchUp(reader);
+  m_replicas[reader]->m_fib->match(cd, faceIds);
+}
+
+void
+RcuTables::countForwarded(size_t reader, const FibEntry& entry, const FaceId& faceId)
+{
+  m_replicas[reader]->m_fib->countForwarded(entry, faceId);
+}
+
+void
+RcuTables::takeForwardedCounts(size_t reader, vector<ForwardedCount>& counts)
+{
+  m_replicas[reader]->m_fib->takeForwardedCounts(counts);
+}
+
+void
+RcuTables::matchSubSummaries(size_t reader, const Cd& cd, FaceIdVector& faceIds) const
+{
+  EpochDomain::ReadGuard guard(m_epochs, reader);
+  const SubSummaryFilters* filters = m_subSummaryFilters.get();
+  for (auto it = filters->cbegin(); it != filters->cend(); it++) {
+    if (it->second.mayMatch(cd)) {
+      faceIds.push_back(it->first);
+    }
+  }
+}
+
+shared_ptr<Face>
+RcuTables::findFace(size_t reader, const FaceId& id) const
+{
+  EpochDomain::ReadGuard guard(m_epochs, reader);
+  const FaceTable* faces = m_faces.get();
+  auto it = faces->find(id);
+  return (it != faces->end()) ? it->second : nullptr;
+}
+
+void
+RcuTables::collectSt(Update& update)
+{
+  const ChangeLog& changes = m_st.changes();
+  if (changes.generation() == m_stGeneration) {
+    return;
+  }
+
+  if (changes.hasSince(m_stGeneration)) {
+    // an entry changed several times goes once, as it is now
+    std::unordered_set<string> keys;
+    FaceIdVector faceIds;
+    for (uint64_t generation = m_stGeneration + 1; generation <= changes.generation(); generation++) {
+      const Cd& cd = changes.at(generation);
+      if (keys.insert(keyOf(cd)).second) {
+        m_st.getFaceIds(cd, faceIds);
+        update.m_stEntries.emplace_back(cd, vector<FaceId>(faceIds.begin(), faceIds.end()));
+      }
+    }
+  } else {
+    update.m_isStReset = true;
+    dumpSt(update);
+  }
+  m_stGeneration = changes.generation();
+}
+
+void
+RcuTables::collectFib(Update& update)
+{
+  const ChangeLog& changes = m_fib.changes();
+  if (changes.generation() == m_fibGeneration) {
+    return;
+  }
+
+  if (changes.hasSince(m_fibGeneration)) {
+    std::unordered_set<string> keys;
+    for (uint64_t generation = m_fibGeneration + 1; generation <= changes.generation(); generation++) {
+      const Cd& cd = changes.at(generation);
+      if (keys.insert(keyOf(cd)).second) {
+        const FibEntry* entry = m_fib.findEntry(cd);
+        update.m_fibEntries.emplace_back(cd, vector<FibEntry::NextHop>());
+        if (entry != nullptr) {
+          update.m_fibEntries.back().second.assign(entry->m_nextHops.cbegin(), entry->m_nextHops.cend());
+        }
+      }
+    }
+  } else {
+    update.m_isFibReset = true;
+    dumpFib(update);
+  }
+  m_fibGeneration = changes.generation();
+}
+
+void
+RcuTables::dumpSt(Update& update) const
+{
+  m_st.forEachEntry([&update] (const Cd& cd, const FaceIdVector& faceIds) {
+    update.m_stEntries.emplace_back(cd, vector<FaceId>(faceIds.begin(), faceIds.end()));
+  });
+}
+
+void
+RcuTables::dumpFib(Update& update) const
+{
+  vector<const FibEntry*> entries;
+  m_fib.getEntries(entries);
+  for (auto entry = entries.cbegin(); entry != entries.cend(); entry++) {
+    update.m_fibEntries.emplace_back((*entry)->m_cd,
+                                     vector<FibEntry::NextHop>((*entry)->m_nextHops.cbegin(),
+                                                               (*entry)->m_nextHops.cend()));
+  }
+}
+
+void
+RcuTables::apply(const Update& update, Replica& replica)
+{
+  // every change was logged when made to the tables, once is enough
+  Log::InfoAsDebug infoAsDebug;
+
+  St& st = *replica.m_st;
+  if (update.m_isStReset) {
+    st.clear();
+  }
+  for (auto entry = update.m_stEntries.cbegin(); entry != update.m_stEntries.cend(); entry++) {
+    const Cd& cd = entry->first;
+    const vector<FaceId>& faceIds = entry->second;
+
+    st.getFaceIds(cd, replica.m_faceIds);
+    for (auto id = replica.m_faceIds.begin(); id != replica.m_faceIds.end(); id++) {
+      if (std::find(faceIds.cbegin(), faceIds.cend(), *id) == faceIds.cend()) {
+        st.remove(cd, *id);
+      }
+    }
+    for (auto id = faceIds.cbegin(); id != faceIds.cend(); id++) {
+      if (!replica.m_faceIds.contains(*id)) {
+        st.restore(cd, *id, Forever);
+      }
+    }
+  }
+
+  Fib& fib = *replica.m_fib;
+  if (update.m_isFibReset) {
+    fib.clear();
+  }
+  for (auto entry = update.m_fibEntries.cbegin(); entry != update.m_fibEntries.cend(); entry++) {
+    const Cd& cd = entry->first;
+    // sorted by FaceId, as in FibEntry::m_nextHops
+    const vector<FibEntry::NextHop>& nextHops = entry->second;
+    if (nextHops.empty()) {
+      fib.remove(cd);
+      continue;
+    }
+
+    // added before the others are removed, so the entry is kept and not made again
+    for (auto nextHop = nextHops.cbegin(); nextHop != nextHops.cend(); nextHop++) {
+      const FibEntry* current = fib.findEntry(cd);
+      if (current != nullptr) {
+        auto it = current->m_nextHops.find(*nextHop);
+        if ((it != current->m_nextHops.end()) && (it->m_cost == nextHop->m_cost)) {
+          continue;
+        }
+      }
+      fib.add(cd, nextHop->m_faceId, nextHop->m_cost);
+    }
+
+    const FibEntry* current = fib.findEntry(cd);
+    replica.m_removedIds.clear();
+    for (auto nextHop = current->m_nextHops.cbegin(); nextHop != current->m_nextHops.cend(); nextHop++) {
+      if (!std::binary_search(nextHops.cbegin(), nextHops.cend(), *nextHop)) {
+        replica.m_removedIds.push_back(nextHop->m_faceId);
+      }
+    }
+    for (auto id = replica.m_removedIds.cbegin(); id != replica.m_removedIds.cend(); id++) {
+      fib.remove(cd, *id);
+    }
+  }
+}
+
+} // namespace router
+} // namespace fcopss
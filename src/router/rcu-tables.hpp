@@ -0,0 +1,192 @@
+/*
+  rcu-tables.hpp
+
+  Copyright (c) 2019 KOZO KEIKAKU ENGINEERING Inc.
+
+  This software is released under the MIT License
+
+  Permission is hereby granted, free of charge, to any person obtaining a copy
+  of this software and associated documentation files (the "Software"), to deal
+  in the Software without restriction, including without limitation the rights
+  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+  copies of the Software, and to permit persons to whom the Software is
+  furnished to do so, subject to the following conditions:
+
+  The above copyright notice and this permission notice shall be included in all
+  copies or substantial portions of the Software.
+
+  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+  SOFTWARE.
+*/
+#ifndef _FCOPSS_ROUTER_RCU_TABLES_HPP_
+#define _FCOPSS_ROUTER_RCU_TABLES_HPP_
+
+#include <fcopss/common.hpp>
+
+#include "epoch.hpp"
+#include "st.hpp"
+#include "fib.hpp"
+#include "sub-summary-table.hpp"
+#include "face-manager.hpp"
+
+#include <deque>
+
+namespace fcopss {
+namespace router {
+
+class TimerWheel;
+
+// ST, FIB, SubSummary filters and face table readable from forwarding threads
+// without locks.
+//
+// Every forwarding thread matches against replicas of its own, an ST of the
+// configured type and a FIB, so it gets the same indexes as the control
+// thread.  The control thread owning the tables calls sync() after changing
+// them, which appends the entries changed since the last sync(), with the
+// next hops they now have, to a list of updates.  A forwarding thread applies
+// the updates it has not seen yet in catchUp(), so a change costs each reader
+// the changed entries only.  When the change log of a table no longer covers
+// the last sync(), after a clear(), a swap() or a long burst, the whole table
+// goes into one update instead.  Updates every reader has applied are freed by
+// the next sync().  The SubSummary filters and the face table are small and
+// are republished whole under epoch based reclamation.
+class RcuTables final : noncopyable
+{
+public:
+  // replica STs are made by St::create() with `stType`, "sharded" ones as a
+  // plain StImpl: a replica is matched by one forwarding thread already
+  RcuTables(const St& st, const Fib& fib, const SubSummaryTable& subSummaries,
+            const FaceManager& faceManager, const string& stType, TimerWheel& timerWheel);
+
+  // control thread, returns true if an update, the SubSummary filters or a
+  // face table was published
+  bool
+  sync();
+
+  // control thread, makes the replicas of a new reader from the current tables
+  size_t
+  registerReader();
+
+  // control thread, once the reader stopped reading
+  void
+  unregisterReader(size_t reader);
+
+  // forwarding thread, applies the updates published since its last
+  // catchUp(), returns true if there were some
+  bool
+  catchUp(size_t reader);
+
+  // forwarding thread, the replicas as of the last catchUp(), the same
+  // objects until the reader is unregistered
+  const St&
+  getSt(size_t reader) const;
+
+  const Fib&
+  getFib(size_t reader) const;
+
+  // forwarding thread, catchUp() then match against the replica
+  void
+  matchSt(size_t reader, const Cd& cd, FaceIdVector& faceIds);
+
+  void
+  matchFib(size_t reader, const Cd& cd, FaceIdVector& faceIds);
+
+  // forwarding thread, counts on `entry` of getFib(reader), see Fib::countForwarded()
+  void
+  countForwarded(size_t reader, const FibEntry& entry, const FaceId& faceId);
+
+  // forwarding thread, counts made since the last call, for the FIB of the control thread
+  void
+  takeForwardedCounts(size_t reader, vector<ForwardedCount>& counts);
+
+  // forwarding thread, SubSummaryTable::match() on the filters of the last sync()
+  void
+  matchSubSummaries(size_t reader, const Cd& cd, FaceIdVector& faceIds) const;
+
+  // nullptr if the face was gone at the last sync()
+  shared_ptr<Face>
+  findFace(size_t reader, const FaceId& id) const;
+
+private:
+  // entries changed between two sync(), as they were at the second one
+  class Update final : noncopyable
+  {
+  public:
+    explicit
+    Update(uint64_t sequence);
+
+  public:
+    uint64_t m_sequence;
+    // the replica is cleared first, the entries are the whole table
+    bool m_isStReset;
+    bool m_isFibReset;
+    // no next hops for an entry that was removed
+    vector<std::pair<Cd, vector<FaceId>>> m_stEntries;
+    vector<std::pair<Cd, vector<FibEntry::NextHop>>> m_fibEntries;
+    // set once by the control thread when the next update is published
+    std::atomic<Update*> m_next;
+  };
+
+  class Replica final : noncopyable
+  {
+  public:
+    unique_ptr<St> m_st;
+    unique_ptr<Fib> m_fib;
+    // last update applied, forwarding thread only
+    const Update* m_update;
+    // m_update->m_sequence, sync() frees the updates before it
+    std::atomic<uint64_t> m_sequence;
+    // scratch for catchUp()
+    FaceIdVector m_faceIds;
+    vector<FaceId> m_removedIds;
+  };
+
+private:
+  // control thread, fills `update` with what changed since the last sync()
+  void
+  collectSt(Update& update);
+
+  void
+  collectFib(Update& update);
+
+  // every entry of the table, for a replica starting from scratch
+  void
+  dumpSt(Update& update) const;
+
+  void
+  dumpFib(Update& update) const;
+
+  static void
+  apply(const Update& update, Replica& replica);
+
+private:
+  const St& m_st;
+  const Fib& m_fib;
+  const SubSummaryTable& m_subSummaries;
+  const FaceManager& m_faceManager;
+  string m_stType;
+  TimerWheel& m_timerWheel;
+  // table generations the last update was collected at
+  uint64_t m_stGeneration;
+  uint64_t m_fibGeneration;
+  // oldest first, the last one is where new readers start
+  std::deque<unique_ptr<Update>> m_updates;
+  // indexed by reader, nullptr for an unused one
+  unique_ptr<Replica> m_replicas[EpochDomain::MaxReaders];
+  // declared before what retires into it
+  mutable EpochDomain m_epochs;
+  RcuPtr<SubSummaryFilters> m_subSummaryFilters;
+  uint64_t m_subSummaryGeneration;
+  RcuPtr<FaceTable> m_faces;
+  uint64_t m_faceGeneration;
+};
+
+} // namespace router
+} // namespace fcopss
+
+#endif // _FCOPSS_ROUTER_RCU_TABLES_HPP_
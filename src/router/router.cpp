@@ -25,12 +25,18 @@
 */
 #include "router.hpp"
 #include "fib.hpp"
-#include "st-impl.hpp"
+#include "st.hpp"
+#include "sub-summary-table.hpp"
 #include "forwarder.hpp"
 #include "face-manager.hpp"
 #include "tcp-server.hpp"
 #include "udp-server.hpp"
 #include "cmd-server.hpp"
+#include "snapshot.hpp"
+#include "worker.hpp"
+#include "rcu-tables.hpp"
+
+#include <boost/bind.hpp>
 
 #include <fcopss/log.hpp>
 
@@ -40,24 +46,114 @@ namespace fcopss {
 namespace router {
 
 Router::Router(const fcopss::Config& config)
-  : m_signals(m_ioService)
+  : m_signals(m_ioService),
+    m_fibFile(config.routerFibFile()),
+    m_startedAt(boost::posix_time::microsec_clock::universal_time()),
+    m_snapshotInterval(config.routerSnapshotInterval()),
+    m_snapshotTimer(m_ioService)
 {
   m_signals.add(SIGTERM);
   m_signals.add(SIGINT);
 
-  m_fib.reset(new Fib());
+  m_fib.reset(new Fib(config.routerFibFlowHashComponents()));
+
+  // ST soft state is refreshed in the order of minutes, one second granularity is enough
+  m_timerWheel.reset(new TimerWheel(m_ioService, boost::posix_time::seconds(1)));
+
+  StCapacity capacity;
+  capacity.m_maxEntries = config.routerStMaxEntries();
+  capacity.m_maxEntriesPerFace = config.routerStMaxEntriesPerFace();
+  string evictPolicy = config.routerStEvictPolicy();
+  if (evictPolicy == "none") {
+    capacity.m_evictPolicy = StCapacity::EvictNone;
+  } else if (evictPolicy == "lru") {
+    capacity.m_evictPolicy = StCapacity::EvictLeastRecentlyMatched;
+  } else {
+    capacity.m_evictPolicy = StCapacity::EvictOldestLease;
+  }
+
+  string stType = config.routerStType();
+  // a limit the ST cannot enforce is refused rather than silently ignored
+  bool isBounded = (capacity.m_maxEntries > 0) || (capacity.m_maxEntriesPerFace > 0);
+  if (isBounded && ((stType == "trie") || (stType == "automaton") || (stType == "compact") ||
+                    (stType == "sharded"))) {
+    ERROR("ST type=%s is unbounded, StMaxEntries and StMaxEntriesPerFace must be 0", stType.c_str());
+    BOOST_THROW_EXCEPTION(Error("ST type " + stType + " does not support StMaxEntries or StMaxEntriesPerFace"));
+  }
+  if ((stType == "flat") && (capacity.m_maxEntries > 0) &&
+      (capacity.m_evictPolicy == StCapacity::EvictLeastRecentlyMatched)) {
+    ERROR("ST type=flat does not see matches, StEvictPolicy=lru is not supported");
+    BOOST_THROW_EXCEPTION(Error("ST type flat does not support StEvictPolicy lru"));
+  }
+
+  m_st = St::create(stType, *m_timerWheel, config.routerStExpireTime(), capacity, config.routerStShardCount());
+  INFO("ST type=%s", stType.c_str());
+  INFO("ST capacity : entries=%lu, per face=%lu, evict=%s",
+       capacity.m_maxEntries, capacity.m_maxEntriesPerFace, evictPolicy.c_str());
+
+  m_fibCache.reset(new MatchCache(config.routerMatchCacheSize(), &Fib::affects));
+  m_stCache.reset(new MatchCache(config.routerMatchCacheSize(), &St::affects));
+  INFO("match cache size=%lu", config.routerMatchCacheSize());
 
-  m_st.reset(new StImpl(m_ioService, config.routerStExpireTime()));
+  m_subSummaries.reset(new SubSummaryTable(config.routerSubSummaryBitCount(), config.routerSubSummaryHashCount()));
+  if (!config.routerSubSummaryInterval().is_pos_infinity()) {
+    INFO("SubSummary interval=%lds bits=%lu hashes=%lu",
+         config.routerSubSummaryInterval().total_seconds(),
+         config.routerSubSummaryBitCount(), config.routerSubSummaryHashCount());
+  }
 
   m_faceManager.reset(new FaceManager(m_ioService));
 
-  m_forwarder.reset(new Forwarder(m_ioService, *m_fib, *m_st, *m_faceManager));
+  // workers match Pubs against replicas, the control thread ST never sees them
+  bool isMatchOrdered = (capacity.m_maxEntries > 0) &&
+                        (capacity.m_evictPolicy == StCapacity::EvictLeastRecentlyMatched);
+  size_t workerCount = config.routerWorkerCount();
+  if (workerCount == 0) {
+    workerCount = isMatchOrdered ? 1 : std::max(std::thread::hardware_concurrency(), 1u);
+  }
+  if (workerCount > EpochDomain::MaxReaders) {
+    WARN("WorkerCount=%lu exceeds %lu, using %lu", workerCount, EpochDomain::MaxReaders, EpochDomain::MaxReaders);
+    workerCount = EpochDomain::MaxReaders;
+  }
+  if (isMatchOrdered && (workerCount > 1)) {
+    ERROR("WorkerCount=%lu matches Pubs on replicas, StEvictPolicy=lru is not supported", workerCount);
+    BOOST_THROW_EXCEPTION(Error("StEvictPolicy lru is not supported with more than one worker"));
+  }
+  // one worker would only add a hop to every packet, the control thread forwards itself
+  vector<Worker*> workers;
+  if (workerCount > 1) {
+    for (size_t i = 0; i < workerCount; i++) {
+      m_workers.emplace_back(new Worker(i, config.routerPort(), config.tcpReceiveTimeout(), *m_faceManager));
+      workers.push_back(m_workers.back().get());
+    }
+    m_faceManager->setWorkers(workers);
+    m_tables.reset(new RcuTables(*m_st, *m_fib, *m_subSummaries, *m_faceManager, stType, *m_timerWheel));
+  }
+  INFO("workers=%lu", m_workers.size());
 
-  m_tcpServer.reset(
-    new TcpServer(m_ioService, config.routerPort(), config.tcpReceiveTimeout(), *m_faceManager)
-  );
+  m_forwarder.reset(new Forwarder(m_ioService, *m_fib, *m_st, *m_faceManager, *m_fibCache, *m_stCache,
+                                  *m_subSummaries, config.routerSubSummaryInterval(),
+                                  m_tables.get(), workers));
+
+  if (m_workers.empty()) {
+    m_tcpServer.reset(
+      new TcpServer(m_ioService, config.routerPort(), config.tcpReceiveTimeout(), *m_faceManager)
+    );
+
+    m_udpServer.reset(new UdpServer(m_ioService, config.routerPort(), *m_faceManager));
+  }
 
-  m_udpServer.reset(new UdpServer(m_ioService, config.routerPort(), *m_faceManager));
+  m_fibLoader.reset(
+    new FibLoader(
+      m_ioService,
+      config.routerPort(),
+      config.tcpReceiveTimeout(),
+      config.tcpConnectionTimeout(),
+      *m_faceManager,
+      *m_fib,
+      [this] (const Fib& previous) { m_forwarder->onFibSwapped(previous); }
+    )
+  );
 
   m_cmdServer.reset(
     new CmdServer(
@@ -68,9 +164,34 @@ Router::Router(const fcopss::Config& config)
       config.tcpConnectionTimeout(),
       *m_faceManager,
       *m_fib,
-      *m_st
+      *m_st,
+      *m_fibCache,
+      *m_stCache,
+      *m_fibLoader
     )
   );  
+
+  // after the Forwarder, restored faces need its event handlers
+  if (!config.routerSnapshotFile().empty()) {
+    m_snapshot.reset(
+      new Snapshot(
+        m_ioService,
+        config.routerSnapshotFile(),
+        config.routerPort(),
+        config.tcpReceiveTimeout(),
+        *m_faceManager,
+        *m_fib,
+        *m_st
+      )
+    );
+    // a FIB file is the authority on the FIB, the snapshot only brings the ST back
+    m_snapshot->load(config.routerStExpireTime(), m_fibFile.empty());
+  }
+}
+
+Router::~Router()
+{
+  stopWorkers();
 }
 
 void
@@ -78,20 +199,87 @@ Router::run()
 {
   m_signals.async_wait(boost::bind(&Router::onSignal, this, placeholders::error, placeholders::signal_number));
 
-  m_tcpServer->start();
-  m_udpServer->start();
   m_cmdServer->start();
+  m_forwarder->start();
+  if (m_snapshot) {
+    startSnapshotTimer();
+  }
+
+  // faces of the FIB file are all connected at once, packets are taken
+  // only once the whole FIB is in place
+  if (m_fibFile.empty()) {
+    startServers();
+  } else {
+    m_fibLoader->load(m_fibFile, [this] (const FibLoader::Result& result) { onFibLoaded(result); });
+  }
 
   INFO("router start");
   m_ioService.run();
+  stopWorkers();
   INFO("router end");
 }
 
+void
+Router::onFibLoaded(const FibLoader::Result& result)
+{
+  if (!result.m_error.empty()) {
+    ERROR("FIB file %s not loaded: %s", m_fibFile.c_str(), result.m_error.c_str());
+  }
+  startServers();
+}
+
+void
+Router::startServers()
+{
+  if (m_workers.empty()) {
+    m_tcpServer->start();
+    m_udpServer->start();
+  }
+  for (auto worker = m_workers.begin(); worker != m_workers.end(); worker++) {
+    (*worker)->start();
+  }
+
+  time_duration coldStart = boost::posix_time::microsec_clock::universal_time() - m_startedAt;
+  INFO("router forwarding, cold start took %lldms", (long long)coldStart.total_milliseconds());
+}
+
 void
 Router::onSignal(const boost::system::error_code& error, int signal)
 {
+  if (m_snapshot) {
+    m_snapshot->save();
+  }
   m_ioService.stop();
 }
 
+void
+Router::stopWorkers()
+{
+  for (auto worker = m_workers.begin(); worker != m_workers.end(); worker++) {
+    (*worker)->stop();
+  }
+}
+
+void
+Router::startSnapshotTimer()
+{
+  if (m_snapshotInterval.is_pos_infinity()) {
+    return;
+  }
+  m_snapshotTimer.expires_from_now(m_snapshotInterval);
+  m_snapshotTimer.async_wait(boost::bind(&Router::onSnapshotTimer, this, placeholders::error));
+}
+
+void
+Router::onSnapshotTimer(const boost::system::error_code& error)
+{
+  if (error) {
+    return;
+  }
+
+  m_snapshot->save();
+  startSnapshotTimer();
+}
+
 } // namespace fcopss
 } // namespace router
@@ -31,11 +31,18 @@
 
 #include "fib.hpp"
 #include "st.hpp"
+#include "timer-wheel.hpp"
+#include "match-cache.hpp"
+#include "sub-summary-table.hpp"
 #include "face-manager.hpp"
 #include "forwarder.hpp"
+#include "fib-loader.hpp"
 #include "tcp-server.hpp"
 #include "udp-server.hpp"
 #include "cmd-server.hpp"
+#include "snapshot.hpp"
+#include "worker.hpp"
+#include "rcu-tables.hpp"
 
 namespace fcopss {
 namespace router {
@@ -43,24 +50,67 @@ namespace router {
 class Router final : noncopyable
 {
 public:
+  class Error : public std::runtime_error
+  {
+  public:
+    explicit
+    Error(const string& what)
+      : std::runtime_error(what)
+    {
+    }
+  };
+
+  // throws Error if the configuration asks for something the router cannot do
   Router(const fcopss::Config& config);
 
+  ~Router();
+
   void
   run();
 
   void
   onSignal(const boost::system::error_code& error, int signal);
 
+private:
+  void
+  onFibLoaded(const FibLoader::Result& result);
+
+  // starts taking packets, once the FIB of the FIB file is in place
+  void
+  startServers();
+
+  void
+  stopWorkers();
+
+  void
+  startSnapshotTimer();
+
+  void
+  onSnapshotTimer(const boost::system::error_code& error);
+
 private:
   boost::asio::io_service m_ioService;
   boost::asio::signal_set m_signals;
+  // before everything that may hold a face, transports of pinned faces use their io_service
+  vector<unique_ptr<Worker>> m_workers;
   unique_ptr<Fib> m_fib;
+  unique_ptr<TimerWheel> m_timerWheel;
   unique_ptr<St> m_st;
+  unique_ptr<MatchCache> m_fibCache;
+  unique_ptr<MatchCache> m_stCache;
+  unique_ptr<SubSummaryTable> m_subSummaries;
+  unique_ptr<RcuTables> m_tables;
   unique_ptr<Forwarder> m_forwarder;
   unique_ptr<FaceManager> m_faceManager;
   unique_ptr<TcpServer> m_tcpServer;
   unique_ptr<UdpServer> m_udpServer;
+  unique_ptr<FibLoader> m_fibLoader;
   unique_ptr<CmdServer> m_cmdServer;
+  unique_ptr<Snapshot> m_snapshot;
+  string m_fibFile;
+  boost::posix_time::ptime m_startedAt;
+  time_duration m_snapshotInterval;
+  deadline_timer m_snapshotTimer;
 };
 
 } // namespace router
@@ -0,0 +1,432 @@
+/*
+  snapshot.cpp
+
+  Copyright (c) 2019 KOZO KEIKAKU ENGINEERING Inc.
+
+  This software is released under the MIT License
+
+  Permission is hereby granted, free of charge, to any person obtaining a copy
+  of this software and associated documentation files (the "Software"), to deal
+  in the Software without restriction, including without limitation the rights
+  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+  copies of the Software, and to permit persons to whom the Software is
+  furnished to do so, subject to the following conditions:
+
+  The above copyright notice and this permission notice shall be included in all
+  copies or substantial portions of the Software.
+
+  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+  SOFTWARE.
+*/
+#include "snapshot.hpp"
+#include "tcp-transport.hpp"
+#include "udp-transport.hpp"
+#include "face-manager.hpp"
+#include "fib.hpp"
+#include "st.hpp"
+#include "st-entry.hpp"
+
+#include <cerrno>
+#include <cstdio>
+#include <cstring>
+#include <ctime>
+
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include <boost/bind.hpp>
+
+#include <fcopss/log.hpp>
+
+namespace asio = boost::asio;
+namespace placeholders = boost::asio::placeholders;
+
+using reuse_address = boost::asio::socket_base::reuse_address;
+using reuse_port = boost::asio::detail::socket_option::boolean<SOL_SOCKET, SO_REUSEPORT>;
+
+namespace fcopss {
+namespace router {
+
+static const char Magic[4] = { 'F', 'C', 'S', 'N' };
+static const uint32_t Version = 1;
+
+template<typename T>
+static void
+append(vector<uint8_t>& buffer, const T& value)
+{
+  const uint8_t* p = reinterpret_cast<const uint8_t*>(&value);
+  buffer.insert(buffer.end(), p, p + sizeof(T));
+}
+
+static void
+append(vector<uint8_t>& buffer, const uint8_t* data, size_t size)
+{
+  buffer.insert(buffer.end(), data, data + size);
+}
+
+// bounds checked cursor over the mapped file
+class SnapshotReader
+{
+public:
+  SnapshotReader(const uint8_t* data, size_t size)
+    : m_data(data), m_size(size), m_offset(0)
+  {
+  }
+
+  template<typename T>
+  T
+  read()
+  {
+    T value;
+    std::memcpy(&value, take(sizeof(T)), sizeof(T));
+    return value;
+  }
+
+  const uint8_t*
+  take(size_t size)
+  {
+    if (size > m_size - m_offset) {
+      BOOST_THROW_EXCEPTION(Snapshot::Error("truncated snapshot"));
+    }
+    const uint8_t* p = m_data + m_offset;
+    m_offset += size;
+    return p;
+  }
+
+  Cd
+  readCd(size_t size)
+  {
+    const uint8_t* p = take(size);
+    try {
+      return Cd(Block(p, size));
+    } catch (const std::exception& e) {
+      BOOST_THROW_EXCEPTION(Snapshot::Error(string("broken CD in snapshot: ") + e.what()));
+    }
+  }
+
+private:
+  const uint8_t* m_data;
+  size_t m_size;
+  size_t m_offset;
+};
+
+bool
+Snapshot::Endpoint::operator<(const Endpoint& other) const
+{
+  return std::tie(m_type, m_ip, m_port) < std::tie(other.m_type, other.m_ip, other.m_port);
+}
+
+Snapshot::Snapshot(
+  io_service& ioService,
+  const string& path,
+  uint16_t routerPort,
+  const time_duration& receiveTimeout,
+  FaceManager& faceManager,
+  Fib& fib,
+  St& st)
+  : m_ioService(ioService),
+    m_path(path),
+    m_routerPort(routerPort),
+    m_receiveTimeout(receiveTimeout),
+    m_faceManager(faceManager),
+    m_fib(fib),
+    m_st(st)
+{
+}
+
+void
+Snapshot::save() const
+{
+  vector<const FibEntry*> fibEntries;
+  m_fib.getEntries(fibEntries);
+
+  std::set<FaceId> faceIds;
+  for (auto entry = fibEntries.cbegin(); entry != fibEntries.cend(); entry++) {
+    for (auto nextHop = (*entry)->m_nextHops.cbegin(); nextHop != (*entry)->m_nextHops.cend(); nextHop++) {
+      faceIds.insert(nextHop->m_faceId);
+    }
+  }
+
+  // the ST entries go last, they are encoded as they are visited
+  vector<uint8_t> stBody;
+  uint32_t stCount = 0;
+  m_st.forEachEntry([&] (const Cd& cd, const FaceIdVector& stFaceIds) {
+    const Block& wire = cd.wireEncode();
+    append(stBody, uint32_t(wire.size()));
+    append(stBody, uint32_t(stFaceIds.size()));
+    append(stBody, wire.wire(), wire.size());
+    for (auto id = stFaceIds.begin(); id != stFaceIds.end(); id++) {
+      append(stBody, uint64_t(*id));
+      faceIds.insert(*id);
+    }
+    stCount++;
+  });
+
+  vector<uint8_t> body;
+  uint32_t faceCount = 0;
+  for (auto id = faceIds.cbegin(); id != faceIds.cend(); id++) {
+    shared_ptr<Face> face = m_faceManager.find(*id);
+    if (!face) {
+      continue;
+    }
+    append(body, uint64_t(*id));
+    append(body, uint16_t(face->getRemotePort()));
+    append(body, uint8_t(face->getType().size()));
+    append(body, uint8_t(face->getRemoteIp().size()));
+    append(body, reinterpret_cast<const uint8_t*>(face->getType().data()), face->getType().size());
+    append(body, reinterpret_cast<const uint8_t*>(face->getRemoteIp().data()), face->getRemoteIp().size());
+    faceCount++;
+  }
+
+  for (auto entry = fibEntries.cbegin(); entry != fibEntries.cend(); entry++) {
+    const Block& wire = (*entry)->m_cd.wireEncode();
+    append(body, uint32_t(wire.size()));
+    append(body, uint32_t((*entry)->m_nextHops.size()));
+    append(body, wire.wire(), wire.size());
+    for (auto nextHop = (*entry)->m_nextHops.cbegin(); nextHop != (*entry)->m_nextHops.cend(); nextHop++) {
+      append(body, uint64_t(nextHop->m_faceId));
+      append(body, uint32_t(nextHop->m_cost));
+    }
+  }
+
+  body.insert(body.end(), stBody.cbegin(), stBody.cend());
+
+  vector<uint8_t> header;
+  append(header, reinterpret_cast<const uint8_t*>(Magic), sizeof(Magic));
+  append(header, Version);
+  append(header, int64_t(std::time(nullptr)));
+  append(header, faceCount);
+  append(header, uint32_t(fibEntries.size()));
+  append(header, stCount);
+  append(header, uint32_t(0));
+
+  string tmpPath = m_path + ".tmp";
+  ofstream ofs(tmpPath, std::ios::binary | std::ios::trunc);
+  ofs.write(reinterpret_cast<const char*>(header.data()), header.size());
+  ofs.write(reinterpret_cast<const char*>(body.data()), body.size());
+  ofs.close();
+  if (!ofs) {
+    ERROR("snapshot %s write error", tmpPath.c_str());
+    return;
+  }
+
+  if (std::rename(tmpPath.c_str(), m_path.c_str()) != 0) {
+    ERROR("snapshot %s rename error: %s", m_path.c_str(), std::strerror(errno));
+    return;
+  }
+
+  INFO("snapshot %s saved: %u faces, %lu FIB entries, %u ST entries",
+       m_path.c_str(), faceCount, fibEntries.size(), stCount);
+}
+
+void
+Snapshot::load(const time_duration& stExpireTime, bool isFibRestored)
+{
+  int fd = ::open(m_path.c_str(), O_RDONLY);
+  if (fd < 0) {
+    INFO("snapshot %s not loaded: %s", m_path.c_str(), std::strerror(errno));
+    return;
+  }
+
+  struct stat status;
+  if ((::fstat(fd, &status) != 0) || (status.st_size == 0)) {
+    WARN("snapshot %s not loaded: empty or unreadable", m_path.c_str());
+    ::close(fd);
+    return;
+  }
+
+  size_t size = status.st_size;
+  void* data = ::mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0);
+  ::close(fd);
+  if (data == MAP_FAILED) {
+    WARN("snapshot %s not loaded: %s", m_path.c_str(), std::strerror(errno));
+    return;
+  }
+
+  try {
+    restore(static_cast<const uint8_t*>(data), size, stExpireTime, isFibRestored);
+  } catch (const Error& e) {
+    WARN("snapshot %s not loaded: %s", m_path.c_str(), e.what());
+  }
+
+  ::munmap(data, size);
+}
+
+void
+Snapshot::restore(const uint8_t* data, size_t size, const time_duration& stExpireTime, bool isFibRestored)
+{
+  SnapshotReader reader(data, size);
+
+  if (std::memcmp(reader.take(sizeof(Magic)), Magic, sizeof(Magic)) != 0) {
+    BOOST_THROW_EXCEPTION(Error("not a snapshot"));
+  }
+  if (reader.read<uint32_t>() != Version) {
+    BOOST_THROW_EXCEPTION(Error("unknown snapshot version"));
+  }
+  int64_t savedAt = reader.read<int64_t>();
+  uint32_t faceCount = reader.read<uint32_t>();
+  uint32_t fibCount = reader.read<uint32_t>();
+  uint32_t stCount = reader.read<uint32_t>();
+  reader.read<uint32_t>();
+
+  // parse everything first, a broken file leaves the tables untouched
+  std::map<uint64_t, Endpoint> endpoints;
+  for (uint32_t i = 0; i < faceCount; i++) {
+    uint64_t id = reader.read<uint64_t>();
+    Endpoint& endpoint = endpoints[id];
+    endpoint.m_port = reader.read<uint16_t>();
+    uint8_t typeSize = reader.read<uint8_t>();
+    uint8_t ipSize = reader.read<uint8_t>();
+    endpoint.m_type.assign(reinterpret_cast<const char*>(reader.take(typeSize)), typeSize);
+    endpoint.m_ip.assign(reinterpret_cast<const char*>(reader.take(ipSize)), ipSize);
+  }
+
+  vector<std::tuple<Cd, uint64_t, uint32_t>> fibNextHops;
+  for (uint32_t i = 0; i < fibCount; i++) {
+    uint32_t cdSize = reader.read<uint32_t>();
+    uint32_t nextHopCount = reader.read<uint32_t>();
+    Cd cd = reader.readCd(cdSize);
+    for (uint32_t j = 0; j < nextHopCount; j++) {
+      uint64_t id = reader.read<uint64_t>();
+      uint32_t cost = reader.read<uint32_t>();
+      fibNextHops.emplace_back(cd, id, cost);
+    }
+  }
+
+  vector<std::pair<Cd, uint64_t>> stNextHops;
+  for (uint32_t i = 0; i < stCount; i++) {
+    uint32_t cdSize = reader.read<uint32_t>();
+    uint32_t nextHopCount = reader.read<uint32_t>();
+    Cd cd = reader.readCd(cdSize);
+    for (uint32_t j = 0; j < nextHopCount; j++) {
+      stNextHops.emplace_back(cd, reader.read<uint64_t>());
+    }
+  }
+
+  if (!isFibRestored) {
+    INFO("snapshot %s : %lu FIB next hops skipped, the FIB comes from the FIB file",
+         m_path.c_str(), fibNextHops.size());
+    fibNextHops.clear();
+  }
+
+  size_t fibRestored = 0;
+  std::map<Endpoint, vector<Route>> tcpRoutes;
+  for (auto it = fibNextHops.cbegin(); it != fibNextHops.cend(); it++) {
+    auto endpoint = endpoints.find(std::get<1>(*it));
+    if (endpoint == endpoints.end()) {
+      continue;
+    }
+    if (endpoint->second.m_type == "udp") {
+      shared_ptr<Face> face = openUdpFace(endpoint->second);
+      if (face) {
+        m_fib.add(std::get<0>(*it), face->getId(), std::get<2>(*it));
+        fibRestored++;
+      }
+    } else {
+      tcpRoutes[endpoint->second].push_back(Route(std::get<0>(*it), std::get<2>(*it)));
+    }
+  }
+
+  size_t stRestored = 0;
+  size_t stDropped = 0;
+  int64_t age = int64_t(std::time(nullptr)) - savedAt;
+  if (stExpireTime.is_pos_infinity() || (age < stExpireTime.total_seconds())) {
+    // a next hop refreshed right before the save has this much of its lease left, at most
+    time_duration lifetime = stExpireTime - boost::posix_time::seconds(std::max<int64_t>(age, 0));
+    for (auto it = stNextHops.cbegin(); it != stNextHops.cend(); it++) {
+      auto endpoint = endpoints.find(it->second);
+      if ((endpoint == endpoints.end()) || (endpoint->second.m_type != "udp")) {
+        stDropped++;
+        continue;
+      }
+      shared_ptr<Face> face = openUdpFace(endpoint->second);
+      if (face) {
+        m_st.restore(it->first, face->getId(), lifetime);
+        stRestored++;
+      } else {
+        stDropped++;
+      }
+    }
+  } else {
+    stDropped = stNextHops.size();
+  }
+
+  for (auto it = tcpRoutes.cbegin(); it != tcpRoutes.cend(); it++) {
+    connectTcpFace(it->first, it->second);
+  }
+
+  INFO("snapshot %s loaded (%llds old): %lu FIB next hops, %lu ST next hops restored, "
+       "%lu FIB next hops reconnecting, %lu ST next hops dropped",
+       m_path.c_str(), (long long)age, fibRestored, stRestored,
+       fibNextHops.size() - fibRestored, stDropped);
+}
+
+shared_ptr<Face>
+Snapshot::openUdpFace(const Endpoint& endpoint)
+{
+  shared_ptr<Face> face = m_faceManager.find(endpoint.m_type, endpoint.m_ip, endpoint.m_port);
+  if (face) {
+    return face;
+  }
+
+  try {
+    udp::socket s(m_ioService);
+    s.open(udp::v4());
+    s.set_option(reuse_address(true));
+    s.set_option(reuse_port(true));
+    s.bind(udp::endpoint(udp::v4(), m_routerPort));
+    s.connect(udp::endpoint(asio::ip::address::from_string(endpoint.m_ip), endpoint.m_port));
+
+    shared_ptr<Transport> transport = UdpTransport::create(m_faceManager.pin(std::move(s)));
+    face = m_faceManager.createFace(transport);
+  } catch (const boost::system::system_error& e) {
+    WARN("snapshot face udp %s:%hu not restored: %s", endpoint.m_ip.c_str(), endpoint.m_port, e.what());
+  }
+
+  return face;
+}
+
+void
+Snapshot::connectTcpFace(const Endpoint& endpoint, const vector<Route>& routes)
+{
+  auto socket = make_shared<tcp::socket>(m_ioService);
+
+  try {
+    socket->open(tcp::v4());
+    socket->set_option(reuse_address(true));
+    socket->set_option(reuse_port(true));
+    socket->bind(tcp::endpoint(tcp::v4(), m_routerPort));
+    socket->async_connect(
+      tcp::endpoint(asio::ip::address::from_string(endpoint.m_ip), endpoint.m_port),
+      boost::bind(&Snapshot::onTcpConnected, this, socket, endpoint, routes, placeholders::error));
+  } catch (const boost::system::system_error& e) {
+    WARN("snapshot face tcp %s:%hu not restored: %s", endpoint.m_ip.c_str(), endpoint.m_port, e.what());
+  }
+}
+
+void
+Snapshot::onTcpConnected(shared_ptr<tcp::socket> socket, const Endpoint& endpoint, const vector<Route>& routes,
+                         const boost::system::error_code& error)
+{
+  if (error) {
+    WARN("snapshot face tcp %s:%hu not restored: %s", endpoint.m_ip.c_str(), endpoint.m_port, error.message().c_str());
+    return;
+  }
+
+  shared_ptr<Transport> transport = TcpTransport::create(m_faceManager.pin(std::move(*socket)), m_receiveTimeout);
+  shared_ptr<Face> face = m_faceManager.createFace(transport);
+  for (auto route = routes.cbegin(); route != routes.cend(); route++) {
+    m_fib.add(route->first, face->getId(), route->second);
+  }
+  INFO("snapshot face tcp %s:%hu restored with %lu FIB next hops", endpoint.m_ip.c_str(), endpoint.m_port, routes.size());
+}
+
+} // namespace router
+} // namespace fcopss
@@ -0,0 +1,136 @@
+/*
+  snapshot.hpp
+
+  Copyright (c) 2019 KOZO KEIKAKU ENGINEERING Inc.
+
+  This software is released under the MIT License
+
+  Permission is hereby granted, free of charge, to any person obtaining a copy
+  of this software and associated documentation files (the "Software"), to deal
+  in the Software without restriction, including without limitation the rights
+  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+  copies of the Software, and to permit persons to whom the Software is
+  furnished to do so, subject to the following conditions:
+
+  The above copyright notice and this permission notice shall be included in all
+  copies or substantial portions of the Software.
+
+  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+  SOFTWARE.
+*/
+#ifndef _FCOPSS_ROUTER_SNAPSHOT_HPP_
+#define _FCOPSS_ROUTER_SNAPSHOT_HPP_
+
+#include <fcopss/common.hpp>
+
+#include "face.hpp"
+
+#include <map>
+
+namespace fcopss {
+namespace router {
+
+class FaceManager;
+class Fib;
+class St;
+
+// Binary snapshot of the FIB and ST, for a warm restart.
+//
+// FaceIds do not survive a restart, so next hops are saved together with the
+// endpoint of their face. On load, UDP faces are opened again at once and TCP
+// faces toward FIB next hops are reconnected. ST next hops on TCP faces are
+// dropped, only the subscriber behind such a face can reconnect it.  With a
+// FIB file configured the FIB is not restored at all: the file replaces the
+// whole FIB once loaded, and routes of a TCP face reconnecting after that
+// would be mixed into it.
+//
+// The file is read through mmap(2). It holds host byte order integers, it is
+// meant to be read back by the router that wrote it:
+//
+//   header : "FCSN", uint32 version, int64 saved at (seconds since epoch),
+//            uint32 face count, uint32 FIB entry count, uint32 ST entry count,
+//            uint32 reserved
+//   face   : uint64 FaceId, uint16 remote port, uint8 type length,
+//            uint8 remote IP length, type, remote IP
+//   FIB    : uint32 CD wire length, uint32 next hop count, CD wire,
+//            next hop count * (uint64 FaceId, uint32 cost)
+//   ST     : uint32 CD wire length, uint32 next hop count, CD wire,
+//            next hop count * uint64 FaceId
+class Snapshot final : noncopyable
+{
+public:
+  class Error : public std::runtime_error
+  {
+  public:
+    explicit
+    Error(const string& what)
+      : std::runtime_error(what)
+    {
+    }
+  };
+
+  Snapshot(
+    io_service& ioService,
+    const string& path,
+    uint16_t routerPort,
+    const time_duration& receiveTimeout,
+    FaceManager& faceManager,
+    Fib& fib,
+    St& st
+  );
+
+  // written beside the file then renamed over it, a crash never leaves a torn snapshot
+  void
+  save() const;
+
+  // restores the FIB and ST, the ST only if its entries cannot have expired
+  // since the snapshot was saved, with the lease they can have left.  The FIB
+  // is left alone unless `isFibRestored`, when a FIB file owns it.
+  void
+  load(const time_duration& stExpireTime, bool isFibRestored);
+
+private:
+  class Endpoint
+  {
+  public:
+    string m_type;
+    string m_ip;
+    uint16_t m_port;
+
+    bool operator<(const Endpoint& other) const;
+  };
+
+  using Route = std::pair<Cd, uint32_t>;
+
+  void
+  restore(const uint8_t* data, size_t size, const time_duration& stExpireTime, bool isFibRestored);
+
+  shared_ptr<Face>
+  openUdpFace(const Endpoint& endpoint);
+
+  void
+  connectTcpFace(const Endpoint& endpoint, const vector<Route>& routes);
+
+  void
+  onTcpConnected(shared_ptr<tcp::socket> socket, const Endpoint& endpoint, const vector<Route>& routes,
+                 const boost::system::error_code& error);
+
+private:
+  io_service& m_ioService;
+  string m_path;
+  uint16_t m_routerPort;
+  time_duration m_receiveTimeout;
+  FaceManager& m_faceManager;
+  Fib& m_fib;
+  St& m_st;
+};
+
+} // namespace router
+} // namespace fcopss
+
+#endif // _FCOPSS_ROUTER_SNAPSHOT_HPP_
@@ -0,0 +1,688 @@
+/*
+  st-automaton.cpp
+
+  Copyright (c) 2019 KOZO KEIKAKU ENGINEERING Inc.
+
+  This software is released under the MIT License
+
+  Permission is hereby granted, free of charge, to any person obtaining a copy
+  of this software and associated documentation files (the "Software"), to deal
+  in the Software without restriction, including without limitation the rights
+  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+  copies of the Software, and to permit persons to whom the Software is
+  furnished to do so, subject to the following conditions:
+
+  The above copyright notice and this permission notice shall be included in all
+  copies or substantial portions of the Software.
+
+  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+  SOFTWARE.
+*/
+#include "st-automaton.hpp"
+#include "memory-usage.hpp"
+
+#include <boost/bind.hpp>
+
+#include <fcopss/log.hpp>
+
+#include <algorithm>
+
+namespace fcopss {
+namespace router {
+
+const StAutomaton::StateId StAutomaton::NoState = std::numeric_limits<StAutomaton::StateId>::max();
+const StAutomaton::StateId StAutomaton::AcceptOnly = 0x80000000;
+
+// the lazily built DFA is dropped and rebuilt when it grows beyond these,
+// retired states included
+const size_t StAutomaton::MaxDfaStates = 65536;
+const size_t StAutomaton::MaxDfaTransitions = 1048576;
+
+StAutomaton::NfaState::NfaState()
+  : m_asterisk(NoState), m_refCount(0), m_isAfterGroup(false)
+{
+}
+
+StAutomaton::DfaState::DfaState()
+  : m_isRetired(false)
+{
+}
+
+StAutomaton::StAutomaton(TimerWheel& timerWheel, const time_duration& expireTime)
+  : m_timerWheel(timerWheel), m_expireTime(expireTime), m_dfaTransitions(0)
+{
+  m_start = allocateState();
+}
+
+std::tuple<bool, Cd>
+StAutomaton::add(const Cd& cd, const FaceId& id)
+{
+  boost::posix_time::ptime now = boost::posix_time::microsec_clock::universal_time();
+
+  StEntry& entry = addNextHop(cd, id, m_expireTime);
+
+  // upstream lease is renewed once half of it has passed
+  if (entry.isForwardFresh(m_expireTime / 2, now)) {
+    INFO("ST entry CD=%s already forwarded upstream, suppress", cd.toUri().c_str());
+    return std::make_tuple(false, cd);
+  }
+
+  const StEntry* covering = findCovering(cd, now);
+  if (covering != nullptr) {
+    INFO("ST entry CD=%s covered by CD=%s", cd.toUri().c_str(), covering->m_cd.toUri().c_str());
+    return std::make_tuple(false, covering->m_cd);
+  }
+
+  entry.m_lastForwarded = now;
+  return std::make_tuple(true, cd);
+}
+
+void
+StAutomaton::restore(const Cd& cd, const FaceId& id, const time_duration& lifetime)
+{
+  addNextHop(cd, id, lifetime);
+  INFO("ST entry FaceID=%llu CD=%s restored", id, cd.toUri().c_str());
+}
+
+void
+StAutomaton::remove(const Cd& cd, const FaceId& id)
+{
+  StateId state = findState(cd);
+  if ((state != NoState) && m_nfa[state].m_entry) {
+    StEntry::NextHop nextHop(id);
+    if (m_nfa[state].m_entry->m_nextHops.erase(nextHop) > 0) {
+      unindexFace(id, *m_nfa[state].m_entry);
+      m_changes.record(cd);
+      INFO("ST entry FaceID=%llu CD=%s remoeved", id, cd.toUri().c_str());
+    }
+    if (m_nfa[state].m_entry->m_nextHops.empty()) {
+      removePattern(cd);
+    }
+  }
+}
+
+void
+StAutomaton::remove(const Cd& cd)
+{
+  StateId state = findState(cd);
+  if ((state != NoState) && m_nfa[state].m_entry) {
+    const StEntry& entry = *m_nfa[state].m_entry;
+    for (auto nextHop = entry.m_nextHops.cbegin(); nextHop != entry.m_nextHops.cend(); nextHop++) {
+      unindexFace(nextHop->m_faceId, entry);
+    }
+    removePattern(cd);
+    m_changes.record(cd);
+    INFO("ST entry CD=%s remoeved", cd.toUri().c_str());
+  }
+}
+
+void
+StAutomaton::remove(const FaceId& id)
+{
+  auto face = m_faceIndex.find(id);
+  if (face == m_faceIndex.end()) {
+    return;
+  }
+
+  // remove(cd, id) updates the index as it goes
+  vector<Cd> cds;
+  for (auto entry = face->second.cbegin(); entry != face->second.cend(); entry++) {
+    cds.push_back((*entry)->m_cd);
+  }
+  for (auto cd = cds.cbegin(); cd != cds.cend(); cd++) {
+    remove(*cd, id);
+  }
+}
+
+void
+StAutomaton::clear()
+{
+  m_faceIndex.clear();
+  m_nfa.clear();
+  m_freeStates.clear();
+  m_start = allocateState();
+  invalidateDfa();
+  m_changes.reset();
+  INFO("all ST entry remoeved");
+}
+
+void
+StAutomaton::match(const Cd& cd, FaceIdVector& faceIds) const
+{
+  faceIds.clear();
+
+  m_matchedEntries.clear();
+  matchEntries(cd, m_matchedEntries);
+  for (auto entry = m_matchedEntries.cbegin(); entry != m_matchedEntries.cend(); entry++) {
+    for (auto nextHop = (*entry)->m_nextHops.cbegin(); nextHop != (*entry)->m_nextHops.cend(); nextHop++) {
+      faceIds.push_back(nextHop->m_faceId);
+      DEBUG("Packet CD=%s : ST entry match FaceID=%llu CD=%s",
+            cd.toUri().c_str(), nextHop->m_faceId, (*entry)->m_cd.toUri().c_str());
+    }
+  }
+
+  faceIds.unique();
+
+  if (faceIds.empty()) {
+    DEBUG("Packet CD=%s : ST entry no match", cd.toUri().c_str());
+  }
+}
+
+const ChangeLog&
+StAutomaton::changes() const
+{
+  return m_changes;
+}
+
+size_t
+StAutomaton::size() const
+{
+  size_t count = 0;
+  for (auto state = m_nfa.cbegin(); state != m_nfa.cend(); state++) {
+    if (state->m_entry) {
+      count++;
+    }
+  }
+  return count;
+}
+
+size_t
+StAutomaton::memoryUsage() const
+{
+  size_t bytes = vectorMemoryUsage(m_nfa) + vectorMemoryUsage(m_freeStates) + hashMapMemoryUsage(m_faceIndex);
+  for (auto state = m_nfa.cbegin(); state != m_nfa.cend(); state++) {
+    bytes += hashMapMemoryUsage(state->m_components) + hashMapMemoryUsage(state->m_optionals);
+    if (state->m_entry) {
+      bytes += state->m_entry->memoryUsage();
+    }
+  }
+  for (auto face = m_faceIndex.cbegin(); face != m_faceIndex.cend(); face++) {
+    bytes += treeMemoryUsage(face->second);
+  }
+
+  // the lazily built DFA is a cache, but it is memory all the same
+  bytes += vectorMemoryUsage(m_dfa) + treeMemoryUsage(m_dfaIndex) + vectorMemoryUsage(m_nfaDfaStates);
+  for (auto state = m_dfa.cbegin(); state != m_dfa.cend(); state++) {
+    bytes += vectorMemoryUsage(state->m_nfaStates) + vectorMemoryUsage(state->m_accepts) +
+             hashMapMemoryUsage(state->m_next);
+  }
+  for (auto states = m_nfaDfaStates.cbegin(); states != m_nfaDfaStates.cend(); states++) {
+    bytes += vectorMemoryUsage(*states);
+  }
+  return bytes;
+}
+
+void
+StAutomaton::getFaceIds(const Cd& cd, FaceIdVector& faceIds) const
+{
+  StateId state = findState(cd);
+  if ((state != NoState) && m_nfa[state].m_entry) {
+    m_nfa[state].m_entry->getFaceIds(faceIds);
+  } else {
+    faceIds.clear();
+  }
+}
+
+void
+StAutomaton::forEachEntry(const StEntryVisitor& visit) const
+{
+  FaceIdVector faceIds;
+  for (auto state = m_nfa.cbegin(); state != m_nfa.cend(); state++) {
+    if (state->m_entry) {
+      state->m_entry->getFaceIds(faceIds);
+      visit(state->m_entry->m_cd, faceIds);
+    }
+  }
+}
+
+void
+StAutomaton::dump(vector<string>& lines) const
+{
+  lines.clear();
+  for (auto state = m_nfa.cbegin(); state != m_nfa.cend(); state++) {
+    if (state->m_entry) {
+      lines.push_back(state->m_entry->toString());
+    }
+  }
+}
+
+void
+StAutomaton::matchEntries(const Cd& cd, vector<const StEntry*>& entries) const
+{
+  if ((m_dfa.size() > MaxDfaStates) || (m_dfaTransitions > MaxDfaTransitions)) {
+    DEBUG("DFA states=%lu transitions=%lu : rebuild", m_dfa.size(), m_dfaTransitions);
+    invalidateDfa();
+  }
+
+  StateId dfaState = dfaStart();
+  size_t pos = 0;
+  while (true) {
+    const DfaState& current = m_dfa[dfaState];
+    for (auto accept = current.m_accepts.cbegin(); accept != current.m_accepts.cend(); accept++) {
+      entries.push_back(m_nfa[*accept].m_entry.get());
+    }
+    if ((pos >= cd.size()) || current.m_nfaStates.empty()) {
+      break;
+    }
+    dfaState = dfaNext(dfaState, keyOf(cd.elements()[pos]));
+    pos++;
+  }
+}
+
+const StEntry*
+StAutomaton::findCovering(const Cd& cd, const boost::posix_time::ptime& now) const
+{
+  size_t leading = 0;
+  while ((leading < cd.size()) && (cd.elements()[leading].type() == tlv::CdComponent)) {
+    leading++;
+  }
+
+  vector<const StEntry*> entries;
+  if (leading == cd.size()) {
+    // plain CD : covered by any entry matching it
+    matchEntries(cd, entries);
+  } else {
+    // otherwise by a plain entry on its leading components
+    StateId state = m_start;
+    for (size_t i = 0; (i < leading) && (state != NoState); i++) {
+      auto component = m_nfa[state].m_components.find(keyOf(cd.elements()[i]));
+      state = (component != m_nfa[state].m_components.end()) ? component->second : NoState;
+      if ((state != NoState) && m_nfa[state].m_entry) {
+        entries.push_back(m_nfa[state].m_entry.get());
+      }
+    }
+  }
+
+  for (auto entry = entries.cbegin(); entry != entries.cend(); entry++) {
+    if (((*entry)->m_cd != cd) && (*entry)->isForwardFresh(m_expireTime / 2, now)) {
+      return *entry;
+    }
+  }
+  return nullptr;
+}
+
+string
+StAutomaton::keyOf(const Block& component)
+{
+  return string(reinterpret_cast<const char*>(component.value()), component.value_size());
+}
+
+StAutomaton::StateId
+StAutomaton::allocateState()
+{
+  if (!m_freeStates.empty()) {
+    StateId state = m_freeStates.back();
+    m_freeStates.pop_back();
+    return state;
+  }
+  m_nfa.emplace_back();
+  return StateId(m_nfa.size() - 1);
+}
+
+void
+StAutomaton::releaseState(StateId state)
+{
+  m_nfa[state] = NfaState();
+  m_freeStates.push_back(state);
+}
+
+StAutomaton::StateId
+StAutomaton::findState(const Cd& cd) const
+{
+  StateId state = m_start;
+
+  for (auto it = cd.elements().cbegin(); it != cd.elements().cend(); it++) {
+    const NfaState& current = m_nfa[state];
+    if (it->type() == tlv::CdAsterisk) {
+      state = current.m_asterisk;
+    } else {
+      const auto& edges = (it->type() == tlv::CdOptional) ? current.m_optionals : current.m_components;
+      auto edge = edges.find(keyOf(*it));
+      state = (edge != edges.end()) ? edge->second : NoState;
+    }
+    if (state == NoState) {
+      break;
+    }
+  }
+
+  return state;
+}
+
+StAutomaton::StateId
+StAutomaton::addPattern(const Cd& cd, vector<StateId>& path)
+{
+  StateId state = m_start;
+  path.clear();
+  path.push_back(state);
+
+  for (auto it = cd.elements().cbegin(); it != cd.elements().cend(); it++) {
+    StateId next;
+    if (it->type() == tlv::CdAsterisk) {
+      next = m_nfa[state].m_asterisk;
+    } else {
+      const auto& edges = (it->type() == tlv::CdOptional) ? m_nfa[state].m_optionals : m_nfa[state].m_components;
+      auto edge = edges.find(keyOf(*it));
+      next = (edge != edges.end()) ? edge->second : NoState;
+    }
+
+    if (next == NoState) {
+      // m_nfa may be reallocated here, so take references only afterwards
+      next = allocateState();
+      if (it->type() == tlv::CdAsterisk) {
+        m_nfa[state].m_asterisk = next;
+        m_nfa[next].m_isAfterGroup = true;
+      } else if (it->type() == tlv::CdOptional) {
+        m_nfa[state].m_optionals[keyOf(*it)] = next;
+      } else {
+        m_nfa[state].m_components[keyOf(*it)] = next;
+      }
+    }
+
+    state = next;
+    m_nfa[state].m_refCount++;
+    path.push_back(state);
+  }
+
+  return state;
+}
+
+void
+StAutomaton::removePattern(const Cd& cd)
+{
+  vector<StateId> path;
+  path.push_back(m_start);
+
+  for (auto it = cd.elements().cbegin(); it != cd.elements().cend(); it++) {
+    const NfaState& current = m_nfa[path.back()];
+    if (it->type() == tlv::CdAsterisk) {
+      path.push_back(current.m_asterisk);
+    } else {
+      const auto& edges = (it->type() == tlv::CdOptional) ? current.m_optionals : current.m_components;
+      path.push_back(edges.at(keyOf(*it)));
+    }
+  }
+
+  m_nfa[path.back()].m_entry.reset();
+
+  // path[i + 1] is reached from path[i] by cd.elements()[i]
+  vector<StateId> released;
+  for (size_t i = cd.size(); i > 0; i--) {
+    NfaState& state = m_nfa[path[i]];
+    state.m_refCount--;
+    if (state.m_refCount == 0) {
+      NfaState& parent = m_nfa[path[i - 1]];
+      const Block& component = cd.elements()[i - 1];
+      if (component.type() == tlv::CdAsterisk) {
+        parent.m_asterisk = NoState;
+      } else if (component.type() == tlv::CdOptional) {
+        parent.m_optionals.erase(keyOf(component));
+      } else {
+        parent.m_components.erase(keyOf(component));
+      }
+      releaseState(path[i]);
+      released.push_back(path[i]);
+    }
+  }
+
+  invalidateDfa(path, released);
+}
+
+void
+StAutomaton::addClosure(StateId state, vector<StateId>& states) const
+{
+  // the asterisk closes the optional group without consuming input
+  while (state != NoState) {
+    states.push_back(state);
+    state = m_nfa[state].m_asterisk;
+  }
+}
+
+void
+StAutomaton::step(StateId state, const string& key, vector<StateId>& states) const
+{
+  const NfaState& current = m_nfa[state];
+
+  // asterisk : proceed entry, which needs a component left
+  if (current.m_isAfterGroup && current.m_entry) {
+    states.push_back(state | AcceptOnly);
+  }
+
+  // normal component : proceed both on equal value
+  auto component = current.m_components.find(key);
+  if (component != current.m_components.end()) {
+    addClosure(component->second, states);
+  }
+
+  // optional component : proceed both on equal value,
+  // otherwise proceed entry until normal component and retry there
+  for (auto optional = current.m_optionals.cbegin(); optional != current.m_optionals.cend(); optional++) {
+    if (optional->first == key) {
+      addClosure(optional->second, states);
+    } else {
+      skipOptional(optional->second, key, states);
+    }
+  }
+}
+
+void
+StAutomaton::skipOptional(StateId state, const string& key, vector<StateId>& states) const
+{
+  const NfaState& current = m_nfa[state];
+
+  for (auto optional = current.m_optionals.cbegin(); optional != current.m_optionals.cend(); optional++) {
+    skipOptional(optional->second, key, states);
+  }
+
+  if (current.m_asterisk != NoState) {
+    const NfaState& afterGroup = m_nfa[current.m_asterisk];
+    // an entry ending with the group matches, as in StImpl::matchRegex(),
+    // but it must not go on to the next components
+    if (afterGroup.m_entry) {
+      states.push_back(current.m_asterisk | AcceptOnly);
+    }
+    auto component = afterGroup.m_components.find(key);
+    if (component != afterGroup.m_components.end()) {
+      addClosure(component->second, states);
+    }
+  }
+}
+
+StAutomaton::StateId
+StAutomaton::dfaStart() const
+{
+  if (!m_dfa.empty() && m_dfa[0].m_isRetired) {
+    invalidateDfa();
+  }
+  if (m_dfa.empty()) {
+    vector<StateId> states;
+    addClosure(m_start, states);
+    internDfa(states);
+  }
+  return 0;
+}
+
+StAutomaton::StateId
+StAutomaton::dfaNext(StateId dfaState, const string& key) const
+{
+  auto cached = m_dfa[dfaState].m_next.find(key);
+  if ((cached != m_dfa[dfaState].m_next.end()) && !m_dfa[cached->second].m_isRetired) {
+    return cached->second;
+  }
+
+  vector<StateId> states;
+  const vector<StateId>& current = m_dfa[dfaState].m_nfaStates;
+  for (auto state = current.cbegin(); state != current.cend(); state++) {
+    step(*state, key, states);
+  }
+
+  // m_dfa may be reallocated by internDfa
+  StateId next = internDfa(states);
+  auto inserted = m_dfa[dfaState].m_next.emplace(key, next);
+  if (inserted.second) {
+    m_dfaTransitions++;
+  } else {
+    inserted.first->second = next;
+  }
+
+  return next;
+}
+
+StAutomaton::StateId
+StAutomaton::internDfa(vector<StateId>& states) const
+{
+  std::sort(states.begin(), states.end());
+  states.erase(std::unique(states.begin(), states.end()), states.end());
+
+  auto it = m_dfaIndex.find(states);
+  if (it != m_dfaIndex.end()) {
+    return it->second;
+  }
+
+  StateId id = StateId(m_dfa.size());
+  m_dfa.emplace_back();
+  DfaState& dfaState = m_dfa.back();
+  dfaState.m_indexed = m_dfaIndex.emplace(states, id).first;
+  for (auto state = states.cbegin(); state != states.cend(); state++) {
+    StateId nfaState = *state & ~AcceptOnly;
+    if (nfaState == *state) {
+      dfaState.m_nfaStates.push_back(nfaState);
+    }
+    if (nfaState >= m_nfaDfaStates.size()) {
+      m_nfaDfaStates.resize(m_nfa.size());
+    }
+    m_nfaDfaStates[nfaState].push_back(id);
+  }
+  setAccepts(dfaState);
+
+  return id;
+}
+
+void
+StAutomaton::setAccepts(DfaState& dfaState) const
+{
+  dfaState.m_accepts.clear();
+  const vector<StateId>& states = dfaState.m_indexed->first;
+  for (auto state = states.cbegin(); state != states.cend(); state++) {
+    StateId nfaState = *state & ~AcceptOnly;
+    bool isAcceptOnly = (nfaState != *state);
+    if (m_nfa[nfaState].m_entry && (isAcceptOnly || !m_nfa[nfaState].m_isAfterGroup)) {
+      dfaState.m_accepts.push_back(nfaState);
+    }
+  }
+}
+
+void
+StAutomaton::invalidateDfa() const
+{
+  m_dfa.clear();
+  m_dfaIndex.clear();
+  m_nfaDfaStates.clear();
+  m_dfaTransitions = 0;
+}
+
+void
+StAutomaton::invalidateDfa(const vector<StateId>& path, const vector<StateId>& released) const
+{
+  // a released NFA state may come back for another pattern, so the DFA states
+  // holding it are retired, dfaNext() recomputes the transitions into them
+  for (auto state = released.cbegin(); state != released.cend(); state++) {
+    if (*state >= m_nfaDfaStates.size()) {
+      continue;
+    }
+    for (auto id = m_nfaDfaStates[*state].cbegin(); id != m_nfaDfaStates[*state].cend(); id++) {
+      DfaState& dfaState = m_dfa[*id];
+      if (dfaState.m_isRetired) {
+        continue;
+      }
+      m_dfaTransitions -= dfaState.m_next.size();
+      dfaState.m_next.clear();
+      dfaState.m_nfaStates.clear();
+      dfaState.m_accepts.clear();
+      m_dfaIndex.erase(dfaState.m_indexed);
+      dfaState.m_isRetired = true;
+    }
+    m_nfaDfaStates[*state].clear();
+  }
+
+  // the NFA is a tree and a transition only reads the NFA states below those
+  // of its DFA state, so a change below the path shows only in the DFA states
+  // holding a state of the path
+  for (auto state = path.cbegin(); state != path.cend(); state++) {
+    if (*state >= m_nfaDfaStates.size()) {
+      continue;
+    }
+    for (auto id = m_nfaDfaStates[*state].cbegin(); id != m_nfaDfaStates[*state].cend(); id++) {
+      DfaState& dfaState = m_dfa[*id];
+      if (dfaState.m_isRetired) {
+        continue;
+      }
+      m_dfaTransitions -= dfaState.m_next.size();
+      dfaState.m_next.clear();
+      setAccepts(dfaState);
+    }
+  }
+}
+
+void
+StAutomaton::unindexFace(const FaceId& id, const StEntry& entry)
+{
+  auto face = m_faceIndex.find(id);
+  if (face != m_faceIndex.end()) {
+    face->second.erase(&entry);
+    if (face->second.empty()) {
+      m_faceIndex.erase(face);
+    }
+  }
+}
+
+StEntry&
+StAutomaton::addNextHop(const Cd& cd, const FaceId& id, const time_duration& lifetime)
+{
+  StateId state = findState(cd);
+  if ((state != NoState) && m_nfa[state].m_entry) {
+    refresh(*m_nfa[state].m_entry, id, lifetime);
+    INFO("ST entry FaceID=%llu CD=%s already exists, update entry", id, cd.toUri().c_str());
+  } else {
+    state = addPattern(cd, m_path);
+    m_nfa[state].m_entry.reset(new StEntry(cd, makeNextHop(cd, id, lifetime)));
+    invalidateDfa(m_path, vector<StateId>());
+    m_changes.record(cd);
+    INFO("ST entry FaceID=%llu CD=%s not exists, create entry", id, cd.toUri().c_str());
+  }
+
+  StEntry& entry = *m_nfa[state].m_entry;
+  m_faceIndex[id].insert(&entry);
+
+  return entry;
+}
+
+StEntry::NextHop
+StAutomaton::makeNextHop(const Cd& cd, const FaceId& id, const time_duration& lifetime)
+{
+  StExpiredCallback callback = boost::bind(&StAutomaton::onExpired, this, cd, id);
+  return StEntry::NextHop(m_timerWheel, lifetime, callback, id);
+}
+
+void
+StAutomaton::refresh(StEntry& entry, const FaceId& id, const time_duration& lifetime)
+{
+  if (!entry.refresh(id, m_timerWheel, lifetime)) {
+    entry.m_nextHops.insert(makeNextHop(entry.m_cd, id, lifetime));
+    m_changes.record(entry.m_cd);
+  }
+}
+
+void
+StAutomaton::onExpired(Cd cd, FaceId id)
+{
+  INFO("ST entry FaceID=%llu CD=%s expired", id, cd.toUri().c_str());
+  remove(cd, id);
+}
+
+} // namespace router
+} // namespace fcopss
@@ -0,0 +1,233 @@
+/*
+  st-automaton.hpp
+
+  Copyright (c) 2019 KOZO KEIKAKU ENGINEERING Inc.
+
+  This software is released under the MIT License
+
+  Permission is hereby granted, free of charge, to any person obtaining a copy
+  of this software and associated documentation files (the "Software"), to deal
+  in the Software without restriction, including without limitation the rights
+  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+  copies of the Software, and to permit persons to whom the Software is
+  furnished to do so, subject to the following conditions:
+
+  The above copyright notice and this permission notice shall be included in all
+  copies or substantial portions of the Software.
+
+  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+  SOFTWARE.
+*/
+#ifndef _FCOPSS_ROUTER_ST_AUTOMATON_HPP_
+#define _FCOPSS_ROUTER_ST_AUTOMATON_HPP_
+
+#include <fcopss/common.hpp>
+
+#include "st.hpp"
+#include "change-log.hpp"
+#include "st-entry.hpp"
+
+#include <map>
+#include <unordered_map>
+
+namespace fcopss {
+namespace router {
+
+// ST compiled into one shared automaton.
+//
+// Every ST entry CD is a small pattern (normal components, one optional group
+// and the asterisk closing it).  All patterns are merged into one NFA which is
+// updated incrementally on add/remove.  The NFA is determinized lazily while
+// matching: each DFA state is a set of NFA states and its transitions are
+// cached per component value, so a publication CD is matched against every
+// subscription in a single pass over its components.  A change to the NFA
+// only drops the cached transitions of the DFA states holding an NFA state on
+// its path.  Matching semantics are those of StImpl::matchRegex.
+class StAutomaton final : public St
+{
+public:
+  StAutomaton(TimerWheel& timerWheel, const time_duration& expireTime);
+
+  virtual std::tuple<bool, Cd>
+  add(const Cd& cd, const FaceId& id) override;
+
+  virtual void
+  restore(const Cd& cd, const FaceId& id, const time_duration& lifetime) override;
+
+  virtual void
+  remove(const Cd& cd, const FaceId& id) override;
+
+  virtual void
+  remove(const Cd& cd) override;
+
+  virtual void
+  remove(const FaceId& id) override;
+
+  virtual void
+  clear() override;
+ 
+  virtual void
+  match(const Cd& cd, FaceIdVector& faceIds) const override;
+
+  virtual const ChangeLog&
+  changes() const override;
+
+  virtual size_t
+  size() const override;
+
+  virtual size_t
+  memoryUsage() const override;
+
+  virtual void
+  getFaceIds(const Cd& cd, FaceIdVector& faceIds) const override;
+
+  virtual void
+  forEachEntry(const StEntryVisitor& visit) const override;
+
+  virtual void
+  dump(vector<string>& lines) const override;
+
+private:
+  using StateId = uint32_t;
+
+  class NfaState
+  {
+  public:
+    NfaState();
+
+  public:
+    std::unordered_map<string, StateId> m_components;
+    std::unordered_map<string, StateId> m_optionals;
+    StateId m_asterisk;
+    unique_ptr<StEntry> m_entry;
+    size_t m_refCount;
+    // reached by an asterisk, its entry only matches with a component left
+    bool m_isAfterGroup;
+  };
+
+  using DfaIndex = std::map<vector<StateId>, StateId>;
+
+  class DfaState
+  {
+  public:
+    DfaState();
+
+  public:
+    // without the AcceptOnly ones
+    vector<StateId> m_nfaStates;
+    vector<StateId> m_accepts;
+    std::unordered_map<string, StateId> m_next;
+    // all the NFA states, AcceptOnly ones included
+    DfaIndex::iterator m_indexed;
+    // held a released NFA state, transitions to it are recomputed
+    bool m_isRetired;
+  };
+
+  void
+  matchEntries(const Cd& cd, vector<const StEntry*>& entries) const;
+
+  const StEntry*
+  findCovering(const Cd& cd, const boost::posix_time::ptime& now) const;
+
+  static string
+  keyOf(const Block& component);
+
+  StateId
+  allocateState();
+
+  void
+  releaseState(StateId state);
+
+  StateId
+  findState(const Cd& cd) const;
+
+  // `path` gets the states from m_start to the returned one
+  StateId
+  addPattern(const Cd& cd, vector<StateId>& path);
+
+  void
+  removePattern(const Cd& cd);
+
+  void
+  addClosure(StateId state, vector<StateId>& states) const;
+
+  void
+  step(StateId state, const string& key, vector<StateId>& states) const;
+
+  void
+  skipOptional(StateId state, const string& key, vector<StateId>& states) const;
+
+  StateId
+  dfaStart() const;
+
+  StateId
+  dfaNext(StateId dfaState, const string& key) const;
+
+  StateId
+  internDfa(vector<StateId>& states) const;
+
+  void
+  setAccepts(DfaState& dfaState) const;
+
+  void
+  invalidateDfa() const;
+
+  // after the edges or entries of the NFA states of `path` changed,
+  // `released` ones included
+  void
+  invalidateDfa(const vector<StateId>& path, const vector<StateId>& released) const;
+
+  void
+  unindexFace(const FaceId& id, const StEntry& entry);
+
+  // the entry of `cd`, created if needed, with next hop `id` expiring after `lifetime`
+  StEntry&
+  addNextHop(const Cd& cd, const FaceId& id, const time_duration& lifetime);
+
+  StEntry::NextHop
+  makeNextHop(const Cd& cd, const FaceId& id, const time_duration& lifetime);
+
+  void
+  refresh(StEntry& entry, const FaceId& id, const time_duration& lifetime);
+
+  void
+  onExpired(Cd cd, FaceId id);
+
+private:
+  static const StateId NoState;
+  // flags an NFA state of a DFA state that only accepts, without consuming
+  // further components
+  static const StateId AcceptOnly;
+  static const size_t MaxDfaStates;
+  static const size_t MaxDfaTransitions;
+
+  TimerWheel& m_timerWheel;
+  time_duration m_expireTime;
+  ChangeLog m_changes;
+
+  vector<NfaState> m_nfa;
+  vector<StateId> m_freeStates;
+  StateId m_start;
+  // FaceId -> entries having it as next hop, so a face is removed in O(its entries)
+  std::unordered_map<FaceId, std::set<const StEntry*>> m_faceIndex;
+  // scratch for match(), reused across packets
+  mutable vector<const StEntry*> m_matchedEntries;
+
+  mutable vector<DfaState> m_dfa;
+  mutable DfaIndex m_dfaIndex;
+  // indexed by NFA state, the DFA states holding it
+  mutable vector<vector<StateId>> m_nfaDfaStates;
+  mutable size_t m_dfaTransitions;
+  // scratch for addNextHop()
+  vector<StateId> m_path;
+};
+
+} // namespace router
+} // namespace fcopss
+
+#endif // _FCOPSS_ROUTER_ST_AUTOMATON_HPP_
@@ -0,0 +1,582 @@
+/*
+  st-compact.cpp
+
+  Copyright (c) 2019 KOZO KEIKAKU ENGINEERING Inc.
+
+  This software is released under the MIT License
+
+  Permission is hereby granted, free of charge, to any person obtaining a copy
+  of this software and associated documentation files (the "Software"), to deal
+  in the Software without restriction, including without limitation the rights
+  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+  copies of the Software, and to permit persons to whom the Software is
+  furnished to do so, subject to the following conditions:
+
+  The above copyright notice and this permission notice shall be included in all
+  copies or substantial portions of the Software.
+
+  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+  SOFTWARE.
+*/
+#include "st-compact.hpp"
+#include "memory-usage.hpp"
+
+#include <fcopss/log.hpp>
+
+#include <boost/date_time.hpp>
+#include <boost/date_time/c_local_time_adjustor.hpp>
+
+#include <limits>
+
+using adjustor = boost::date_time::c_local_adjustor<boost::posix_time::ptime>;
+
+namespace fcopss {
+namespace router {
+
+const StCompact::Slot StCompact::ProbeSlot = std::numeric_limits<Slot>::max();
+const StCompact::Slot StCompact::NoSlot = std::numeric_limits<Slot>::max() - 1;
+const StCompact::Seconds StCompact::Never = std::numeric_limits<Seconds>::max();
+
+// reads a TLV type or length, false if it runs past `end`
+static bool
+readVarNumber(const uint8_t*& p, const uint8_t* end, uint64_t& number)
+{
+  if (p >= end) {
+    return false;
+  }
+
+  uint8_t first = *p++;
+  size_t size = (first < 253) ? 0 : (first == 253) ? 2 : (first == 254) ? 4 : 8;
+  if (size_t(end - p) < size) {
+    return false;
+  }
+
+  number = (size == 0) ? first : 0;
+  for (size_t i = 0; i < size; i++) {
+    number = (number << 8) | *p++;
+  }
+  return true;
+}
+
+// reads one TLV, leaving `p` past it, false at the end of the buffer
+static bool
+readTlv(const uint8_t*& p, const uint8_t* end, uint64_t& type, const uint8_t*& value, size_t& size)
+{
+  uint64_t length;
+  if (!readVarNumber(p, end, type) || !readVarNumber(p, end, length) || (uint64_t(end - p) < length)) {
+    return false;
+  }
+  value = p;
+  size = length;
+  p += length;
+  return true;
+}
+
+StCompact::SlotHash::SlotHash(const StCompact& st)
+  : m_st(&st)
+{
+}
+
+size_t
+StCompact::SlotHash::operator()(Slot slot) const
+{
+  const uint8_t* bytes;
+  size_t size;
+  m_st->bytesOf(slot, bytes, size);
+
+  // FNV-1a
+  uint64_t hash = 14695981039346656037ULL;
+  for (size_t i = 0; i < size; i++) {
+    hash = (hash ^ bytes[i]) * 1099511628211ULL;
+  }
+  return hash;
+}
+
+StCompact::SlotEqual::SlotEqual(const StCompact& st)
+  : m_st(&st)
+{
+}
+
+bool
+StCompact::SlotEqual::operator()(Slot lhs, Slot rhs) const
+{
+  const uint8_t* lhsBytes;
+  size_t lhsSize;
+  const uint8_t* rhsBytes;
+  size_t rhsSize;
+  m_st->bytesOf(lhs, lhsBytes, lhsSize);
+  m_st->bytesOf(rhs, rhsBytes, rhsSize);
+
+  return (lhsSize == rhsSize) && (memcmp(lhsBytes, rhsBytes, lhsSize) == 0);
+}
+
+bool
+StCompact::Expiry::operator>(const Expiry& expiry) const
+{
+  return (m_expireAt > expiry.m_expireAt);
+}
+
+StCompact::StCompact(TimerWheel& timerWheel, const time_duration& expireTime)
+  : m_timerWheel(timerWheel),
+    m_expireTime(expireTime),
+    m_expireSeconds(expireTime.is_special() ? Never : std::max<Seconds>(expireTime.total_seconds(), 1)),
+    m_epoch(boost::posix_time::microsec_clock::universal_time()),
+    m_size(0),
+    m_probe(nullptr),
+    m_probeSize(0),
+    m_index(0, SlotHash(*this), SlotEqual(*this))
+{
+  if (m_expireSeconds != Never) {
+    m_sweepTimer = m_timerWheel.schedule(boost::posix_time::seconds(1), std::bind(&StCompact::onSweep, this));
+  }
+}
+
+std::tuple<bool, Cd>
+StCompact::add(const Cd& cd, const FaceId& id)
+{
+  Seconds current = now();
+
+  Slot slot = addNextHop(cd, id, (m_expireSeconds == Never) ? Never : current + m_expireSeconds);
+  CompactStEntry& entry = m_slots[slot];
+
+  // upstream lease is renewed once half of it has passed
+  Seconds halfLease = (m_expireSeconds == Never) ? Never : m_expireSeconds / 2;
+  if (isForwardFresh(entry, halfLease, current)) {
+    INFO("ST entry CD=%s already forwarded upstream, suppress", cd.toUri().c_str());
+    return std::make_tuple(false, cd);
+  }
+
+  Slot covering = findCovering(cd, halfLease, current);
+  if (covering != NoSlot) {
+    Cd coveringCd = m_slots[covering].decodeCd();
+    INFO("ST entry CD=%s covered by CD=%s", cd.toUri().c_str(), coveringCd.toUri().c_str());
+    return std::make_tuple(false, coveringCd);
+  }
+
+  entry.m_lastForwarded = current;
+  return std::make_tuple(true, cd);
+}
+
+void
+StCompact::restore(const Cd& cd, const FaceId& id, const time_duration& lifetime)
+{
+  Seconds expireAt = Never;
+  if ((m_expireSeconds != Never) && !lifetime.is_special()) {
+    expireAt = now() + std::min<Seconds>(std::max<int64_t>(lifetime.total_seconds(), 1), m_expireSeconds);
+  }
+
+  addNextHop(cd, id, expireAt);
+  INFO("ST entry FaceID=%llu CD=%s restored", id, cd.toUri().c_str());
+}
+
+void
+StCompact::remove(const Cd& cd, const FaceId& id)
+{
+  Slot slot = find(cd.wireEncode());
+  if (slot == NoSlot) {
+    return;
+  }
+
+  size_t i = m_slots[slot].findNextHop(id);
+  if (i < m_slots[slot].nextHopCount()) {
+    removeNextHop(slot, i);
+    INFO("ST entry FaceID=%llu CD=%s remoeved", id, cd.toUri().c_str());
+  }
+}
+
+void
+StCompact::remove(const Cd& cd)
+{
+  Slot slot = find(cd.wireEncode());
+  if (slot != NoSlot) {
+    release(slot);
+    m_changes.record(cd);
+    INFO("ST entry CD=%s remoeved", cd.toUri().c_str());
+  }
+}
+
+void
+StCompact::remove(const FaceId& id)
+{
+  size_t count = 0;
+  for (Slot slot = 0; slot < m_slots.size(); slot++) {
+    if (m_slots[slot].isFree()) {
+      continue;
+    }
+    size_t i = m_slots[slot].findNextHop(id);
+    if (i < m_slots[slot].nextHopCount()) {
+      removeNextHop(slot, i);
+      count++;
+    }
+  }
+
+  if (count > 0) {
+    INFO("ST entries FaceID=%llu remoeved : count=%lu", id, count);
+  }
+}
+
+void
+StCompact::clear()
+{
+  m_index.clear();
+  m_slots.clear();
+  m_freeSlots.clear();
+  m_size = 0;
+  // queued expiries find their slot gone
+  std::priority_queue<Expiry, vector<Expiry>, std::greater<Expiry>>().swap(m_expiries);
+  m_changes.reset();
+  INFO("all ST entry remoeved");
+}
+
+void
+StCompact::match(const Cd& cd, FaceIdVector& faceIds) const
+{
+  faceIds.clear();
+
+  uint64_t signature = StEntry::signatureOf(cd);
+
+  for (Slot slot = 0; slot < m_slots.size(); slot++) {
+    const CompactStEntry& entry = m_slots[slot];
+    if (entry.isFree() || ((entry.m_signature & ~signature) != 0)) {
+      continue;
+    }
+    if (matchWire(entry.cd(), entry.cdSize(), cd)) {
+      for (size_t i = 0; i < entry.nextHopCount(); i++) {
+        faceIds.push_back(entry.nextHopAt(i).m_faceId);
+        DEBUG("Packet CD=%s : ST entry match FaceID=%llu slot=%u",
+              cd.toUri().c_str(), entry.nextHopAt(i).m_faceId, slot);
+      }
+    }
+  }
+
+  faceIds.unique();
+
+  if (faceIds.empty()) {
+    DEBUG("Packet CD=%s : ST entry no match", cd.toUri().c_str());
+  }
+}
+
+const ChangeLog&
+StCompact::changes() const
+{
+  return m_changes;
+}
+
+size_t
+StCompact::size() const
+{
+  return m_size;
+}
+
+size_t
+StCompact::memoryUsage() const
+{
+  size_t bytes = vectorMemoryUsage(m_slots) + vectorMemoryUsage(m_freeSlots) + hashMapMemoryUsage(m_index);
+  // the queue is a vector, its capacity is not visible
+  bytes += m_expiries.size() * sizeof (Expiry);
+  for (auto it = m_slots.cbegin(); it != m_slots.cend(); it++) {
+    bytes += it->heapSize();
+  }
+  return bytes;
+}
+
+void
+StCompact::getFaceIds(const Cd& cd, FaceIdVector& faceIds) const
+{
+  faceIds.clear();
+  Slot slot = find(cd.wireEncode());
+  if (slot == NoSlot) {
+    return;
+  }
+  for (size_t i = 0; i < m_slots[slot].nextHopCount(); i++) {
+    faceIds.push_back(m_slots[slot].nextHopAt(i).m_faceId);
+  }
+}
+
+void
+StCompact::forEachEntry(const StEntryVisitor& visit) const
+{
+  FaceIdVector faceIds;
+  for (auto entry = m_slots.cbegin(); entry != m_slots.cend(); entry++) {
+    if (entry->isFree()) {
+      continue;
+    }
+
+    faceIds.clear();
+    for (size_t i = 0; i < entry->nextHopCount(); i++) {
+      faceIds.push_back(entry->nextHopAt(i).m_faceId);
+    }
+    visit(entry->decodeCd(), faceIds);
+  }
+}
+
+void
+StCompact::dump(vector<string>& lines) const
+{
+  lines.clear();
+  for (auto entry = m_slots.cbegin(); entry != m_slots.cend(); entry++) {
+    if (entry->isFree()) {
+      continue;
+    }
+
+    stringstream ss;
+    auto facet = new boost::posix_time::time_facet("%Y-%m-%d %H:%M:%S");
+    ss.imbue(std::locale(std::cout.getloc(), facet));
+    // stream will delete facet.
+
+    ss << entry->decodeCd() << "=";
+    for (size_t i = 0; i < entry->nextHopCount(); i++) {
+      const CompactStEntry::NextHop& nextHop = entry->nextHopAt(i);
+      ss << "(" << nextHop.m_faceId << ",";
+      if (nextHop.m_expireAt == Never) {
+        ss << "INFINITY";
+      } else {
+        ss << adjustor::utc_to_local(m_epoch + boost::posix_time::seconds(nextHop.m_expireAt));
+      }
+      ss << ")";
+    }
+    lines.push_back(ss.str());
+  }
+}
+
+void
+StCompact::bytesOf(Slot slot, const uint8_t*& bytes, size_t& size) const
+{
+  if (slot == ProbeSlot) {
+    bytes = m_probe;
+    size = m_probeSize;
+    return;
+  }
+
+  // step into the CD TLV, a slot holds a valid encoding
+  const uint8_t* p = m_slots[slot].cd();
+  uint64_t type;
+  readTlv(p, p + m_slots[slot].cdSize(), type, bytes, size);
+}
+
+StCompact::Slot
+StCompact::find(const Block& wire) const
+{
+  return find(wire.value(), wire.value_size());
+}
+
+StCompact::Slot
+StCompact::find(const uint8_t* bytes, size_t size) const
+{
+  m_probe = bytes;
+  m_probeSize = size;
+  auto it = m_index.find(ProbeSlot);
+  m_probe = nullptr;
+
+  return (it == m_index.end()) ? NoSlot : *it;
+}
+
+StCompact::Slot
+StCompact::findCovering(const Cd& cd, Seconds leaseTime, Seconds now) const
+{
+  // the components are encoded one after the other in the CD value, so each
+  // prefix of normal components is a prefix of the value
+  const uint8_t* value = cd.wireEncode().value();
+  size_t prefixSize = 0;
+  for (size_t i = 0; i < cd.size(); i++) {
+    Slot slot = find(value, prefixSize);
+    if ((slot != NoSlot) && isForwardFresh(m_slots[slot], leaseTime, now)) {
+      return slot;
+    }
+
+    const Block& component = cd.elements()[i];
+    if (component.type() != tlv::CdComponent) {
+      break;
+    }
+    prefixSize += component.size();
+  }
+  return NoSlot;
+}
+
+StCompact::Slot
+StCompact::addNextHop(const Cd& cd, const FaceId& id, Seconds expireAt)
+{
+  const Block& wire = cd.wireEncode();
+
+  Slot slot = find(wire);
+  if (slot != NoSlot) {
+    INFO("ST entry FaceID=%llu CD=%s already exists, update entry", id, cd.toUri().c_str());
+  } else {
+    slot = allocate(wire, StEntry::requiredSignatureOf(cd));
+    m_changes.record(cd);
+    INFO("ST entry FaceID=%llu CD=%s not exists, create entry", id, cd.toUri().c_str());
+  }
+
+  CompactStEntry& entry = m_slots[slot];
+  size_t i = entry.findNextHop(id);
+  if (i == entry.nextHopCount()) {
+    CompactStEntry::NextHop nextHop;
+    nextHop.m_faceId = id;
+    nextHop.m_expireAt = expireAt;
+    nextHop.m_queuedAt = Never;
+    entry.addNextHop(nextHop);
+    queueExpiry(slot, entry.nextHopAt(i));
+    m_changes.record(cd);
+  } else {
+    // the queued expiry finds the later time and is queued again
+    entry.nextHopAt(i).m_expireAt = expireAt;
+  }
+
+  return slot;
+}
+
+StCompact::Slot
+StCompact::allocate(const Block& wire, uint64_t signature)
+{
+  Slot slot;
+  if (!m_freeSlots.empty()) {
+    slot = m_freeSlots.back();
+    m_freeSlots.pop_back();
+  } else {
+    slot = m_slots.size();
+    m_slots.emplace_back();
+  }
+
+  m_slots[slot].assign(wire, signature);
+  m_index.insert(slot);
+  m_size++;
+  return slot;
+}
+
+void
+StCompact::release(Slot slot)
+{
+  // hashed on its bytes, unindex before clearing them
+  m_index.erase(slot);
+  m_slots[slot].clear();
+  m_freeSlots.push_back(slot);
+  m_size--;
+}
+
+void
+StCompact::removeNextHop(Slot slot, size_t i)
+{
+  m_changes.record(m_slots[slot].decodeCd());
+  m_slots[slot].removeNextHopAt(i);
+  if (m_slots[slot].nextHopCount() == 0) {
+    release(slot);
+  }
+}
+
+StCompact::Seconds
+StCompact::now() const
+{
+  boost::posix_time::ptime current = boost::posix_time::microsec_clock::universal_time();
+  // 0 is kept for never
+  return (current - m_epoch).total_seconds() + 1;
+}
+
+bool
+StCompact::isForwardFresh(const CompactStEntry& entry, Seconds leaseTime, Seconds now) const
+{
+  if (entry.m_lastForwarded == 0) {
+    return false;
+  }
+  return (leaseTime == Never) || (now < entry.m_lastForwarded + leaseTime);
+}
+
+bool
+StCompact::matchWire(const uint8_t* entry, size_t entrySize, const Cd& cd)
+{
+  const uint8_t* end = entry + entrySize;
+  uint64_t type;
+  const uint8_t* value;
+  size_t size;
+
+  // step into the CD TLV
+  if (!readTlv(entry, end, type, value, size)) {
+    return false;
+  }
+  const uint8_t* p = value;
+  end = value + size;
+
+  Block::element_const_iterator inputIt = cd.elements().cbegin();
+  bool hasEntry = readTlv(p, end, type, value, size);
+
+  // same walk as StImpl::matchRegex, over the wire bytes
+  while (true) {
+    if (!hasEntry) {
+      return true;
+    }
+    if (inputIt == cd.elements().cend()) {
+      return false;
+    }
+
+    if (type == tlv::CdAsterisk) {
+      hasEntry = readTlv(p, end, type, value, size);
+    } else if ((size == inputIt->value_size()) && ((size == 0) || (memcmp(value, inputIt->value(), size) == 0))) {
+      hasEntry = readTlv(p, end, type, value, size);
+      inputIt++;
+    } else if (type == tlv::CdOptional) {
+      do {
+        hasEntry = readTlv(p, end, type, value, size);
+      } while (hasEntry && (type != tlv::CdComponent));
+    } else {
+      return false;
+    }
+  }
+}
+
+void
+StCompact::queueExpiry(Slot slot, CompactStEntry::NextHop& nextHop)
+{
+  if (nextHop.m_expireAt == Never) {
+    return;
+  }
+
+  Expiry expiry;
+  expiry.m_faceId = nextHop.m_faceId;
+  expiry.m_slot = slot;
+  expiry.m_expireAt = nextHop.m_expireAt;
+  m_expiries.push(expiry);
+  nextHop.m_queuedAt = nextHop.m_expireAt;
+}
+
+void
+StCompact::onSweep()
+{
+  Seconds current = now();
+
+  size_t count = 0;
+  while (!m_expiries.empty() && (m_expiries.top().m_expireAt <= current)) {
+    Expiry expiry = m_expiries.top();
+    m_expiries.pop();
+
+    // the slot may have been freed, reused or cleared since
+    if ((expiry.m_slot >= m_slots.size()) || m_slots[expiry.m_slot].isFree()) {
+      continue;
+    }
+    CompactStEntry& entry = m_slots[expiry.m_slot];
+    size_t i = entry.findNextHop(expiry.m_faceId);
+    if ((i == entry.nextHopCount()) || (entry.nextHopAt(i).m_queuedAt != expiry.m_expireAt)) {
+      continue;
+    }
+
+    if (entry.nextHopAt(i).m_expireAt > current) {
+      // refreshed since it was queued
+      queueExpiry(expiry.m_slot, entry.nextHopAt(i));
+    } else {
+      removeNextHop(expiry.m_slot, i);
+      count++;
+    }
+  }
+
+  if (count > 0) {
+    INFO("ST next hops expired : count=%lu, entries=%lu", count, m_size);
+  }
+
+  m_timerWheel.reschedule(*m_sweepTimer, boost::posix_time::seconds(1));
+}
+
+} // namespace router
+} // namespace fcopss
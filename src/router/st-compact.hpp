@@ -0,0 +1,212 @@
+/*
+  st-compact.hpp
+
+  Copyright (c) 2019 KOZO KEIKAKU ENGINEERING Inc.
+
+  This software is released under the MIT License
+
+  Permission is hereby granted, free of charge, to any person obtaining a copy
+  of this software and associated documentation files (the "Software"), to deal
+  in the Software without restriction, including without limitation the rights
+  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+  copies of the Software, and to permit persons to whom the Software is
+  furnished to do so, subject to the following conditions:
+
+  The above copyright notice and this permission notice shall be included in all
+  copies or substantial portions of the Software.
+
+  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+  SOFTWARE.
+*/
+#ifndef _FCOPSS_ROUTER_ST_COMPACT_HPP_
+#define _FCOPSS_ROUTER_ST_COMPACT_HPP_
+
+#include <fcopss/common.hpp>
+
+#include "st.hpp"
+#include "change-log.hpp"
+#include "st-entry.hpp"
+#include "compact-st-entry.hpp"
+
+#include <functional>
+#include <queue>
+#include <unordered_set>
+
+namespace fcopss {
+namespace router {
+
+// ST keeping each subscription in a fixed size CompactStEntry slot.
+//
+// Slots are indexed by a hash set of slot numbers hashed on the CD TLV value,
+// the encoded components, so the key of a prefix is a prefix of the key and a
+// covering entry is found by probing each plain prefix of a new CD.  Next hop
+// expiry is one timestamp per next hop swept once a second from a single
+// queue, and no index of faces is kept, so removing a face scans the slots.
+// Matching walks the CD bytes of each slot directly.  forEachEntry() and dump()
+// decode one slot at a time and are meant for the control plane.  Matching
+// semantics are those of StImpl::matchRegex.
+class StCompact final : public St
+{
+public:
+  StCompact(TimerWheel& timerWheel, const time_duration& expireTime);
+
+  virtual std::tuple<bool, Cd>
+  add(const Cd& cd, const FaceId& id) override;
+
+  virtual void
+  restore(const Cd& cd, const FaceId& id, const time_duration& lifetime) override;
+
+  virtual void
+  remove(const Cd& cd, const FaceId& id) override;
+
+  virtual void
+  remove(const Cd& cd) override;
+
+  virtual void
+  remove(const FaceId& id) override;
+
+  virtual void
+  clear() override;
+
+  virtual void
+  match(const Cd& cd, FaceIdVector& faceIds) const override;
+
+  virtual const ChangeLog&
+  changes() const override;
+
+  virtual size_t
+  size() const override;
+
+  virtual size_t
+  memoryUsage() const override;
+
+  virtual void
+  getFaceIds(const Cd& cd, FaceIdVector& faceIds) const override;
+
+  virtual void
+  forEachEntry(const StEntryVisitor& visit) const override;
+
+  virtual void
+  dump(vector<string>& lines) const override;
+
+private:
+  using Seconds = CompactStEntry::Seconds;
+  using Slot = uint32_t;
+
+  // slot standing for the m_probe bytes in m_index lookups
+  static const Slot ProbeSlot;
+  static const Slot NoSlot;
+  static const Seconds Never;
+
+  class SlotHash
+  {
+  public:
+    explicit
+    SlotHash(const StCompact& st);
+
+    size_t
+    operator()(Slot slot) const;
+
+  private:
+    const StCompact* m_st;
+  };
+
+  class SlotEqual
+  {
+  public:
+    explicit
+    SlotEqual(const StCompact& st);
+
+    bool
+    operator()(Slot lhs, Slot rhs) const;
+
+  private:
+    const StCompact* m_st;
+  };
+
+  class Expiry
+  {
+  public:
+    bool
+    operator>(const Expiry& expiry) const;
+
+  public:
+    FaceId m_faceId;
+    Slot m_slot;
+    Seconds m_expireAt;
+  };
+
+private:
+  // the components of the CD of `slot`, the key of m_index
+  void
+  bytesOf(Slot slot, const uint8_t*& bytes, size_t& size) const;
+
+  Slot
+  find(const Block& wire) const;
+
+  // slot whose CD has the components `bytes`
+  Slot
+  find(const uint8_t* bytes, size_t size) const;
+
+  // slot forwarded upstream less than `leaseTime` ago whose CD is a plain prefix of `cd`
+  Slot
+  findCovering(const Cd& cd, Seconds leaseTime, Seconds now) const;
+
+  // slot of `cd`, created if needed, with next hop `id` expiring at `expireAt`
+  Slot
+  addNextHop(const Cd& cd, const FaceId& id, Seconds expireAt);
+
+  Slot
+  allocate(const Block& wire, uint64_t signature);
+
+  void
+  release(Slot slot);
+
+  // records the change, the slot is released with its last next hop
+  void
+  removeNextHop(Slot slot, size_t i);
+
+  Seconds
+  now() const;
+
+  bool
+  isForwardFresh(const CompactStEntry& entry, Seconds leaseTime, Seconds now) const;
+
+  static bool
+  matchWire(const uint8_t* entry, size_t entrySize, const Cd& cd);
+
+  void
+  queueExpiry(Slot slot, CompactStEntry::NextHop& nextHop);
+
+  void
+  onSweep();
+
+private:
+  TimerWheel& m_timerWheel;
+  time_duration m_expireTime;
+  // m_expireTime in seconds, Never if infinite
+  Seconds m_expireSeconds;
+  boost::posix_time::ptime m_epoch;
+  ChangeLog m_changes;
+
+  vector<CompactStEntry> m_slots;
+  vector<Slot> m_freeSlots;
+  size_t m_size;
+  // components of a lookup, hashed and compared as ProbeSlot
+  mutable const uint8_t* m_probe;
+  mutable size_t m_probeSize;
+  std::unordered_set<Slot, SlotHash, SlotEqual> m_index;
+
+  std::priority_queue<Expiry, vector<Expiry>, std::greater<Expiry>> m_expiries;
+  shared_ptr<TimerWheel::Timer> m_sweepTimer;
+};
+
+} // namespace router
+} // namespace fcopss
+
+#endif // _FCOPSS_ROUTER_ST_COMPACT_HPP_
@@ -28,8 +28,6 @@
 #include <boost/date_time.hpp>
 #include <boost/date_time/c_local_time_adjustor.hpp>
 
-namespace placeholders = boost::asio::placeholders;
-
 using adjustor = boost::date_time::c_local_adjustor<boost::posix_time::ptime>;
 
 namespace fcopss {
@@ -45,12 +43,10 @@ StEntry::NextHop::NextHop(const FaceId& id)
 {
 }
 
-StEntry::NextHop::NextHop(io_service& ioService, const time_duration& expireTime, const StExpiredCallback& onStExipred, const FaceId& id)
+StEntry::NextHop::NextHop(TimerWheel& timerWheel, const time_duration& expireTime, const StExpiredCallback& onStExipred, const FaceId& id)
   : m_faceId(id)
 {
-  m_expireTimer = std::make_shared<deadline_timer>(ioService);
-  m_expireTimer->expires_from_now(expireTime);
-  m_expireTimer->async_wait(boost::bind(onStExipred, placeholders::error));
+  m_expireTimer = timerWheel.schedule(expireTime, onStExipred);
 }
 
 bool
@@ -87,10 +83,10 @@ StEntry::NextHop::toString() const
   // stream will delete facet.
   
   ss << "(" << m_faceId << ",";
-  if (m_expireTimer->expires_at().is_special()) {
+  if (m_expireTimer->expiresAt().is_special()) {
     ss << "INFINITY";
   } else {
-    boost::posix_time::ptime expire = adjustor::utc_to_local(m_expireTimer->expires_at());
+    boost::posix_time::ptime expire = adjustor::utc_to_local(m_expireTimer->expiresAt());
     ss << expire;
   }
   ss  << ")";
@@ -100,11 +96,12 @@ StEntry::NextHop::toString() const
 
 
 StEntry::StEntry()
+  : m_signature(0)
 {
 }
 
 StEntry::StEntry(const Cd& cd, const NextHop& nextHop)
-  : m_cd(cd)
+  : m_cd(cd), m_signature(requiredSignatureOf(cd))
 {
   m_nextHops.insert(nextHop);
 }
@@ -122,6 +119,88 @@ StEntry::operator!=(const StEntry& stEntry) const
   return !operator==(stEntry);
 }
 
+bool
+StEntry::refresh(const FaceId& id, TimerWheel& timerWheel, const time_duration& expireTime)
+{
+  auto it = m_nextHops.find(NextHop(id));
+  if ((it == m_nextHops.end()) || !it->m_expireTimer) {
+    return false;
+  }
+
+  timerWheel.reschedule(*it->m_expireTimer, expireTime);
+  return true;
+}
+
+bool
+StEntry::isForwardFresh(const time_duration& leaseTime, const boost::posix_time::ptime& now) const
+{
+  if (m_lastForwarded.is_special()) {
+    return false;
+  }
+  return (now < m_lastForwarded + leaseTime);
+}
+
+uint64_t
+StEntry::signatureOf(const Cd& cd)
+{
+  uint64_t signature = 0;
+  for (auto it = cd.elements().cbegin(); it != cd.elements().cend(); it++) {
+    signature |= signatureBit(*it);
+  }
+  return signature;
+}
+
+uint64_t
+StEntry::requiredSignatureOf(const Cd& cd)
+{
+  // matching compares values only, and a normal component of the entry is
+  // passed only on an equal input value
+  uint64_t signature = 0;
+  for (auto it = cd.elements().cbegin(); it != cd.elements().cend(); it++) {
+    if (it->type() == tlv::CdComponent) {
+      signature |= signatureBit(*it);
+    }
+  }
+  return signature;
+}
+
+uint64_t
+StEntry::signatureBit(const Block& component)
+{
+  // FNV-1a of the value
+  uint64_t hash = 14695981039346656037ULL;
+  for (size_t i = 0; i < component.value_size(); i++) {
+    hash ^= component.value()[i];
+    hash *= 1099511628211ULL;
+  }
+  return uint64_t(1) << (hash & 63);
+}
+
+void
+StEntry::getFaceIds(FaceIdVector& faceIds) const
+{
+  faceIds.clear();
+  for (auto nextHop = m_nextHops.cbegin(); nextHop != m_nextHops.cend(); nextHop++) {
+    faceIds.push_back(nextHop->m_faceId);
+  }
+}
+
+size_t
+StEntry::memoryUsage() const
+{
+  const Block& wire = m_cd.wireEncode();
+
+  // buffer shared by the CD blocks, with its control block
+  size_t bytes = sizeof (StEntry) + wire.size() + sizeof (Buffer) + 2 * sizeof (void*);
+  bytes += m_cd.elements().capacity() * sizeof (Block);
+  // set node, and the timer with its control block
+  bytes += m_nextHops.size() * (sizeof (NextHop) + 4 * sizeof (void*) +
+                                sizeof (TimerWheel::Timer) + 2 * sizeof (void*));
+  bytes += m_componentIds.capacity() * sizeof (ComponentInterner::Id);
+
+  return bytes;
+}
+
 string
 StEntry::toString() const
 {
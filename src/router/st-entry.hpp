@@ -29,16 +29,18 @@
 #include <fcopss/common.hpp>
 
 #include <boost/function.hpp>
-#include <boost/bind.hpp>
 
 #include "face.hpp"
+#include "face-id-vector.hpp"
+#include "component-interner.hpp"
+#include "timer-wheel.hpp"
 
 #include <set>
 
 namespace fcopss {
 namespace router {
 
-using StExpiredCallback = boost::function<void(const boost::system::error_code&)>;
+using StExpiredCallback = boost::function<void()>;
 
 class StEntry
 {
@@ -46,12 +48,12 @@ public:
   class NextHop
   {
   public:
-    shared_ptr<deadline_timer> m_expireTimer;
+    shared_ptr<TimerWheel::Timer> m_expireTimer;
     FaceId m_faceId;
 
     NextHop();
     NextHop(const FaceId& id);
-    NextHop(io_service& ioService, const time_duration& expireTime, const StExpiredCallback& onStExipred, const FaceId& id);
+    NextHop(TimerWheel& timerWheel, const time_duration& expireTime, const StExpiredCallback& onStExipred, const FaceId& id);
     NextHop(const NextHop& nextHop) = default;
     NextHop(NextHop&& nextHop) = default;
     NextHop& operator=(const NextHop& nextHop) = default;
@@ -69,6 +71,10 @@ public:
 
   };
 
+private:
+  static uint64_t
+  signatureBit(const Block& component);
+
 public:
   StEntry();
   StEntry(const Cd& cd, const NextHop& nextHop);
@@ -80,12 +86,41 @@ public:
   bool operator!=(const StEntry& stEntry) const;
 
 public:
+  // re-arms the expiry timer of next hop `id`, returns false if there is no such next hop
+  bool
+  refresh(const FaceId& id, TimerWheel& timerWheel, const time_duration& expireTime);
+
+  // true if this CD was forwarded upstream less than `leaseTime` before `now`
+  bool
+  isForwardFresh(const time_duration& leaseTime, const boost::posix_time::ptime& now) const;
+
+  // one bit per component value, over all components of a packet CD
+  static uint64_t
+  signatureOf(const Cd& cd);
+
+  // one bit per normal component value of an entry CD, every CD it matches
+  // contains all of them, i.e. has (signatureOf(cd) & m_signature) == m_signature
+  static uint64_t
+  requiredSignatureOf(const Cd& cd);
+
+  // the faces of m_nextHops
+  void
+  getFaceIds(FaceIdVector& faceIds) const;
+
+  // estimated bytes taken by this entry, its CD and its next hops
+  size_t
+  memoryUsage() const;
+
   string
   toString() const;
  
 public:
   Cd m_cd;
   std::set<NextHop> m_nextHops;
+  boost::posix_time::ptime m_lastForwarded;
+  uint64_t m_signature;
+  // IDs of the m_cd components in the interner of a table that interns them
+  vector<ComponentInterner::Id> m_componentIds;
 };
 
 } // namespace router
@@ -0,0 +1,435 @@
+/*
+  st-flat.cpp
+
+  Copyright (c) 2019 KOZO KEIKAKU ENGINEERING Inc.
+
+  This software is released under the MIT License
+
+  Permission is hereby granted, free of charge, to any person obtaining a copy
+  of this software and associated documentation files (the "Software"), to deal
+  in the Software without restriction, including without limitation the rights
+  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+  copies of the Software, and to permit persons to whom the Software is
+  furnished to do so, subject to the following conditions:
+
+  The above copyright notice and this permission notice shall be included in all
+  copies or substantial portions of the Software.
+
+  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+  SOFTWARE.
+*/
+#include "st-flat.hpp"
+#include "memory-usage.hpp"
+
+#include <fcopss/log.hpp>
+
+#include <cstring>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define FCOPSS_ST_FLAT_X86
+#endif
+
+namespace fcopss {
+namespace router {
+
+// bytes readable past the last arena value, one AVX2 load
+static const size_t ArenaPadding = 32;
+
+// signature of a dead slot, needing every component a packet may have
+static const uint64_t DeadSignature = ~uint64_t(0);
+
+// dead slots or next hops tolerated beyond the live ones before a rebuild
+static const size_t DeadSlack = 64;
+
+// appends the entries in [first, count) whose required components the packet has
+static void
+filterSignaturesScalar(const uint64_t* signatures, size_t first, size_t count, uint64_t signature,
+                       vector<uint32_t>& candidates)
+{
+  for (size_t i = first; i < count; i++) {
+    if ((signatures[i] & ~signature) == 0) {
+      candidates.push_back(i);
+    }
+  }
+}
+
+#ifdef FCOPSS_ST_FLAT_X86
+__attribute__((target("avx2")))
+static void
+filterSignaturesAvx2(const uint64_t* signatures, size_t count, uint64_t signature, vector<uint32_t>& candidates)
+{
+  const __m256i packet = _mm256_set1_epi64x(signature);
+  const __m256i zero = _mm256_setzero_si256();
+
+  size_t i = 0;
+  for (; i + 4 <= count; i += 4) {
+    __m256i required = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(signatures + i));
+    // bits an entry needs and the packet lacks
+    __m256i missing = _mm256_andnot_si256(packet, required);
+    int mask = _mm256_movemask_pd(_mm256_castsi256_pd(_mm256_cmpeq_epi64(missing, zero)));
+    while (mask != 0) {
+      int lane = __builtin_ctz(mask);
+      candidates.push_back(i + lane);
+      mask &= mask - 1;
+    }
+  }
+  filterSignaturesScalar(signatures, i, count, signature, candidates);
+}
+
+static bool
+hasAvx2()
+{
+  static const bool hasAvx2 = __builtin_cpu_supports("avx2");
+  return hasAvx2;
+}
+#endif
+
+static void
+filterSignatures(const uint64_t* signatures, size_t count, uint64_t signature, vector<uint32_t>& candidates)
+{
+  candidates.clear();
+#ifdef FCOPSS_ST_FLAT_X86
+  if (hasAvx2()) {
+    filterSignaturesAvx2(signatures, count, signature, candidates);
+    return;
+  }
+#endif
+  filterSignaturesScalar(signatures, 0, count, signature, candidates);
+}
+
+// both buffers must be readable ArenaPadding bytes past `length`
+static bool
+isEqualBytes(const uint8_t* lhs, const uint8_t* rhs, size_t length)
+{
+#ifdef FCOPSS_ST_FLAT_X86
+  for (size_t i = 0; i < length; i += 16) {
+    __m128i l = _mm_loadu_si128(reinterpret_cast<const __m128i*>(lhs + i));
+    __m128i r = _mm_loadu_si128(reinterpret_cast<const __m128i*>(rhs + i));
+    unsigned differ = ~_mm_movemask_epi8(_mm_cmpeq_epi8(l, r)) & 0xffff;
+    if (length - i < 16) {
+      // ignore the bytes past the end of the values
+      differ &= (1u << (length - i)) - 1;
+    }
+    if (differ != 0) {
+      return false;
+    }
+  }
+  return true;
+#else
+  return (memcmp(lhs, rhs, length) == 0);
+#endif
+}
+
+void
+StFlat::Components::clear()
+{
+  m_types.clear();
+  m_lengths.clear();
+  m_offsets.clear();
+  m_arena.clear();
+}
+
+void
+StFlat::Components::append(const Cd& cd)
+{
+  for (auto it = cd.elements().cbegin(); it != cd.elements().cend(); it++) {
+    if (it->type() == tlv::CdAsterisk) {
+      m_types.push_back(Asterisk);
+    } else if (it->type() == tlv::CdOptional) {
+      m_types.push_back(Optional);
+    } else {
+      m_types.push_back(Normal);
+    }
+    m_lengths.push_back(it->value_size());
+    m_offsets.push_back(m_arena.size());
+    m_arena.insert(m_arena.end(), it->value(), it->value() + it->value_size());
+  }
+}
+
+void
+StFlat::Components::pad()
+{
+  m_arena.insert(m_arena.end(), ArenaPadding, 0);
+}
+
+void
+StFlat::Components::unpad()
+{
+  m_arena.resize(m_arena.size() - ArenaPadding);
+}
+
+StFlat::StFlat(TimerWheel& timerWheel, const time_duration& expireTime, const StCapacity& capacity)
+  : m_st(timerWheel, expireTime, capacity, &m_changes), m_deadSlots(0), m_deadFaceIds(0)
+{
+  m_components.pad();
+  m_changes.setObserver([this] (const Cd* cd) { onChanged(cd); });
+}
+
+std::tuple<bool, Cd>
+StFlat::add(const Cd& cd, const FaceId& id)
+{
+  return m_st.add(cd, id);
+}
+
+void
+StFlat::restore(const Cd& cd, const FaceId& id, const time_duration& lifetime)
+{
+  m_st.restore(cd, id, lifetime);
+}
+
+void
+StFlat::remove(const Cd& cd, const FaceId& id)
+{
+  m_st.remove(cd, id);
+}
+
+void
+StFlat::remove(const Cd& cd)
+{
+  m_st.remove(cd);
+}
+
+void
+StFlat::remove(const FaceId& id)
+{
+  m_st.remove(id);
+}
+
+void
+StFlat::clear()
+{
+  m_st.clear();
+}
+
+void
+StFlat::match(const Cd& cd, FaceIdVector& faceIds) const
+{
+  faceIds.clear();
+
+  m_input.clear();
+  m_input.append(cd);
+  m_input.pad();
+
+  filterSignatures(m_signatures.data(), m_signatures.size(), StEntry::signatureOf(cd), m_candidates);
+  for (auto entry = m_candidates.cbegin(); entry != m_candidates.cend(); entry++) {
+    if (matchEntry(*entry)) {
+      for (uint32_t i = m_firstFaceIds[*entry]; i < m_firstFaceIds[*entry] + m_faceIdCounts[*entry]; i++) {
+        faceIds.push_back(m_faceIds[i]);
+        DEBUG("Packet CD=%s : ST entry match FaceID=%llu CD=%s",
+              cd.toUri().c_str(), m_faceIds[i], m_entries[*entry]->m_cd.toUri().c_str());
+      }
+    }
+  }
+
+  faceIds.unique();
+
+  if (faceIds.empty()) {
+    DEBUG("Packet CD=%s : ST entry no match", cd.toUri().c_str());
+  }
+}
+
+const ChangeLog&
+StFlat::changes() const
+{
+  return m_st.changes();
+}
+
+size_t
+StFlat::size() const
+{
+  return m_st.size();
+}
+
+size_t
+StFlat::memoryUsage() const
+{
+  size_t bytes = m_st.memoryUsage() +
+                 vectorMemoryUsage(m_signatures) + vectorMemoryUsage(m_firstComponents) +
+                 vectorMemoryUsage(m_componentCounts) + vectorMemoryUsage(m_firstFaceIds) +
+                 vectorMemoryUsage(m_faceIdCounts) + vectorMemoryUsage(m_entries) + vectorMemoryUsage(m_faceIds) +
+                 vectorMemoryUsage(m_components.m_types) + vectorMemoryUsage(m_components.m_lengths) +
+                 vectorMemoryUsage(m_components.m_offsets) + vectorMemoryUsage(m_components.m_arena) +
+                 hashMapMemoryUsage(m_slots);
+  for (auto it = m_slots.cbegin(); it != m_slots.cend(); it++) {
+    bytes += stringMemoryUsage(it->first);
+  }
+  return bytes;
+}
+
+StCapacityCounters
+StFlat::capacityCounters() const
+{
+  return m_st.capacityCounters();
+}
+
+void
+StFlat::getFaceIds(const Cd& cd, FaceIdVector& faceIds) const
+{
+  m_st.getFaceIds(cd, faceIds);
+}
+
+void
+StFlat::forEachEntry(const StEntryVisitor& visit) const
+{
+  m_st.forEachEntry(visit);
+}
+
+void
+StFlat::dump(vector<string>& lines) const
+{
+  m_st.dump(lines);
+}
+
+void
+StFlat::onChanged(const Cd* cd)
+{
+  if (cd == nullptr) {
+    rebuild();
+    return;
+  }
+
+  update(*cd);
+  if ((m_deadSlots > m_slots.size() + DeadSlack) ||
+      (m_deadFaceIds > m_faceIds.size() - m_deadFaceIds + DeadSlack)) {
+    rebuild();
+  }
+}
+
+void
+StFlat::update(const Cd& cd)
+{
+  const StEntry* entry = m_st.findEntry(cd);
+  string key = keyOf(cd);
+  auto it = m_slots.find(key);
+
+  if (it == m_slots.end()) {
+    if (entry != nullptr) {
+      m_slots.emplace(std::move(key), appendSlot(*entry));
+    }
+  } else if (entry != nullptr) {
+    writeFaceIds(it->second, *entry);
+  } else {
+    uint32_t slot = it->second;
+    m_signatures[slot] = DeadSignature;
+    m_deadFaceIds += m_faceIdCounts[slot];
+    m_faceIdCounts[slot] = 0;
+    m_entries[slot] = nullptr;
+    m_slots.erase(it);
+    m_deadSlots++;
+  }
+}
+
+void
+StFlat::rebuild()
+{
+  m_signatures.clear();
+  m_firstComponents.clear();
+  m_componentCounts.clear();
+  m_firstFaceIds.clear();
+  m_faceIdCounts.clear();
+  m_entries.clear();
+  m_components.clear();
+  m_components.pad();
+  m_faceIds.clear();
+  m_slots.clear();
+  m_deadSlots = 0;
+  m_deadFaceIds = 0;
+
+  m_st.forEachEntry([this] (const Cd& cd, const FaceIdVector&) {
+    m_slots.emplace(keyOf(cd), appendSlot(*m_st.findEntry(cd)));
+  });
+
+  DEBUG("flat ST rebuilt : entries=%lu components=%lu arena=%lu",
+        m_entries.size(), m_components.m_types.size(), m_components.m_arena.size());
+}
+
+uint32_t
+StFlat::appendSlot(const StEntry& entry)
+{
+  uint32_t slot = m_signatures.size();
+  m_signatures.push_back(entry.m_signature);
+  m_firstComponents.push_back(m_components.m_types.size());
+  m_componentCounts.push_back(entry.m_cd.size());
+  m_components.unpad();
+  m_components.append(entry.m_cd);
+  m_components.pad();
+  m_entries.push_back(&entry);
+  m_firstFaceIds.push_back(m_faceIds.size());
+  m_faceIdCounts.push_back(0);
+  writeFaceIds(slot, entry);
+  return slot;
+}
+
+void
+StFlat::writeFaceIds(uint32_t slot, const StEntry& entry)
+{
+  size_t count = entry.m_nextHops.size();
+  if (count > m_faceIdCounts[slot]) {
+    // no room in place, the old ids become dead
+    m_deadFaceIds += m_faceIdCounts[slot];
+    m_firstFaceIds[slot] = m_faceIds.size();
+    m_faceIds.resize(m_faceIds.size() + count);
+  } else {
+    m_deadFaceIds += m_faceIdCounts[slot] - count;
+  }
+
+  FaceId* faceIds = m_faceIds.data() + m_firstFaceIds[slot];
+  for (auto nextHop = entry.m_nextHops.cbegin(); nextHop != entry.m_nextHops.cend(); nextHop++) {
+    *faceIds++ = nextHop->m_faceId;
+  }
+  m_faceIdCounts[slot] = count;
+}
+
+string
+StFlat::keyOf(const Cd& cd)
+{
+  const Block& wire = cd.wireEncode();
+  return string(reinterpret_cast<const char*>(wire.wire()), wire.size());
+}
+
+bool
+StFlat::matchEntry(size_t entry) const
+{
+  const uint8_t* types = m_components.m_types.data();
+  const uint32_t* lengths = m_components.m_lengths.data();
+  const uint32_t* offsets = m_components.m_offsets.data();
+  const uint8_t* arena = m_components.m_arena.data();
+
+  size_t e = m_firstComponents[entry];
+  size_t entryEnd = e + m_componentCounts[entry];
+  size_t i = 0;
+  size_t inputEnd = m_input.m_types.size();
+
+  // same walk as StImpl::matchRegex, over the flat arrays
+  while (true) {
+    if (e == entryEnd) {
+      return true;
+    }
+    if (i == inputEnd) {
+      return false;
+    }
+
+    if (types[e] == Asterisk) {
+      e++;
+    } else if ((lengths[e] == m_input.m_lengths[i]) &&
+               isEqualBytes(arena + offsets[e], m_input.m_arena.data() + m_input.m_offsets[i], lengths[e])) {
+      e++;
+      i++;
+    } else if (types[e] == Optional) {
+      do {
+        e++;
+      } while ((e != entryEnd) && (types[e] != Normal));
+    } else {
+      return false;
+    }
+  }
+}
+
+} // namespace router
+} // namespace fcopss
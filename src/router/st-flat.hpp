@@ -0,0 +1,183 @@
+/*
+  st-flat.hpp
+
+  Copyright (c) 2019 KOZO KEIKAKU ENGINEERING Inc.
+
+  This software is released under the MIT License
+
+  Permission is hereby granted, free of charge, to any person obtaining a copy
+  of this software and associated documentation files (the "Software"), to deal
+  in the Software without restriction, including without limitation the rights
+  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+  copies of the Software, and to permit persons to whom the Software is
+  furnished to do so, subject to the following conditions:
+
+  The above copyright notice and this permission notice shall be included in all
+  copies or substantial portions of the Software.
+
+  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+  SOFTWARE.
+*/
+#ifndef _FCOPSS_ROUTER_ST_FLAT_HPP_
+#define _FCOPSS_ROUTER_ST_FLAT_HPP_
+
+#include <fcopss/common.hpp>
+
+#include "st.hpp"
+#include "st-impl.hpp"
+
+#include <unordered_map>
+
+namespace fcopss {
+namespace router {
+
+// ST matched over a flattened, struct-of-arrays copy of its entries.
+//
+// Entries are kept and expired by an StImpl.  For matching, their signatures,
+// component types, lengths and arena offsets are laid out in contiguous arrays
+// and all component values in one byte arena, so a scan touches a few dense
+// arrays instead of one Block and shared buffer per component.  Signatures are
+// prefiltered with AVX2 when the CPU has it and component values compared with
+// SSE2, both with a scalar fallback.  The flat copy follows each change of the
+// StImpl as it is recorded, so matching never waits for it: a new entry is
+// appended, the next hops of a changed one are rewritten in place or appended,
+// and a removed one is left as a dead slot the signature prefilter skips.  The
+// copy is rebuilt once dead slots or next hops outnumber live ones.  Matching
+// semantics are those of StImpl::matchRegex.  Matches are not seen by the
+// StImpl, so EvictLeastRecentlyMatched is not supported.
+class StFlat final : public St
+{
+public:
+  StFlat(TimerWheel& timerWheel, const time_duration& expireTime, const StCapacity& capacity = StCapacity());
+
+  virtual std::tuple<bool, Cd>
+  add(const Cd& cd, const FaceId& id) override;
+
+  virtual void
+  restore(const Cd& cd, const FaceId& id, const time_duration& lifetime) override;
+
+  virtual void
+  remove(const Cd& cd, const FaceId& id) override;
+
+  virtual void
+  remove(const Cd& cd) override;
+
+  virtual void
+  remove(const FaceId& id) override;
+
+  virtual void
+  clear() override;
+
+  virtual void
+  match(const Cd& cd, FaceIdVector& faceIds) const override;
+
+  virtual const ChangeLog&
+  changes() const override;
+
+  virtual size_t
+  size() const override;
+
+  virtual size_t
+  memoryUsage() const override;
+
+  virtual StCapacityCounters
+  capacityCounters() const override;
+
+  virtual void
+  getFaceIds(const Cd& cd, FaceIdVector& faceIds) const override;
+
+  virtual void
+  forEachEntry(const StEntryVisitor& visit) const override;
+
+  virtual void
+  dump(vector<string>& lines) const override;
+
+private:
+  enum ComponentType : uint8_t {
+    Normal,
+    Optional,
+    Asterisk
+  };
+
+  // arrays of one CD's components, the entries' or the packet's
+  class Components
+  {
+  public:
+    void
+    clear();
+
+    void
+    append(const Cd& cd);
+
+    // pads the arena so that SIMD loads may run past the last value
+    void
+    pad();
+
+    // removes the padding before more values are appended
+    void
+    unpad();
+
+  public:
+    vector<uint8_t> m_types;
+    vector<uint32_t> m_lengths;
+    vector<uint32_t> m_offsets;
+    vector<uint8_t> m_arena;
+  };
+
+private:
+  // observer of m_changes
+  void
+  onChanged(const Cd* cd);
+
+  // copies the entry of `cd` into its slot, or kills the slot if it is gone
+  void
+  update(const Cd& cd);
+
+  void
+  rebuild();
+
+  uint32_t
+  appendSlot(const StEntry& entry);
+
+  void
+  writeFaceIds(uint32_t slot, const StEntry& entry);
+
+  static string
+  keyOf(const Cd& cd);
+
+  bool
+  matchEntry(size_t entry) const;
+
+private:
+  ChangeLog m_changes;
+  StImpl m_st;
+
+  // flat copy of m_st, one slot per entry
+  vector<uint64_t> m_signatures;
+  vector<uint32_t> m_firstComponents;
+  vector<uint32_t> m_componentCounts;
+  vector<uint32_t> m_firstFaceIds;
+  vector<uint32_t> m_faceIdCounts;
+  vector<const StEntry*> m_entries;
+  Components m_components;
+  vector<FaceId> m_faceIds;
+  // CD wire encoding -> slot of a live entry
+  std::unordered_map<string, uint32_t> m_slots;
+  // slots of removed entries and ids of m_faceIds no longer used, until rebuild()
+  size_t m_deadSlots;
+  size_t m_deadFaceIds;
+
+  // scratch for match(), reused across packets
+  mutable Components m_input;
+  mutable vector<uint32_t> m_candidates;
+};
+
+} // namespace router
+} // namespace fcopss
+
+#endif // _FCOPSS_ROUTER_ST_FLAT_HPP_
@@ -24,53 +24,87 @@
   SOFTWARE.
 */
 #include "st-impl.hpp"
+#include "memory-usage.hpp"
 
-#include <fcopss/log.hpp>
+#include <boost/bind.hpp>
 
-namespace placeholders = boost::asio::placeholders;
+#include <fcopss/log.hpp>
 
 namespace fcopss {
 namespace router {
 
-StImpl::StImpl(io_service& ioService, const time_duration& expireTime)
-  : m_ioService(ioService), m_expireTime(expireTime)
+// scratch for match() and matchBatch(), reused across packets, one per thread
+// since the shards of an StSharded are matched from several threads at once
+class StImplScratch
+{
+public:
+  vector<ComponentInterner::Id> m_inputIds;
+  vector<uint64_t> m_batchSignatures;
+  vector<vector<ComponentInterner::Id>> m_batchIds;
+  vector<list<StEntry>::const_iterator> m_matched;
+};
+
+static thread_local StImplScratch Scratch;
+
+StImpl::StImpl(TimerWheel& timerWheel, const time_duration& expireTime, const StCapacity& capacity,
+               ChangeLog* changes)
+  : m_timerWheel(timerWheel),
+    m_expireTime(expireTime),
+    m_changes((changes != nullptr) ? *changes : m_ownChanges),
+    m_capacity(capacity)
 {
 }
 
 std::tuple<bool, Cd>
 StImpl::add(const Cd& cd, const FaceId& id)
 {
-  StExpiredCallback callback = boost::bind(&StImpl::onExpired, this, cd, id, placeholders::error);
+  boost::posix_time::ptime now = boost::posix_time::microsec_clock::universal_time();
 
-  bool doForward = true;
+  StEntry* entry = addNextHop(cd, id, m_expireTime);
+  if (entry == nullptr) {
+    return std::make_tuple(false, cd);
+  }
 
-  auto it = std::find_if(m_st.begin(), m_st.end(), [&](StEntry& entry) { return entry.m_cd == cd; });
-  if (it != m_st.end()) {
-    StEntry::NextHop nextHop(m_ioService, m_expireTime, callback, id);
-    it->m_nextHops.erase(nextHop);
-    it->m_nextHops.insert(nextHop);
-    INFO("ST entry FaceID=%llu CD=%s already exists, update entry", id, cd.toUri().c_str());
-  } else {
-    StEntry::NextHop nextHop(m_ioService, m_expireTime, callback, id);
-    StEntry entry(cd, nextHop);
-    m_st.push_back(entry);
-    INFO("ST entry FaceID=%llu CD=%s not exists, create entry", id, cd.toUri().c_str());
+  // upstream lease is renewed once half of it has passed
+  if (entry->isForwardFresh(m_expireTime / 2, now)) {
+    INFO("ST entry CD=%s already forwarded upstream, suppress", cd.toUri().c_str());
+    return std::make_tuple(false, cd);
   }
 
-  return std::make_tuple(doForward, cd);
+  const StEntry* covering = findCovering(cd, now);
+  if (covering != nullptr) {
+    INFO("ST entry CD=%s covered by CD=%s", cd.toUri().c_str(), covering->m_cd.toUri().c_str());
+    return std::make_tuple(false, covering->m_cd);
+  }
+
+  entry->m_lastForwarded = now;
+  return std::make_tuple(true, cd);
+}
+
+void
+StImpl::restore(const Cd& cd, const FaceId& id, const time_duration& lifetime)
+{
+  if (addNextHop(cd, id, lifetime) != nullptr) {
+    INFO("ST entry FaceID=%llu CD=%s restored", id, cd.toUri().c_str());
+  }
 }
 
 void
 StImpl::remove(const Cd& cd, const FaceId& id)
 {
-  auto it = std::find_if(m_st.begin(), m_st.end(), [&](StEntry& entry) { return entry.m_cd == cd; });
+  auto it = find(cd);
   if (it != m_st.end()) {
     StEntry::NextHop nextHop(id);
-    if (it->m_nextHops.erase(nextHop) > 0) {
+    bool isRemoved = (it->m_nextHops.erase(nextHop) > 0);
+    if (isRemoved) {
+      unindexFace(id, *it);
       INFO("ST entry FaceID=%llu CD=%s remoeved", id, cd.toUri().c_str());
     }
     if (it->m_nextHops.empty()) {
-      m_st.erase(it);
+      erase(it);
+    }
+    if (isRemoved) {
+      m_changes.record(cd);
     }
   }
 }
@@ -78,9 +112,13 @@ StImpl::remove(const Cd& cd, const FaceId& id)
 void
 StImpl::remove(const Cd& cd)
 {
-  auto it = std::find_if(m_st.begin(), m_st.end(), [&](StEntry& entry) { return entry.m_cd == cd; });
+  auto it = find(cd);
   if (it != m_st.end()) {
-    m_st.erase(it);
+    for (auto nextHop = it->m_nextHops.cbegin(); nextHop != it->m_nextHops.cend(); nextHop++) {
+      unindexFace(nextHop->m_faceId, *it);
+    }
+    erase(it);
+    m_changes.record(cd);
     INFO("ST entry CD=%s remoeved", cd.toUri().c_str());
   }
 }
@@ -88,48 +126,103 @@ StImpl::remove(const Cd& cd)
 void
 StImpl::remove(const FaceId& id)
 {
-  StEntry::NextHop nextHop(id);
+  auto face = m_faceIndex.find(id);
+  if (face == m_faceIndex.end()) {
+    return;
+  }
 
-  auto it = m_st.begin();
-  while (it != m_st.end()) {
-    if (it->m_nextHops.erase(nextHop) > 0) {
-      INFO("ST entry FaceID=%llu CD=%s remoeved", id, it->m_cd.toUri().c_str());
-    }
-    if (it->m_nextHops.empty()) {
-      it = m_st.erase(it);
-    } else {
-      it++;
-    }
+  // remove(cd, id) updates the index as it goes
+  vector<Cd> cds;
+  for (auto entry = face->second.cbegin(); entry != face->second.cend(); entry++) {
+    cds.push_back((*entry)->m_cd);
+  }
+  for (auto cd = cds.cbegin(); cd != cds.cend(); cd++) {
+    remove(*cd, id);
   }
 }
 
 void
 StImpl::clear()
 {
+  m_faceIndex.clear();
+  m_index.clear();
   m_st.clear();
+  m_interner.clear();
+  m_changes.reset();
   INFO("all ST entry remoeved");
 }
 
-set<FaceId>
-StImpl::match(const Cd& cd) const
+void
+StImpl::match(const Cd& cd, FaceIdVector& faceIds) const
 {
-  set<FaceId> faceIds;
+  faceIds.clear();
+
+  uint64_t signature = StEntry::signatureOf(cd);
+  m_interner.find(cd, Scratch.m_inputIds);
 
   for (auto it = m_st.cbegin(); it != m_st.cend(); it++) {
-    if (matchRegex(it->m_cd, cd)) {
+    // an entry needing a component value the CD does not have cannot match
+    if ((it->m_signature & ~signature) != 0) {
+      continue;
+    }
+    if (matchIds(*it, Scratch.m_inputIds)) {
       for (auto nextHop = it->m_nextHops.cbegin(); nextHop != it->m_nextHops.cend(); nextHop++) {
-        faceIds.insert(nextHop->m_faceId);
-        INFO("Packet CD=%s : ST entry match FaceID=%llu CD=%s",
-             cd.toUri().c_str(), nextHop->m_faceId, it->m_cd.toUri().c_str());
+        faceIds.push_back(nextHop->m_faceId);
+        DEBUG("Packet CD=%s : ST entry match FaceID=%llu CD=%s",
+              cd.toUri().c_str(), nextHop->m_faceId, it->m_cd.toUri().c_str());
       }
+      Scratch.m_matched.push_back(it);
     }
   }
 
-  if (faceIds.size() == 0) {
-    INFO("Packet CD=%s : ST entry no match", cd.toUri().c_str());
+  touchMatched();
+  faceIds.unique();
+
+  if (faceIds.empty()) {
+    DEBUG("Packet CD=%s : ST entry no match", cd.toUri().c_str());
+  }
+}
+
+void
+StImpl::matchBatch(const Cd* const cds[], FaceIdVector* const faceIds[], size_t count) const
+{
+  Scratch.m_batchSignatures.resize(count);
+  if (Scratch.m_batchIds.size() < count) {
+    Scratch.m_batchIds.resize(count);
+  }
+  for (size_t i = 0; i < count; i++) {
+    faceIds[i]->clear();
+    Scratch.m_batchSignatures[i] = StEntry::signatureOf(*cds[i]);
+    m_interner.find(*cds[i], Scratch.m_batchIds[i]);
+  }
+
+  // entry-major, each entry is brought into cache once per batch
+  for (auto it = m_st.cbegin(); it != m_st.cend(); it++) {
+    for (size_t i = 0; i < count; i++) {
+      if ((it->m_signature & ~Scratch.m_batchSignatures[i]) != 0) {
+        continue;
+      }
+      if (matchIds(*it, Scratch.m_batchIds[i])) {
+        for (auto nextHop = it->m_nextHops.cbegin(); nextHop != it->m_nextHops.cend(); nextHop++) {
+          faceIds[i]->push_back(nextHop->m_faceId);
+          DEBUG("Packet CD=%s : ST entry match FaceID=%llu CD=%s",
+                cds[i]->toUri().c_str(), nextHop->m_faceId, it->m_cd.toUri().c_str());
+        }
+        if (Scratch.m_matched.empty() || (Scratch.m_matched.back() != it)) {
+          Scratch.m_matched.push_back(it);
+        }
+      }
+    }
   }
 
-  return faceIds;
+  touchMatched();
+
+  for (size_t i = 0; i < count; i++) {
+    faceIds[i]->unique();
+    if (faceIds[i]->empty()) {
+      DEBUG("Packet CD=%s : ST entry no match", cds[i]->toUri().c_str());
+    }
+  }
 }
 
 bool
@@ -165,7 +258,7 @@ StImpl::matchRegex(const Cd& entryCd, const Cd& inputCd)
       DEBUG("entry type = optional : proceed entry until normal component");
       do {
         entryIt++;
-      } while (entryIt->type() != tlv::CdComponent) ;
+      } while ((entryIt != entryCd.elements().cend()) && (entryIt->type() != tlv::CdComponent));
     } else if (entryIt->type() == tlv::CdComponent) {
       DEBUG("entry type = normal component : stop");
       DEBUG("result = not match (2)");
@@ -174,6 +267,64 @@ StImpl::matchRegex(const Cd& entryCd, const Cd& inputCd)
   }
 }
 
+bool
+StImpl::matchIds(const StEntry& entry, const vector<ComponentInterner::Id>& inputIds)
+{
+  const Block::element_container& components = entry.m_cd.elements();
+  const vector<ComponentInterner::Id>& entryIds = entry.m_componentIds;
+  size_t e = 0;
+  size_t i = 0;
+
+  // same walk as matchRegex(), equal IDs are equal values
+  while (true) {
+    if (e == entryIds.size()) {
+      return true;
+    }
+    if (i == inputIds.size()) {
+      return false;
+    }
+
+    if (components[e].type() == tlv::CdAsterisk) {
+      e++;
+    } else if (entryIds[e] == inputIds[i]) {
+      e++;
+      i++;
+    } else if (components[e].type() == tlv::CdOptional) {
+      do {
+        e++;
+      } while ((e != entryIds.size()) && (components[e].type() != tlv::CdComponent));
+    } else {
+      return false;
+    }
+  }
+}
+
+bool
+StImpl::covers(const Cd& entryCd, const Cd& cd)
+{
+  size_t leading = 0;
+  while ((leading < cd.size()) && (cd.elements()[leading].type() == tlv::CdComponent)) {
+    leading++;
+  }
+
+  // plain CD : publications matching it all start with it
+  if (leading == cd.size()) {
+    return matchRegex(entryCd, cd);
+  }
+
+  // otherwise only a plain prefix of the leading components is known to cover it
+  if (entryCd.size() > leading) {
+    return false;
+  }
+  for (size_t i = 0; i < entryCd.size(); i++) {
+    const Block& component = entryCd.elements()[i];
+    if ((component.type() != tlv::CdComponent) || !isEqualValue(component, cd.elements()[i])) {
+      return false;
+    }
+  }
+  return true;
+}
+
 bool
 StImpl::isEqualValue(const Block& entry, const Block& input)
 {
@@ -218,6 +369,192 @@ StImpl::componentDebugPrint(const Block& entry, const Block& input)
     DEBUG("%s", ss.str().c_str());
 }
 
+string
+StImpl::keyOf(const Cd& cd)
+{
+  // the components one after the other, the key of a prefix is a prefix of the key
+  string key;
+  for (auto it = cd.elements().cbegin(); it != cd.elements().cend(); it++) {
+    key.append(reinterpret_cast<const char*>(it->wire()), it->size());
+  }
+  return key;
+}
+
+const StEntry*
+StImpl::findCovering(const Cd& cd, const boost::posix_time::ptime& now) const
+{
+  // a plain prefix of the leading normal components covers `cd` either way,
+  // looked up in m_index one length at a time
+  string key;
+  for (size_t i = 0; i <= cd.size(); i++) {
+    if (i > 0) {
+      const Block& component = cd.elements()[i - 1];
+      if (component.type() != tlv::CdComponent) {
+        break;
+      }
+      key.append(reinterpret_cast<const char*>(component.wire()), component.size());
+    }
+    if (i == cd.size()) {
+      // the entry of `cd` itself
+      break;
+    }
+
+    auto it = m_index.find(key);
+    // the covering lease must outlast the Sub it stands for like any refreshed entry
+    if ((it != m_index.end()) && it->second->isForwardFresh(m_expireTime / 2, now)) {
+      return &*it->second;
+    }
+  }
+  return nullptr;
+}
+
+const StEntry*
+StImpl::findEntry(const Cd& cd) const
+{
+  auto it = m_index.find(keyOf(cd));
+  return (it != m_index.end()) ? &*it->second : nullptr;
+}
+
+list<StEntry>::iterator
+StImpl::find(const Cd& cd)
+{
+  auto it = m_index.find(keyOf(cd));
+  if (it == m_index.end()) {
+    return m_st.end();
+  }
+  return it->second;
+}
+
+void
+StImpl::erase(list<StEntry>::iterator it)
+{
+  m_interner.release(it->m_componentIds);
+  m_index.erase(keyOf(it->m_cd));
+  m_st.erase(it);
+}
+
+void
+StImpl::unindexFace(const FaceId& id, const StEntry& entry)
+{
+  auto face = m_faceIndex.find(id);
+  if (face != m_faceIndex.end()) {
+    face->second.erase(&entry);
+    if (face->second.empty()) {
+      m_faceIndex.erase(face);
+    }
+  }
+}
+
+bool
+StImpl::admit(const Cd& cd, const FaceId& id, bool isNewEntry)
+{
+  if (m_capacity.m_maxEntriesPerFace > 0) {
+    auto face = m_faceIndex.find(id);
+    if ((face != m_faceIndex.end()) && (face->second.size() >= m_capacity.m_maxEntriesPerFace)) {
+      m_counters.m_rejectedFaceQuota++;
+      INFO("ST entry FaceID=%llu CD=%s rejected : face quota %lu reached",
+           id, cd.toUri().c_str(), m_capacity.m_maxEntriesPerFace);
+      return false;
+    }
+  }
+
+  if (!isNewEntry || (m_capacity.m_maxEntries == 0) || (m_st.size() < m_capacity.m_maxEntries)) {
+    return true;
+  }
+
+  if (m_capacity.m_evictPolicy == StCapacity::EvictNone) {
+    m_counters.m_rejectedFull++;
+    INFO("ST entry FaceID=%llu CD=%s rejected : ST full with %lu entries",
+         id, cd.toUri().c_str(), m_st.size());
+    return false;
+  }
+
+  while (m_st.size() >= m_capacity.m_maxEntries) {
+    evict();
+  }
+  return true;
+}
+
+void
+StImpl::evict()
+{
+  auto it = m_st.begin();
+  INFO("ST entry CD=%s evicted", it->m_cd.toUri().c_str());
+
+  for (auto nextHop = it->m_nextHops.cbegin(); nextHop != it->m_nextHops.cend(); nextHop++) {
+    unindexFace(nextHop->m_faceId, *it);
+  }
+  Cd cd = it->m_cd;
+  erase(it);
+  m_changes.record(cd);
+  m_counters.m_evicted++;
+}
+
+void
+StImpl::touchMatched() const
+{
+  if (m_capacity.m_evictPolicy == StCapacity::EvictLeastRecentlyMatched) {
+    for (auto it = Scratch.m_matched.cbegin(); it != Scratch.m_matched.cend(); it++) {
+      m_st.splice(m_st.end(), m_st, *it);
+    }
+  }
+  Scratch.m_matched.clear();
+}
+
+const ChangeLog&
+StImpl::changes() const
+{
+  return m_changes;
+}
+
+size_t
+StImpl::size() const
+{
+  return m_st.size();
+}
+
+size_t
+StImpl::memoryUsage() const
+{
+  size_t bytes = hashMapMemoryUsage(m_index) + hashMapMemoryUsage(m_faceIndex) + m_interner.memoryUsage();
+  for (auto it = m_st.cbegin(); it != m_st.cend(); it++) {
+    // list node links
+    bytes += it->memoryUsage() + 2 * sizeof (void*);
+    bytes += stringMemoryUsage(keyOf(it->m_cd));
+  }
+  for (auto face = m_faceIndex.cbegin(); face != m_faceIndex.cend(); face++) {
+    bytes += treeMemoryUsage(face->second);
+  }
+  return bytes;
+}
+
+StCapacityCounters
+StImpl::capacityCounters() const
+{
+  return m_counters;
+}
+
+void
+StImpl::getFaceIds(const Cd& cd, FaceIdVector& faceIds) const
+{
+  const StEntry* entry = findEntry(cd);
+  if (entry != nullptr) {
+    entry->getFaceIds(faceIds);
+  } else {
+    faceIds.clear();
+  }
+}
+
+void
+StImpl::forEachEntry(const StEntryVisitor& visit) const
+{
+  FaceIdVector faceIds;
+  for (auto it = m_st.cbegin(); it != m_st.cend(); it++) {
+    it->getFaceIds(faceIds);
+    visit(it->m_cd, faceIds);
+  }
+}
+
 void
 StImpl::dump(vector<string>& lines) const
 {
@@ -227,16 +564,58 @@ StImpl::dump(vector<string>& lines) const
   }
 }
 
-void
-StImpl::onExpired(Cd cd, FaceId id, const boost::system::error_code& error)
+StEntry*
+StImpl::addNextHop(const Cd& cd, const FaceId& id, const time_duration& lifetime)
 {
-  if (!error) {
-    INFO("ST entry FaceID=%llu CD=%s expired", id, cd.toUri().c_str());
-    remove(cd, id);
+  auto it = find(cd);
+  bool isNewEntry = (it == m_st.end());
+  if ((isNewEntry || (it->m_nextHops.count(StEntry::NextHop(id)) == 0)) && !admit(cd, id, isNewEntry)) {
+    return nullptr;
+  }
+
+  if (!isNewEntry) {
+    refresh(*it, id, lifetime);
+    if (m_capacity.m_evictPolicy == StCapacity::EvictOldestLease) {
+      m_st.splice(m_st.end(), m_st, it);
+    }
+    INFO("ST entry FaceID=%llu CD=%s already exists, update entry", id, cd.toUri().c_str());
   } else {
+    StEntry entry(cd, makeNextHop(cd, id, lifetime));
+    m_interner.intern(cd, entry.m_componentIds);
+    m_st.push_back(entry);
+    it = std::prev(m_st.end());
+    m_index.emplace(keyOf(cd), it);
+    m_changes.record(cd);
+    INFO("ST entry FaceID=%llu CD=%s not exists, create entry", id, cd.toUri().c_str());
+  }
+  m_faceIndex[id].insert(&*it);
+
+  return &*it;
+}
+
+StEntry::NextHop
+StImpl::makeNextHop(const Cd& cd, const FaceId& id, const time_duration& lifetime)
+{
+  StExpiredCallback callback = boost::bind(&StImpl::onExpired, this, cd, id);
+  return StEntry::NextHop(m_timerWheel, lifetime, callback, id);
+}
+
+void
+StImpl::refresh(StEntry& entry, const FaceId& id, const time_duration& lifetime)
+{
+  if (!entry.refresh(id, m_timerWheel, lifetime)) {
+    entry.m_nextHops.insert(makeNextHop(entry.m_cd, id, lifetime));
+    m_changes.record(entry.m_cd);
   }
 }
 
+void
+StImpl::onExpired(Cd cd, FaceId id)
+{
+  INFO("ST entry FaceID=%llu CD=%s expired", id, cd.toUri().c_str());
+  remove(cd, id);
+}
+
 } // namespace router
 } // namespace fcopss
 
@@ -29,19 +29,32 @@
 #include <fcopss/common.hpp>
 
 #include "st.hpp"
+#include "change-log.hpp"
 #include "st-entry.hpp"
 
+#include <unordered_map>
+
 namespace fcopss {
 namespace router {
 
+// Entries are kept in a list, ordered for eviction by the StCapacity policy:
+// oldest lease or least recently matched first.  With EvictLeastRecentlyMatched
+// the const match() and matchBatch() move the matched entries to the back of
+// the list (touchMatched()), a write to the table: they must not run
+// concurrently with each other or with any other call.
 class StImpl final : public St
 {
 public:
-  StImpl(io_service& ioSerivce, const time_duration& exprieTime);
+  // changes are recorded to `changes` if given, to a log of this ST otherwise
+  StImpl(TimerWheel& timerWheel, const time_duration& expireTime, const StCapacity& capacity = StCapacity(),
+         ChangeLog* changes = nullptr);
 
   virtual std::tuple<bool, Cd>
   add(const Cd& cd, const FaceId& id) override;
 
+  virtual void
+  restore(const Cd& cd, const FaceId& id, const time_duration& lifetime) override;
+
   virtual void
   remove(const Cd& cd, const FaceId& id) override;
 
@@ -54,18 +67,62 @@ public:
   virtual void
   clear() override;
  
-  virtual set<FaceId>
-  match(const Cd& cd) const override;
+  virtual void
+  match(const Cd& cd, FaceIdVector& faceIds) const override;
+
+  // walks the entry list once for the whole batch
+  virtual void
+  matchBatch(const Cd* const cds[], FaceIdVector* const faceIds[], size_t count) const override;
+
+  virtual const ChangeLog&
+  changes() const override;
 
   static bool
   matchRegex(const Cd& entryCd, const Cd& inputCd);
 
+  // matchRegex() over interned components, `inputIds` from m_interner.find()
+  static bool
+  matchIds(const StEntry& entry, const vector<ComponentInterner::Id>& inputIds);
+
+  // true if every publication matching `cd` also matches `entryCd`
+  static bool
+  covers(const Cd& entryCd, const Cd& cd);
+
+  virtual size_t
+  size() const override;
+
+  virtual size_t
+  memoryUsage() const override;
+
+  virtual StCapacityCounters
+  capacityCounters() const override;
+
+  // entry of exactly `cd`, nullptr if there is none
+  const StEntry*
+  findEntry(const Cd& cd) const;
+
+  virtual void
+  getFaceIds(const Cd& cd, FaceIdVector& faceIds) const override;
+
+  virtual void
+  forEachEntry(const StEntryVisitor& visit) const override;
+
   virtual void
   dump(vector<string>& lines) const override;
 
 private:
+  // the entry of `cd` with next hop `id` expiring after `lifetime`, nullptr if not admitted
+  StEntry*
+  addNextHop(const Cd& cd, const FaceId& id, const time_duration& lifetime);
+
+  StEntry::NextHop
+  makeNextHop(const Cd& cd, const FaceId& id, const time_duration& lifetime);
+
+  void
+  refresh(StEntry& entry, const FaceId& id, const time_duration& lifetime);
+
   void
-  onExpired(Cd cd, FaceId id, const boost::system::error_code& error);
+  onExpired(Cd cd, FaceId id);
 
   static bool
   isEqualValue(const Block& entry, const Block& input);
@@ -73,10 +130,50 @@ private:
   static void
   componentDebugPrint(const Block& entry, const Block& input);
 
+  static string
+  keyOf(const Cd& cd);
+
+  list<StEntry>::iterator
+  find(const Cd& cd);
+
+  // entry forwarded upstream recently enough to stand for `cd`, nullptr if none.
+  // Only plain prefixes of `cd` are looked for, an entry with optional groups or
+  // asterisks covering it is not found.
+  const StEntry*
+  findCovering(const Cd& cd, const boost::posix_time::ptime& now) const;
+
+  void
+  erase(list<StEntry>::iterator it);
+
+  void
+  unindexFace(const FaceId& id, const StEntry& entry);
+
+  // false if next hop `id` may not be added, making room for a new entry if needed
+  bool
+  admit(const Cd& cd, const FaceId& id, bool isNewEntry);
+
+  // removes the entry at the front of m_st
+  void
+  evict();
+
+  // moves the entries just matched on this thread to the back of m_st
+  void
+  touchMatched() const;
+
 private:
-  io_service& m_ioService;
+  TimerWheel& m_timerWheel;
   time_duration m_expireTime;
-  list<StEntry> m_st;
+  ChangeLog m_ownChanges;
+  ChangeLog& m_changes;
+  StCapacity m_capacity;
+  StCapacityCounters m_counters;
+  // reordered by match() for EvictLeastRecentlyMatched
+  mutable list<StEntry> m_st;
+  // keyOf() -> entry in m_st, for O(1) exact and covering lookups
+  std::unordered_map<string, list<StEntry>::iterator> m_index;
+  // FaceId -> entries having it as next hop, so a face is removed in O(its entries)
+  std::unordered_map<FaceId, std::set<const StEntry*>> m_faceIndex;
+  ComponentInterner m_interner;
 };
 
 } // namespace router
@@ -0,0 +1,321 @@
+/*
+  st-sharded.cpp
+
+  Copyright (c) 2019 KOZO KEIKAKU ENGINEERING Inc.
+
+  This software is released under the MIT License
+
+  Permission is hereby granted, free of charge, to any person obtaining a copy
+  of this software and associated documentation files (the "Software"), to deal
+  in the Software without restriction, including without limitation the rights
+  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+  copies of the Software, and to permit persons to whom the Software is
+  furnished to do so, subject to the following conditions:
+
+  The above copyright notice and this permission notice shall be included in all
+  copies or substantial portions of the Software.
+
+  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+  SOFTWARE.
+*/
+#include "st-sharded.hpp"
+#include "memory-usage.hpp"
+
+#include <fcopss/log.hpp>
+
+#include <limits>
+
+namespace fcopss {
+namespace router {
+
+const size_t StSharded::NoShard = std::numeric_limits<size_t>::max();
+
+StSharded::Batch::Batch()
+  : m_sharedCapacity(0), m_pending(0)
+{
+}
+
+StSharded::Shard::Shard(size_t index, TimerWheel& timerWheel, const time_duration& expireTime, ChangeLog& changes)
+  : m_index(index), m_st(timerWheel, expireTime, StCapacity(), &changes)
+{
+}
+
+StSharded::StSharded(TimerWheel& timerWheel, const time_duration& expireTime, size_t shardCount)
+  : m_shared(timerWheel, expireTime, StCapacity(), &m_changes),
+    m_isStopping(false)
+{
+  if (shardCount == 0) {
+    shardCount = std::max(std::thread::hardware_concurrency(), 1u);
+  }
+
+  for (size_t i = 0; i < shardCount; i++) {
+    m_shards.emplace_back(new Shard(i, timerWheel, expireTime, m_changes));
+  }
+  for (auto shard = m_shards.begin(); shard != m_shards.end(); shard++) {
+    Shard& s = **shard;
+    s.m_thread = std::thread([this, &s] { run(s); });
+  }
+  INFO("ST shards=%lu", m_shards.size());
+}
+
+StSharded::~StSharded()
+{
+  {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_isStopping = true;
+  }
+  for (auto shard = m_shards.begin(); shard != m_shards.end(); shard++) {
+    (*shard)->m_workReady.notify_one();
+  }
+  for (auto shard = m_shards.begin(); shard != m_shards.end(); shard++) {
+    (*shard)->m_thread.join();
+  }
+}
+
+std::tuple<bool, Cd>
+StSharded::add(const Cd& cd, const FaceId& id)
+{
+  return shardOf(cd).add(cd, id);
+}
+
+void
+StSharded::restore(const Cd& cd, const FaceId& id, const time_duration& lifetime)
+{
+  shardOf(cd).restore(cd, id, lifetime);
+}
+
+void
+StSharded::remove(const Cd& cd, const FaceId& id)
+{
+  shardOf(cd).remove(cd, id);
+}
+
+void
+StSharded::remove(const Cd& cd)
+{
+  shardOf(cd).remove(cd);
+}
+
+void
+StSharded::remove(const FaceId& id)
+{
+  for (auto shard = m_shards.begin(); shard != m_shards.end(); shard++) {
+    (*shard)->m_st.remove(id);
+  }
+  m_shared.remove(id);
+}
+
+void
+StSharded::clear()
+{
+  for (auto shard = m_shards.begin(); shard != m_shards.end(); shard++) {
+    (*shard)->m_st.clear();
+  }
+  m_shared.clear();
+}
+
+void
+StSharded::match(const Cd& cd, FaceIdVector& faceIds) const
+{
+  FaceIdVector* output = &faceIds;
+  const Cd* input = &cd;
+  matchBatch(&input, &output, 1);
+}
+
+void
+StSharded::matchBatch(const Cd* const cds[], FaceIdVector* const faceIds[], size_t count) const
+{
+  Batch& batch = threadBatch();
+  if (batch.m_cds.size() < m_shards.size()) {
+    batch.m_cds.resize(m_shards.size());
+    batch.m_faceIds.resize(m_shards.size());
+  }
+  if (batch.m_sharedCapacity < count) {
+    batch.m_sharedFaceIds.reset(new FaceIdVector[count]);
+    batch.m_sharedCapacity = count;
+  }
+
+  batch.m_sharedOutputs.resize(count);
+  batch.m_shards.clear();
+  for (size_t i = 0; i < count; i++) {
+    batch.m_sharedOutputs[i] = &batch.m_sharedFaceIds[i];
+
+    size_t index = shardIndexOf(*cds[i]);
+    if (index == NoShard) {
+      faceIds[i]->clear();
+      continue;
+    }
+    if (batch.m_cds[index].empty()) {
+      batch.m_shards.push_back(index);
+    }
+    batch.m_cds[index].push_back(cds[i]);
+    batch.m_faceIds[index].push_back(faceIds[i]);
+  }
+
+  if (batch.m_shards.size() <= 1) {
+    // no parallelism to gain, skip the hand-off
+    for (auto index = batch.m_shards.cbegin(); index != batch.m_shards.cend(); index++) {
+      m_shards[*index]->m_st.matchBatch(batch.m_cds[*index].data(), batch.m_faceIds[*index].data(),
+                                        batch.m_cds[*index].size());
+      batch.m_cds[*index].clear();
+      batch.m_faceIds[*index].clear();
+    }
+    m_shared.matchBatch(cds, batch.m_sharedOutputs.data(), count);
+    mergeShared(batch, faceIds, count);
+    return;
+  }
+
+  {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    batch.m_pending = batch.m_shards.size();
+    for (auto index = batch.m_shards.cbegin(); index != batch.m_shards.cend(); index++) {
+      m_shards[*index]->m_jobs.push_back(&batch);
+    }
+  }
+  for (auto index = batch.m_shards.cbegin(); index != batch.m_shards.cend(); index++) {
+    m_shards[*index]->m_workReady.notify_one();
+  }
+
+  m_shared.matchBatch(cds, batch.m_sharedOutputs.data(), count);
+
+  {
+    std::unique_lock<std::mutex> lock(m_mutex);
+    batch.m_done.wait(lock, [&batch] { return (batch.m_pending == 0); });
+  }
+
+  mergeShared(batch, faceIds, count);
+}
+
+const ChangeLog&
+StSharded::changes() const
+{
+  return m_changes;
+}
+
+size_t
+StSharded::size() const
+{
+  size_t size = m_shared.size();
+  for (auto shard = m_shards.cbegin(); shard != m_shards.cend(); shard++) {
+    size += (*shard)->m_st.size();
+  }
+  return size;
+}
+
+size_t
+StSharded::memoryUsage() const
+{
+  size_t bytes = m_shared.memoryUsage();
+  for (auto shard = m_shards.cbegin(); shard != m_shards.cend(); shard++) {
+    bytes += sizeof (Shard) + (*shard)->m_st.memoryUsage();
+  }
+  return bytes;
+}
+
+void
+StSharded::getFaceIds(const Cd& cd, FaceIdVector& faceIds) const
+{
+  size_t index = shardIndexOf(cd);
+  const StImpl& st = (index == NoShard) ? m_shared : m_shards[index]->m_st;
+  st.getFaceIds(cd, faceIds);
+}
+
+void
+StSharded::forEachEntry(const StEntryVisitor& visit) const
+{
+  m_shared.forEachEntry(visit);
+  for (auto shard = m_shards.cbegin(); shard != m_shards.cend(); shard++) {
+    (*shard)->m_st.forEachEntry(visit);
+  }
+}
+
+void
+StSharded::dump(vector<string>& lines) const
+{
+  m_shared.dump(lines);
+
+  vector<string> shardLines;
+  for (auto shard = m_shards.cbegin(); shard != m_shards.cend(); shard++) {
+    (*shard)->m_st.dump(shardLines);
+    lines.insert(lines.end(), shardLines.cbegin(), shardLines.cend());
+  }
+}
+
+size_t
+StSharded::shardIndexOf(const Cd& cd) const
+{
+  if ((cd.size() == 0) || (cd.elements()[0].type() != tlv::CdComponent)) {
+    return NoShard;
+  }
+
+  // FNV-1a over the first component value
+  const Block& component = cd.elements()[0];
+  uint64_t hash = 14695981039346656037ULL;
+  for (size_t i = 0; i < component.value_size(); i++) {
+    hash = (hash ^ component.value()[i]) * 1099511628211ULL;
+  }
+  return (hash % m_shards.size());
+}
+
+StImpl&
+StSharded::shardOf(const Cd& cd)
+{
+  size_t index = shardIndexOf(cd);
+  return (index == NoShard) ? m_shared : m_shards[index]->m_st;
+}
+
+void
+StSharded::run(Shard& shard)
+{
+  std::unique_lock<std::mutex> lock(m_mutex);
+  while (true) {
+    shard.m_workReady.wait(lock, [this, &shard] { return (!shard.m_jobs.empty() || m_isStopping); });
+    if (m_isStopping) {
+      return;
+    }
+
+    Batch& batch = *shard.m_jobs.front();
+    shard.m_jobs.pop_front();
+    lock.unlock();
+    vector<const Cd*>& cds = batch.m_cds[shard.m_index];
+    vector<FaceIdVector*>& faceIds = batch.m_faceIds[shard.m_index];
+    shard.m_st.matchBatch(cds.data(), faceIds.data(), cds.size());
+    cds.clear();
+    faceIds.clear();
+    lock.lock();
+
+    if (--batch.m_pending == 0) {
+      batch.m_done.notify_one();
+    }
+  }
+}
+
+StSharded::Batch&
+StSharded::threadBatch()
+{
+  static thread_local Batch batch;
+  return batch;
+}
+
+void
+StSharded::mergeShared(const Batch& batch, FaceIdVector* const faceIds[], size_t count) const
+{
+  for (size_t i = 0; i < count; i++) {
+    const FaceIdVector& shared = batch.m_sharedFaceIds[i];
+    if (shared.empty()) {
+      continue;
+    }
+    for (auto id = shared.begin(); id != shared.end(); id++) {
+      faceIds[i]->push_back(*id);
+    }
+    faceIds[i]->unique();
+  }
+}
+
+} // namespace router
+} // namespace fcopss
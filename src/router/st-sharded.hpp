@@ -0,0 +1,178 @@
+/*
+  st-sharded.hpp
+
+  Copyright (c) 2019 KOZO KEIKAKU ENGINEERING Inc.
+
+  This software is released under the MIT License
+
+  Permission is hereby granted, free of charge, to any person obtaining a copy
+  of this software and associated documentation files (the "Software"), to deal
+  in the Software without restriction, including without limitation the rights
+  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+  copies of the Software, and to permit persons to whom the Software is
+  furnished to do so, subject to the following conditions:
+
+  The above copyright notice and this permission notice shall be included in all
+  copies or substantial portions of the Software.
+
+  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+  SOFTWARE.
+*/
+#ifndef _FCOPSS_ROUTER_ST_SHARDED_HPP_
+#define _FCOPSS_ROUTER_ST_SHARDED_HPP_
+
+#include <fcopss/common.hpp>
+
+#include "st.hpp"
+#include "change-log.hpp"
+#include "st-impl.hpp"
+
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <thread>
+
+namespace fcopss {
+namespace router {
+
+// ST split into StImpl shards by the first component of each entry CD.
+//
+// An entry starting with a normal component only matches publications whose
+// first component has the same value, so it goes to the shard that value
+// hashes to, and a publication is matched against that one shard plus a small
+// shared shard holding the entries starting with an optional group, an
+// asterisk or nothing.  Each keyed shard is matched by its own worker thread:
+// matchBatch() hands every worker the CDs of its shard and matches the shared
+// shard itself meanwhile.  Workers only run inside matchBatch(), so adding,
+// removing and expiring entries on the calling thread needs no locking.
+// matchBatch() may run on several threads at once, each call keeps its state
+// in a Batch of its thread and queues its parts to the workers, which take
+// them in order; changes must still wait for every call to return.
+// Matching semantics are those of StImpl::matchRegex, covering CDs are only
+// looked for in the shard of the new entry.
+class StSharded final : public St
+{
+public:
+  // `shardCount` keyed shards, 0 for one per hardware thread
+  StSharded(TimerWheel& timerWheel, const time_duration& expireTime, size_t shardCount);
+
+  ~StSharded();
+
+  virtual std::tuple<bool, Cd>
+  add(const Cd& cd, const FaceId& id) override;
+
+  virtual void
+  restore(const Cd& cd, const FaceId& id, const time_duration& lifetime) override;
+
+  virtual void
+  remove(const Cd& cd, const FaceId& id) override;
+
+  virtual void
+  remove(const Cd& cd) override;
+
+  virtual void
+  remove(const FaceId& id) override;
+
+  virtual void
+  clear() override;
+
+  // a single CD touches at most one keyed shard, it is matched inline
+  virtual void
+  match(const Cd& cd, FaceIdVector& faceIds) const override;
+
+  virtual void
+  matchBatch(const Cd* const cds[], FaceIdVector* const faceIds[], size_t count) const override;
+
+  virtual const ChangeLog&
+  changes() const override;
+
+  virtual size_t
+  size() const override;
+
+  virtual size_t
+  memoryUsage() const override;
+
+  virtual void
+  getFaceIds(const Cd& cd, FaceIdVector& faceIds) const override;
+
+  virtual void
+  forEachEntry(const StEntryVisitor& visit) const override;
+
+  virtual void
+  dump(vector<string>& lines) const override;
+
+private:
+  // state of one matchBatch() call, reused by the next call of the same thread
+  class Batch final : noncopyable
+  {
+  public:
+    Batch();
+
+  public:
+    // the part of the batch for each keyed shard, indexed like m_shards
+    vector<vector<const Cd*>> m_cds;
+    vector<vector<FaceIdVector*>> m_faceIds;
+    // keyed shards having a part
+    vector<size_t> m_shards;
+    // shared shard results, merged after the keyed shards are done
+    unique_ptr<FaceIdVector[]> m_sharedFaceIds;
+    size_t m_sharedCapacity;
+    vector<FaceIdVector*> m_sharedOutputs;
+    // keyed shards still matching their part, guarded by m_mutex
+    size_t m_pending;
+    std::condition_variable m_done;
+  };
+
+  class Shard final : noncopyable
+  {
+  public:
+    Shard(size_t index, TimerWheel& timerWheel, const time_duration& expireTime, ChangeLog& changes);
+
+  public:
+    size_t m_index;
+    StImpl m_st;
+    std::thread m_thread;
+    std::condition_variable m_workReady;
+    // batches having a part for this shard, oldest first, guarded by m_mutex
+    std::deque<Batch*> m_jobs;
+  };
+
+  static const size_t NoShard;
+
+  // keyed shard of a CD starting with a normal component, NoShard otherwise
+  size_t
+  shardIndexOf(const Cd& cd) const;
+
+  StImpl&
+  shardOf(const Cd& cd);
+
+  void
+  run(Shard& shard);
+
+  // the Batch of the calling thread
+  static Batch&
+  threadBatch();
+
+  // adds the ids of batch.m_sharedFaceIds[i] to *faceIds[i]
+  void
+  mergeShared(const Batch& batch, FaceIdVector* const faceIds[], size_t count) const;
+
+private:
+  // shared by all shards
+  ChangeLog m_changes;
+  vector<unique_ptr<Shard>> m_shards;
+  StImpl m_shared;
+
+  mutable std::mutex m_mutex;
+  bool m_isStopping;
+};
+
+} // namespace router
+} // namespace fcopss
+
+#endif // _FCOPSS_ROUTER_ST_SHARDED_HPP_
@@ -0,0 +1,491 @@
+/*
+  st-trie.cpp
+
+  Copyright (c) 2019 KOZO KEIKAKU ENGINEERING Inc.
+
+  This software is released under the MIT License
+
+  Permission is hereby granted, free of charge, to any person obtaining a copy
+  of this software and associated documentation files (the "Software"), to deal
+  in the Software without restriction, including without limitation the rights
+  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+  copies of the Software, and to permit persons to whom the Software is
+  furnished to do so, subject to the following conditions:
+
+  The above copyright notice and this permission notice shall be included in all
+  copies or substantial portions of the Software.
+
+  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+  SOFTWARE.
+*/
+#include "st-trie.hpp"
+#include "memory-usage.hpp"
+
+#include <boost/bind.hpp>
+
+#include <fcopss/log.hpp>
+
+namespace fcopss {
+namespace router {
+
+bool
+StTrie::Node::empty() const
+{
+  return (!m_entry && !m_asterisk && m_components.empty() && m_optionals.empty());
+}
+
+StTrie::StTrie(TimerWheel& timerWheel, const time_duration& expireTime)
+  : m_timerWheel(timerWheel), m_expireTime(expireTime), m_root(new Node())
+{
+}
+
+std::tuple<bool, Cd>
+StTrie::add(const Cd& cd, const FaceId& id)
+{
+  boost::posix_time::ptime now = boost::posix_time::microsec_clock::universal_time();
+
+  StEntry& entry = addNextHop(cd, id, m_expireTime);
+
+  // upstream lease is renewed once half of it has passed
+  if (entry.isForwardFresh(m_expireTime / 2, now)) {
+    INFO("ST entry CD=%s already forwarded upstream, suppress", cd.toUri().c_str());
+    return std::make_tuple(false, cd);
+  }
+
+  const StEntry* covering = findCovering(cd, now);
+  if (covering != nullptr) {
+    INFO("ST entry CD=%s covered by CD=%s", cd.toUri().c_str(), covering->m_cd.toUri().c_str());
+    return std::make_tuple(false, covering->m_cd);
+  }
+
+  entry.m_lastForwarded = now;
+  return std::make_tuple(true, cd);
+}
+
+void
+StTrie::restore(const Cd& cd, const FaceId& id, const time_duration& lifetime)
+{
+  addNextHop(cd, id, lifetime);
+  INFO("ST entry FaceID=%llu CD=%s restored", id, cd.toUri().c_str());
+}
+
+void
+StTrie::remove(const Cd& cd, const FaceId& id)
+{
+  vector<Node*> path;
+  Node* node = findNode(cd, &path);
+  if ((node != nullptr) && node->m_entry) {
+    StEntry::NextHop nextHop(id);
+    if (node->m_entry->m_nextHops.erase(nextHop) > 0) {
+      unindexFace(id, *node->m_entry);
+      m_changes.record(cd);
+      INFO("ST entry FaceID=%llu CD=%s remoeved", id, cd.toUri().c_str());
+    }
+    if (node->m_entry->m_nextHops.empty()) {
+      node->m_entry.reset();
+      prune(cd, path);
+    }
+  }
+}
+
+void
+StTrie::remove(const Cd& cd)
+{
+  vector<Node*> path;
+  Node* node = findNode(cd, &path);
+  if ((node != nullptr) && node->m_entry) {
+    const StEntry& entry = *node->m_entry;
+    for (auto nextHop = entry.m_nextHops.cbegin(); nextHop != entry.m_nextHops.cend(); nextHop++) {
+      unindexFace(nextHop->m_faceId, entry);
+    }
+    node->m_entry.reset();
+    prune(cd, path);
+    m_changes.record(cd);
+    INFO("ST entry CD=%s remoeved", cd.toUri().c_str());
+  }
+}
+
+void
+StTrie::remove(const FaceId& id)
+{
+  auto face = m_faceIndex.find(id);
+  if (face == m_faceIndex.end()) {
+    return;
+  }
+
+  // remove(cd, id) updates the index as it goes
+  vector<Cd> cds;
+  for (auto entry = face->second.cbegin(); entry != face->second.cend(); entry++) {
+    cds.push_back((*entry)->m_cd);
+  }
+  for (auto cd = cds.cbegin(); cd != cds.cend(); cd++) {
+    remove(*cd, id);
+  }
+}
+
+void
+StTrie::clear()
+{
+  m_faceIndex.clear();
+  m_root.reset(new Node());
+  m_changes.reset();
+  INFO("all ST entry remoeved");
+}
+
+void
+StTrie::match(const Cd& cd, FaceIdVector& faceIds) const
+{
+  faceIds.clear();
+
+  m_matchedEntries.clear();
+  matchNode(*m_root, cd, 0, m_matchedEntries);
+  for (auto entry = m_matchedEntries.cbegin(); entry != m_matchedEntries.cend(); entry++) {
+    for (auto nextHop = (*entry)->m_nextHops.cbegin(); nextHop != (*entry)->m_nextHops.cend(); nextHop++) {
+      faceIds.push_back(nextHop->m_faceId);
+      DEBUG("Packet CD=%s : ST entry match FaceID=%llu CD=%s",
+            cd.toUri().c_str(), nextHop->m_faceId, (*entry)->m_cd.toUri().c_str());
+    }
+  }
+
+  faceIds.unique();
+
+  if (faceIds.empty()) {
+    DEBUG("Packet CD=%s : ST entry no match", cd.toUri().c_str());
+  }
+}
+
+const ChangeLog&
+StTrie::changes() const
+{
+  return m_changes;
+}
+
+size_t
+StTrie::size() const
+{
+  size_t size = 0;
+  visitEntries(*m_root, [&size] (const StEntry&) { size++; });
+  return size;
+}
+
+size_t
+StTrie::memoryUsage() const
+{
+  size_t bytes = nodeMemoryUsage(*m_root) + hashMapMemoryUsage(m_faceIndex);
+  for (auto face = m_faceIndex.cbegin(); face != m_faceIndex.cend(); face++) {
+    bytes += treeMemoryUsage(face->second);
+  }
+  return bytes;
+}
+
+void
+StTrie::getFaceIds(const Cd& cd, FaceIdVector& faceIds) const
+{
+  const Node* node = findNode(cd);
+  if ((node != nullptr) && node->m_entry) {
+    node->m_entry->getFaceIds(faceIds);
+  } else {
+    faceIds.clear();
+  }
+}
+
+void
+StTrie::forEachEntry(const StEntryVisitor& visit) const
+{
+  FaceIdVector faceIds;
+  visitEntries(*m_root, [&] (const StEntry& entry) {
+    entry.getFaceIds(faceIds);
+    visit(entry.m_cd, faceIds);
+  });
+}
+
+void
+StTrie::dump(vector<string>& lines) const
+{
+  lines.clear();
+  dumpNode(*m_root, lines);
+}
+
+string
+StTrie::keyOf(const Block& component)
+{
+  return string(reinterpret_cast<const char*>(component.value()), component.value_size());
+}
+
+StTrie::Node*
+StTrie::findChild(const Node& node, const Block& component)
+{
+  if (component.type() == tlv::CdAsterisk) {
+    return node.m_asterisk.get();
+  }
+
+  const auto& children = (component.type() == tlv::CdOptional) ? node.m_optionals : node.m_components;
+  auto it = children.find(keyOf(component));
+  if (it == children.end()) {
+    return nullptr;
+  }
+  return it->second.get();
+}
+
+StTrie::Node*
+StTrie::createChild(Node& node, const Block& component)
+{
+  if (component.type() == tlv::CdAsterisk) {
+    if (!node.m_asterisk) {
+      node.m_asterisk.reset(new Node());
+    }
+    return node.m_asterisk.get();
+  }
+
+  auto& children = (component.type() == tlv::CdOptional) ? node.m_optionals : node.m_components;
+  unique_ptr<Node>& child = children[keyOf(component)];
+  if (!child) {
+    child.reset(new Node());
+  }
+  return child.get();
+}
+
+void
+StTrie::removeChild(Node& node, const Block& component)
+{
+  if (component.type() == tlv::CdAsterisk) {
+    node.m_asterisk.reset();
+  } else if (component.type() == tlv::CdOptional) {
+    node.m_optionals.erase(keyOf(component));
+  } else {
+    node.m_components.erase(keyOf(component));
+  }
+}
+
+StTrie::Node*
+StTrie::findNode(const Cd& cd, vector<Node*>* path) const
+{
+  Node* node = m_root.get();
+  if (path != nullptr) {
+    path->push_back(node);
+  }
+
+  for (auto it = cd.elements().cbegin(); it != cd.elements().cend(); it++) {
+    node = findChild(*node, *it);
+    if (node == nullptr) {
+      return nullptr;
+    }
+    if (path != nullptr) {
+      path->push_back(node);
+    }
+  }
+
+  return node;
+}
+
+void
+StTrie::prune(const Cd& cd, const vector<Node*>& path)
+{
+  // path[i + 1] is the child of path[i] reached by cd.elements()[i]
+  for (size_t i = cd.size(); i > 0; i--) {
+    if (!path[i]->empty()) {
+      break;
+    }
+    removeChild(*path[i - 1], cd.elements()[i - 1]);
+  }
+}
+
+void
+StTrie::unindexFace(const FaceId& id, const StEntry& entry)
+{
+  auto face = m_faceIndex.find(id);
+  if (face != m_faceIndex.end()) {
+    face->second.erase(&entry);
+    if (face->second.empty()) {
+      m_faceIndex.erase(face);
+    }
+  }
+}
+
+void
+StTrie::matchNode(const Node& node, const Cd& cd, size_t pos, vector<const StEntry*>& entries) const
+{
+  // entry end : match
+  if (node.m_entry) {
+    entries.push_back(node.m_entry.get());
+  }
+
+  // input end : no more match below this node
+  if (pos >= cd.size()) {
+    return;
+  }
+
+  const Block& input = cd.elements()[pos];
+  string key = keyOf(input);
+
+  // normal component : proceed both on equal value
+  auto component = node.m_components.find(key);
+  if (component != node.m_components.end()) {
+    matchNode(*component->second, cd, pos + 1, entries);
+  }
+
+  // optional component : proceed both on equal value,
+  // otherwise proceed entry until normal component
+  for (auto optional = node.m_optionals.cbegin(); optional != node.m_optionals.cend(); optional++) {
+    if (optional->first == key) {
+      matchNode(*optional->second, cd, pos + 1, entries);
+    } else {
+      skipOptional(*optional->second, cd, pos, entries);
+    }
+  }
+
+  // asterisk : proceed entry
+  if (node.m_asterisk) {
+    matchNode(*node.m_asterisk, cd, pos, entries);
+  }
+}
+
+void
+StTrie::skipOptional(const Node& node, const Cd& cd, size_t pos, vector<const StEntry*>& entries) const
+{
+  // the rest of the optional group is skipped without consuming input,
+  // matching resumes at the normal component after the asterisk
+  for (auto optional = node.m_optionals.cbegin(); optional != node.m_optionals.cend(); optional++) {
+    skipOptional(*optional->second, cd, pos, entries);
+  }
+  if (node.m_asterisk) {
+    matchNode(*node.m_asterisk, cd, pos, entries);
+  }
+}
+
+const StEntry*
+StTrie::findCovering(const Cd& cd, const boost::posix_time::ptime& now) const
+{
+  size_t leading = 0;
+  while ((leading < cd.size()) && (cd.elements()[leading].type() == tlv::CdComponent)) {
+    leading++;
+  }
+
+  vector<const StEntry*> entries;
+  if (leading == cd.size()) {
+    // plain CD : covered by any entry matching it
+    matchNode(*m_root, cd, 0, entries);
+  } else {
+    // otherwise by a plain entry on its leading components
+    const Node* node = m_root.get();
+    for (size_t i = 0; (i < leading) && (node != nullptr); i++) {
+      auto component = node->m_components.find(keyOf(cd.elements()[i]));
+      node = (component != node->m_components.end()) ? component->second.get() : nullptr;
+      if ((node != nullptr) && node->m_entry) {
+        entries.push_back(node->m_entry.get());
+      }
+    }
+  }
+
+  for (auto entry = entries.cbegin(); entry != entries.cend(); entry++) {
+    if (((*entry)->m_cd != cd) && (*entry)->isForwardFresh(m_expireTime / 2, now)) {
+      return *entry;
+    }
+  }
+  return nullptr;
+}
+
+void
+StTrie::visitEntries(const Node& node, const function<void(const StEntry&)>& visit) const
+{
+  if (node.m_entry) {
+    visit(*node.m_entry);
+  }
+  for (auto it = node.m_components.cbegin(); it != node.m_components.cend(); it++) {
+    visitEntries(*it->second, visit);
+  }
+  for (auto it = node.m_optionals.cbegin(); it != node.m_optionals.cend(); it++) {
+    visitEntries(*it->second, visit);
+  }
+  if (node.m_asterisk) {
+    visitEntries(*node.m_asterisk, visit);
+  }
+}
+
+size_t
+StTrie::nodeMemoryUsage(const Node& node) const
+{
+  size_t bytes = sizeof (Node) + hashMapMemoryUsage(node.m_components) + hashMapMemoryUsage(node.m_optionals);
+  if (node.m_entry) {
+    bytes += node.m_entry->memoryUsage();
+  }
+  for (auto it = node.m_components.cbegin(); it != node.m_components.cend(); it++) {
+    bytes += stringMemoryUsage(it->first) + nodeMemoryUsage(*it->second);
+  }
+  for (auto it = node.m_optionals.cbegin(); it != node.m_optionals.cend(); it++) {
+    bytes += stringMemoryUsage(it->first) + nodeMemoryUsage(*it->second);
+  }
+  if (node.m_asterisk) {
+    bytes += nodeMemoryUsage(*node.m_asterisk);
+  }
+  return bytes;
+}
+
+void
+StTrie::dumpNode(const Node& node, vector<string>& lines) const
+{
+  if (node.m_entry) {
+    lines.push_back(node.m_entry->toString());
+  }
+  for (auto it = node.m_components.cbegin(); it != node.m_components.cend(); it++) {
+    dumpNode(*it->second, lines);
+  }
+  for (auto it = node.m_optionals.cbegin(); it != node.m_optionals.cend(); it++) {
+    dumpNode(*it->second, lines);
+  }
+  if (node.m_asterisk) {
+    dumpNode(*node.m_asterisk, lines);
+  }
+}
+
+StEntry&
+StTrie::addNextHop(const Cd& cd, const FaceId& id, const time_duration& lifetime)
+{
+  Node* node = m_root.get();
+  for (auto it = cd.elements().cbegin(); it != cd.elements().cend(); it++) {
+    node = createChild(*node, *it);
+  }
+
+  if (node->m_entry) {
+    refresh(*node->m_entry, id, lifetime);
+    INFO("ST entry FaceID=%llu CD=%s already exists, update entry", id, cd.toUri().c_str());
+  } else {
+    node->m_entry.reset(new StEntry(cd, makeNextHop(cd, id, lifetime)));
+    m_changes.record(cd);
+    INFO("ST entry FaceID=%llu CD=%s not exists, create entry", id, cd.toUri().c_str());
+  }
+  m_faceIndex[id].insert(node->m_entry.get());
+
+  return *node->m_entry;
+}
+
+StEntry::NextHop
+StTrie::makeNextHop(const Cd& cd, const FaceId& id, const time_duration& lifetime)
+{
+  StExpiredCallback callback = boost::bind(&StTrie::onExpired, this, cd, id);
+  return StEntry::NextHop(m_timerWheel, lifetime, callback, id);
+}
+
+void
+StTrie::refresh(StEntry& entry, const FaceId& id, const time_duration& lifetime)
+{
+  if (!entry.refresh(id, m_timerWheel, lifetime)) {
+    entry.m_nextHops.insert(makeNextHop(entry.m_cd, id, lifetime));
+    m_changes.record(entry.m_cd);
+  }
+}
+
+void
+StTrie::onExpired(Cd cd, FaceId id)
+{
+  INFO("ST entry FaceID=%llu CD=%s expired", id, cd.toUri().c_str());
+  remove(cd, id);
+}
+
+} // namespace router
+} // namespace fcopss
@@ -0,0 +1,170 @@
+/*
+  st-trie.hpp
+
+  Copyright (c) 2019 KOZO KEIKAKU ENGINEERING Inc.
+
+  This software is released under the MIT License
+
+  Permission is hereby granted, free of charge, to any person obtaining a copy
+  of this software and associated documentation files (the "Software"), to deal
+  in the Software without restriction, including without limitation the rights
+  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+  copies of the Software, and to permit persons to whom the Software is
+  furnished to do so, subject to the following conditions:
+
+  The above copyright notice and this permission notice shall be included in all
+  copies or substantial portions of the Software.
+
+  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+  SOFTWARE.
+*/
+#ifndef _FCOPSS_ROUTER_ST_TRIE_HPP_
+#define _FCOPSS_ROUTER_ST_TRIE_HPP_
+
+#include <fcopss/common.hpp>
+
+#include "st.hpp"
+#include "change-log.hpp"
+#include "st-entry.hpp"
+
+#include <unordered_map>
+
+namespace fcopss {
+namespace router {
+
+// ST keyed by a component trie.
+//
+// Normal components, optional components and the asterisk are all trie edges,
+// so a lookup follows only the branches the packet CD can take and costs
+// O(CD depth) instead of O(number of entries).  Matching semantics are those
+// of StImpl::matchRegex.
+class StTrie final : public St
+{
+public:
+  StTrie(TimerWheel& timerWheel, const time_duration& expireTime);
+
+  virtual std::tuple<bool, Cd>
+  add(const Cd& cd, const FaceId& id) override;
+
+  virtual void
+  restore(const Cd& cd, const FaceId& id, const time_duration& lifetime) override;
+
+  virtual void
+  remove(const Cd& cd, const FaceId& id) override;
+
+  virtual void
+  remove(const Cd& cd) override;
+
+  virtual void
+  remove(const FaceId& id) override;
+
+  virtual void
+  clear() override;
+ 
+  virtual void
+  match(const Cd& cd, FaceIdVector& faceIds) const override;
+
+  virtual const ChangeLog&
+  changes() const override;
+
+  virtual size_t
+  size() const override;
+
+  virtual size_t
+  memoryUsage() const override;
+
+  virtual void
+  getFaceIds(const Cd& cd, FaceIdVector& faceIds) const override;
+
+  virtual void
+  forEachEntry(const StEntryVisitor& visit) const override;
+
+  virtual void
+  dump(vector<string>& lines) const override;
+
+private:
+  class Node
+  {
+  public:
+    bool
+    empty() const;
+
+  public:
+    std::unordered_map<string, unique_ptr<Node>> m_components;
+    std::unordered_map<string, unique_ptr<Node>> m_optionals;
+    unique_ptr<Node> m_asterisk;
+    unique_ptr<StEntry> m_entry;
+  };
+
+  static string
+  keyOf(const Block& component);
+
+  static Node*
+  findChild(const Node& node, const Block& component);
+
+  static Node*
+  createChild(Node& node, const Block& component);
+
+  static void
+  removeChild(Node& node, const Block& component);
+
+  Node*
+  findNode(const Cd& cd, vector<Node*>* path = nullptr) const;
+
+  void
+  prune(const Cd& cd, const vector<Node*>& path);
+
+  void
+  unindexFace(const FaceId& id, const StEntry& entry);
+
+  void
+  matchNode(const Node& node, const Cd& cd, size_t pos, vector<const StEntry*>& entries) const;
+
+  void
+  skipOptional(const Node& node, const Cd& cd, size_t pos, vector<const StEntry*>& entries) const;
+
+  const StEntry*
+  findCovering(const Cd& cd, const boost::posix_time::ptime& now) const;
+
+  void
+  visitEntries(const Node& node, const function<void(const StEntry&)>& visit) const;
+
+  size_t
+  nodeMemoryUsage(const Node& node) const;
+
+  void
+  dumpNode(const Node& node, vector<string>& lines) const;
+
+  // the entry of `cd`, created if needed, with next hop `id` expiring after `lifetime`
+  StEntry&
+  addNextHop(const Cd& cd, const FaceId& id, const time_duration& lifetime);
+
+  StEntry::NextHop
+  makeNextHop(const Cd& cd, const FaceId& id, const time_duration& lifetime);
+
+  void
+  refresh(StEntry& entry, const FaceId& id, const time_duration& lifetime);
+
+  void
+  onExpired(Cd cd, FaceId id);
+
+private:
+  TimerWheel& m_timerWheel;
+  time_duration m_expireTime;
+  ChangeLog m_changes;
+  unique_ptr<Node> m_root;
+  // FaceId -> entries having it as next hop, so a face is removed in O(its entries)
+  std::unordered_map<FaceId, std::set<const StEntry*>> m_faceIndex;
+  // scratch for match(), reused across packets
+  mutable vector<const StEntry*> m_matchedEntries;
+};
+
+} // namespace router
+} // namespace fcopss
+
+#endif // _FCOPSS_ROUTER_ST_TRIE_HPP_
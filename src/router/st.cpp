@@ -0,0 +1,118 @@
+/*
+  st.cpp
+
+  Copyright (c) 2019 KOZO KEIKAKU ENGINEERING Inc.
+
+  This software is released under the MIT License
+
+  Permission is hereby granted, free of charge, to any person obtaining a copy
+  of this software and associated documentation files (the "Software"), to deal
+  in the Software without restriction, including without limitation the rights
+  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+  copies of the Software, and to permit persons to whom the Software is
+  furnished to do so, subject to the following conditions:
+
+  The above copyright notice and this permission notice shall be included in all
+  copies or substantial portions of the Software.
+
+  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+  SOFTWARE.
+*/
+#include "st.hpp"
+#include "st-impl.hpp"
+#include "st-trie.hpp"
+#include "st-automaton.hpp"
+#include "st-flat.hpp"
+#include "st-compact.hpp"
+#include "st-sharded.hpp"
+#include "change-log.hpp"
+#include "match-cache.hpp"
+
+#include <unordered_map>
+
+namespace fcopss {
+namespace router {
+
+// scratch for St::matchBatch(), one per thread,
+// MatchCache::hashOf() a CD -> index of its first occurrence in the batch
+static thread_local std::unordered_multimap<uint64_t, size_t> BatchFirsts;
+
+StCapacity::StCapacity()
+  : m_maxEntries(0), m_maxEntriesPerFace(0), m_evictPolicy(EvictOldestLease)
+{
+}
+
+StCapacityCounters::StCapacityCounters()
+  : m_rejectedFull(0), m_rejectedFaceQuota(0), m_evicted(0)
+{
+}
+
+unique_ptr<St>
+St::create(const string& type, TimerWheel& timerWheel, const time_duration& expireTime,
+           const StCapacity& capacity, size_t shardCount)
+{
+  unique_ptr<St> st;
+  if (type == "trie") {
+    st.reset(new StTrie(timerWheel, expireTime));
+  } else if (type == "automaton") {
+    st.reset(new StAutomaton(timerWheel, expireTime));
+  } else if (type == "flat") {
+    st.reset(new StFlat(timerWheel, expireTime, capacity));
+  } else if (type == "compact") {
+    st.reset(new StCompact(timerWheel, expireTime));
+  } else if (type == "sharded") {
+    st.reset(new StSharded(timerWheel, expireTime, shardCount));
+  } else {
+    st.reset(new StImpl(timerWheel, expireTime, capacity));
+  }
+  return st;
+}
+
+void
+St::matchBatch(const Cd* const cds[], FaceIdVector* const faceIds[], size_t count) const
+{
+  // bursts often repeat a CD, reuse the result of its first occurrence
+  BatchFirsts.clear();
+  for (size_t i = 0; i < count; i++) {
+    uint64_t hash = MatchCache::hashOf(cds[i]->wireEncode());
+    auto range = BatchFirsts.equal_range(hash);
+    auto first = range.first;
+    while ((first != range.second) && (*cds[first->second] != *cds[i])) {
+      first++;
+    }
+
+    if (first != range.second) {
+      faceIds[i]->assign(*faceIds[first->second]);
+    } else {
+      match(*cds[i], *faceIds[i]);
+      BatchFirsts.emplace(hash, i);
+    }
+  }
+}
+
+uint64_t
+St::generation() const
+{
+  return changes().generation();
+}
+
+bool
+St::affects(const Cd& changed, const Cd& cd)
+{
+  // an entry only takes part in the matches of the CDs it matches
+  return StImpl::matchRegex(changed, cd);
+}
+
+StCapacityCounters
+St::capacityCounters() const
+{
+  return StCapacityCounters();
+}
+
+} // namespace router
+} // namespace fcopss
@@ -29,16 +29,76 @@
 #include <fcopss/common.hpp>
 
 #include "face.hpp"
+#include "face-id-vector.hpp"
 
 namespace fcopss {
 namespace router {
 
+class ChangeLog;
+class TimerWheel;
+
+// given the CD and the next hop faces of one entry by St::forEachEntry()
+using StEntryVisitor = function<void(const Cd& cd, const FaceIdVector& faceIds)>;
+
+// bounds on the subscriptions an ST keeps, 0 is unlimited.  Only StImpl and
+// StFlat enforce them, the router refuses a bounded configuration for the
+// other types.
+class StCapacity
+{
+public:
+  enum EvictPolicy
+  {
+    // a Sub needing a new entry is rejected while the ST is full
+    EvictNone = 0,
+    // the entry least recently added or refreshed makes room
+    EvictOldestLease = 1,
+    // the entry least recently matched by a publication makes room, match()
+    // then reorders the entries and is not safe to call concurrently
+    EvictLeastRecentlyMatched = 2
+  };
+
+  StCapacity();
+
+public:
+  size_t m_maxEntries;
+  // entries having a face as next hop
+  size_t m_maxEntriesPerFace;
+  EvictPolicy m_evictPolicy;
+};
+
+class StCapacityCounters
+{
+public:
+  StCapacityCounters();
+
+public:
+  // Subs rejected because the ST was full
+  uint64_t m_rejectedFull;
+  // Subs rejected because their face was at its quota
+  uint64_t m_rejectedFaceQuota;
+  uint64_t m_evicted;
+};
+
 class St
 {
 public:
+  // ST of `type` as named by StType, StImpl for "list" or any other name.
+  // `shardCount` is only used by "sharded".
+  static unique_ptr<St>
+  create(const string& type, TimerWheel& timerWheel, const time_duration& expireTime,
+         const StCapacity& capacity, size_t shardCount);
+
+  virtual
+  ~St() = default;
+
   virtual std::tuple<bool, Cd>
   add(const Cd& cd, const FaceId& id) = 0;
 
+  // adds next hop `id` to the entry of `cd` expiring after `lifetime` rather
+  // than a full lease, nothing is forwarded upstream, for a warm restart
+  virtual void
+  restore(const Cd& cd, const FaceId& id, const time_duration& lifetime) = 0;
+
   virtual void
   remove(const Cd& cd, const FaceId& id) = 0;
 
@@ -51,8 +111,45 @@ public:
   virtual void
   clear() = 0;
  
-  virtual set<FaceId>
-  match(const Cd& cd) const = 0;
+  virtual void
+  match(const Cd& cd, FaceIdVector& faceIds) const = 0;
+
+  // *faceIds[i] gets the result of match(*cds[i]), for a burst of packets.
+  // The default matches each distinct CD of the batch once.
+  virtual void
+  matchBatch(const Cd* const cds[], FaceIdVector* const faceIds[], size_t count) const;
+
+  // every entry added, modified or removed, in order
+  virtual const ChangeLog&
+  changes() const = 0;
+
+  // changes whenever the result of match() may change, changes().generation()
+  uint64_t
+  generation() const;
+
+  // true if a change of the entry `changed` may change the result of match(cd)
+  static bool
+  affects(const Cd& changed, const Cd& cd);
+
+  // number of entries
+  virtual size_t
+  size() const = 0;
+
+  // estimated bytes taken by the entries and the structures indexing them
+  virtual size_t
+  memoryUsage() const = 0;
+
+  // Subs turned away by the StCapacity of this ST, all 0 for an unbounded one
+  virtual StCapacityCounters
+  capacityCounters() const;
+
+  // next hops of the entry of exactly `cd`, none if there is no such entry
+  virtual void
+  getFaceIds(const Cd& cd, FaceIdVector& faceIds) const = 0;
+
+  // calls `visit` for each entry, one at a time, `visit` must not modify the ST
+  virtual void
+  forEachEntry(const StEntryVisitor& visit) const = 0;
 
   virtual void
   dump(vector<string>& lines) const = 0;
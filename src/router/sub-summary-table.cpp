@@ -0,0 +1,169 @@
+/*
+  sub-summary-table.cpp
+
+  Copyright (c) 2019 KOZO KEIKAKU ENGINEERING Inc.
+
+  This software is released under the MIT License
+
+  Permission is hereby granted, free of charge, to any person obtaining a copy
+  of this software and associated documentation files (the "Software"), to deal
+  in the Software without restriction, including without limitation the rights
+  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+  copies of the Software, and to permit persons to whom the Software is
+  furnished to do so, subject to the following conditions:
+
+  The above copyright notice and this permission notice shall be included in all
+  copies or substantial portions of the Software.
+
+  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+  SOFTWARE.
+*/
+#include "sub-summary-table.hpp"
+
+#include <fcopss/log.hpp>
+
+namespace fcopss {
+namespace router {
+
+SubSummaryTable::SubSummaryTable(size_t bitCount, size_t hashCount)
+  : m_bitCount(bitCount), m_hashCount(hashCount), m_generation(0)
+{
+}
+
+BloomFilter
+SubSummaryTable::makeFilter() const
+{
+  return BloomFilter(m_bitCount, m_hashCount);
+}
+
+bool
+SubSummaryTable::update(const FaceId& id, const SubSummary& summary)
+{
+  if (!summary.isDelta()) {
+    // filters of another geometry could not be merged into the ones sent
+    // upstream, and a peer could make match() hash without bound
+    if ((summary.getBitCount() != m_bitCount) || (summary.getHashCount() != m_hashCount)) {
+      WARN("SubSummary from FaceID=%llu dropped: geometry bits=%lu hashes=%lu, expected bits=%lu hashes=%lu",
+           id, summary.getBitCount(), summary.getHashCount(), m_bitCount, m_hashCount);
+      return false;
+    }
+
+    m_generation++;
+    Received& received = m_received[id];
+    if (!received.m_filter.assign(summary.getBitCount(), summary.getHashCount(), summary.getFilter())) {
+      WARN("SubSummary from FaceID=%llu dropped: %lu filter bytes for %lu bits",
+           id, summary.getFilter().size(), m_bitCount);
+      m_received.erase(id);
+      return false;
+    }
+    received.m_sequence = summary.getSequence();
+    return true;
+  }
+
+  auto it = m_received.find(id);
+  if ((it == m_received.end()) ||
+      (it->second.m_sequence != summary.getBaseSequence()) ||
+      (it->second.m_filter.bitCount() != summary.getBitCount()) ||
+      (it->second.m_filter.hashCount() != summary.getHashCount())) {
+    return false;
+  }
+
+  if (!it->second.m_filter.toggle(summary.getToggles())) {
+    return false;
+  }
+  m_generation++;
+  it->second.m_sequence = summary.getSequence();
+  return true;
+}
+
+void
+SubSummaryTable::match(const Cd& cd, FaceIdVector& faceIds) const
+{
+  for (auto it = m_received.cbegin(); it != m_received.cend(); it++) {
+    if (it->second.m_filter.mayMatch(cd)) {
+      faceIds.push_back(it->first);
+      DEBUG("Packet CD=%s : SubSummary match FaceID=%llu", cd.toUri().c_str(), it->first);
+    }
+  }
+}
+
+uint64_t
+SubSummaryTable::generation() const
+{
+  return m_generation;
+}
+
+void
+SubSummaryTable::getReceivedFilters(SubSummaryFilters& filters) const
+{
+  filters.clear();
+  for (auto it = m_received.cbegin(); it != m_received.cend(); it++) {
+    filters.emplace_back(it->first, it->second.m_filter);
+  }
+}
+
+void
+SubSummaryTable::mergeReceived(BloomFilter& filter, const FaceId& id) const
+{
+  for (auto it = m_received.cbegin(); it != m_received.cend(); it++) {
+    if (it->first != id) {
+      filter.merge(it->second.m_filter);
+    }
+  }
+}
+
+bool
+SubSummaryTable::makeSummary(const FaceId& id, const BloomFilter& filter, SubSummary& summary)
+{
+  summary.setGeometry(filter.bitCount(), filter.hashCount());
+
+  auto it = m_sent.find(id);
+  if (it == m_sent.end()) {
+    if (filter.isEmpty()) {
+      return false;
+    }
+    Sent& sent = m_sent[id];
+    sent.m_filter = filter;
+    sent.m_sequence = 1;
+    sent.m_deltaCount = 0;
+    summary.setSequence(sent.m_sequence).setFilter(filter.bytes());
+    return true;
+  }
+
+  Sent& sent = it->second;
+  filter.diff(sent.m_filter, m_toggles);
+  if (m_toggles.empty() && (sent.m_deltaCount < FullRefreshInterval)) {
+    sent.m_deltaCount++;
+    return false;
+  }
+
+  sent.m_sequence++;
+  // a toggle takes 4 bytes, past a point the whole filter is smaller
+  if (m_toggles.empty() || (sent.m_deltaCount >= FullRefreshInterval) ||
+      (m_toggles.size() * 4 >= filter.bytes().size())) {
+    summary.setSequence(sent.m_sequence).setFilter(filter.bytes());
+    sent.m_deltaCount = 0;
+  } else {
+    summary.setSequence(sent.m_sequence).setDelta(sent.m_sequence - 1, m_toggles);
+    sent.m_deltaCount++;
+  }
+  sent.m_filter = filter;
+  return true;
+}
+
+void
+SubSummaryTable::remove(const FaceId& id)
+{
+  if (m_received.erase(id) > 0) {
+    m_generation++;
+  }
+  m_sent.erase(id);
+}
+
+} // namespace router
+} // namespace fcopss
@@ -0,0 +1,120 @@
+/*
+  sub-summary-table.hpp
+
+  Copyright (c) 2019 KOZO KEIKAKU ENGINEERING Inc.
+
+  This software is released under the MIT License
+
+  Permission is hereby granted, free of charge, to any person obtaining a copy
+  of this software and associated documentation files (the "Software"), to deal
+  in the Software without restriction, including without limitation the rights
+  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+  copies of the Software, and to permit persons to whom the Software is
+  furnished to do so, subject to the following conditions:
+
+  The above copyright notice and this permission notice shall be included in all
+  copies or substantial portions of the Software.
+
+  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+  SOFTWARE.
+*/
+#ifndef _FCOPSS_ROUTER_SUB_SUMMARY_TABLE_HPP_
+#define _FCOPSS_ROUTER_SUB_SUMMARY_TABLE_HPP_
+
+#include <fcopss/common.hpp>
+#include <fcopss/sub-summary.hpp>
+
+#include "face.hpp"
+#include "face-id-vector.hpp"
+#include "bloom-filter.hpp"
+
+#include <map>
+
+namespace fcopss {
+namespace router {
+
+// filters received from downstream faces, copied out of a SubSummaryTable
+using SubSummaryFilters = vector<std::pair<FaceId, BloomFilter>>;
+
+// Filter based ST.
+//
+// Holds the SubSummary filters received from downstream faces, which stand in
+// for the ST entries of the subscriptions behind them, and the last filters
+// sent to upstream faces, from which the next summaries are sent as deltas.
+class SubSummaryTable final : noncopyable
+{
+public:
+  // full summaries are sent at least every FullRefreshInterval summaries,
+  // so that a receiver which missed a delta catches up
+  static const size_t FullRefreshInterval = 10;
+
+  // geometry of the filters this router sends
+  SubSummaryTable(size_t bitCount, size_t hashCount);
+
+  BloomFilter
+  makeFilter() const;
+
+  // applies a summary received from a downstream face, false if it was
+  // dropped, i.e. a delta not based on the last summary from that face, or a
+  // summary whose geometry is not the one this router sends
+  bool
+  update(const FaceId& id, const SubSummary& summary);
+
+  // appends the faces whose summary may hold a subscription matching the CD
+  void
+  match(const Cd& cd, FaceIdVector& faceIds) const;
+
+  // changes whenever the result of match() may change
+  uint64_t
+  generation() const;
+
+  // the filters match() uses
+  void
+  getReceivedFilters(SubSummaryFilters& filters) const;
+
+  // ORs in the filters received from every face but `id`
+  void
+  mergeReceived(BloomFilter& filter, const FaceId& id) const;
+
+  // makes the summary bringing the upstream face `id` to `filter`,
+  // false if there is nothing to send
+  bool
+  makeSummary(const FaceId& id, const BloomFilter& filter, SubSummary& summary);
+
+  void
+  remove(const FaceId& id);
+
+private:
+  class Received
+  {
+  public:
+    BloomFilter m_filter;
+    uint64_t m_sequence;
+  };
+
+  class Sent
+  {
+  public:
+    BloomFilter m_filter;
+    uint64_t m_sequence;
+    size_t m_deltaCount;
+  };
+
+private:
+  size_t m_bitCount;
+  size_t m_hashCount;
+  std::map<FaceId, Received> m_received;
+  std::map<FaceId, Sent> m_sent;
+  vector<uint32_t> m_toggles;
+  uint64_t m_generation;
+};
+
+} // namespace router
+} // namespace fcopss
+
+#endif // _FCOPSS_ROUTER_SUB_SUMMARY_TABLE_HPP_
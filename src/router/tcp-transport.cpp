@@ -109,6 +109,12 @@ TcpTransport::getRemotePort() const
   return remote.port();
 }
 
+io_service&
+TcpTransport::getIoService()
+{
+  return m_socket.get_io_service();
+}
+
 void
 TcpTransport::shutdown()
 {
@@ -162,10 +168,15 @@ TcpTransport::handleReceive(const boost::system::error_code& error, size_t bytes
         break;
       }
       offset += block.size();
+      m_receivedPackets.push_back(std::move(block));
+    }
+
+    if (!m_receivedPackets.empty()) {
       auto face = m_face.lock();
       if (face) {
-        face->onPacketReceived(std::move(block));
+        face->onPacketsReceived(m_receivedPackets);
       }
+      m_receivedPackets.clear();
     }
 
     if (!ok && (m_receivedBufferSize == sizeof (m_receiveBuffer)) && (offset == 0)) {
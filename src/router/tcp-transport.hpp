@@ -65,6 +65,9 @@ public:
   void
   shutdown() override;
 
+  io_service&
+  getIoService() override;
+
 private:
   TcpTransport(tcp::socket&& s, const time_duration& receiveTimeout);
 
@@ -93,6 +96,8 @@ private:
   time_duration m_receiveTimeout;
   deadline_timer m_receiveTimer;
   std::queue<Block> m_sendQueue;
+  // packets parsed out of one receive, handed to the face together
+  vector<Block> m_receivedPackets;
 };
 
 } // namespace router
@@ -0,0 +1,241 @@
+/*
+  timer-wheel.cpp
+
+  Copyright (c) 2019 KOZO KEIKAKU ENGINEERING Inc.
+
+  This software is released under the MIT License
+
+  Permission is hereby granted, free of charge, to any person obtaining a copy
+  of this software and associated documentation files (the "Software"), to deal
+  in the Software without restriction, including without limitation the rights
+  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+  copies of the Software, and to permit persons to whom the Software is
+  furnished to do so, subject to the following conditions:
+
+  The above copyright notice and this permission notice shall be included in all
+  copies or substantial portions of the Software.
+
+  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+  SOFTWARE.
+*/
+#include "timer-wheel.hpp"
+
+#include <boost/bind.hpp>
+
+#include <fcopss/log.hpp>
+
+namespace placeholders = boost::asio::placeholders;
+
+namespace fcopss {
+namespace router {
+
+TimerWheel::Timer::Timer(TimerWheel& wheel, const Callback& callback)
+  : m_wheel(&wheel),
+    m_callback(callback),
+    m_expiresAt(boost::posix_time::pos_infin),
+    m_expireTick(0),
+    m_prev(nullptr),
+    m_next(nullptr),
+    m_slot(nullptr)
+{
+}
+
+TimerWheel::Timer::~Timer()
+{
+  if ((m_wheel != nullptr) && (m_slot != nullptr)) {
+    m_wheel->unlink(*this);
+  }
+}
+
+const boost::posix_time::ptime&
+TimerWheel::Timer::expiresAt() const
+{
+  return m_expiresAt;
+}
+
+TimerWheel::TimerWheel(io_service& ioService, const time_duration& tick)
+  : m_tickTimer(ioService),
+    m_tick(tick),
+    m_currentTick(0),
+    m_size(0),
+    m_lastExpiredCount(0)
+{
+  for (size_t level = 0; level < Levels; level++) {
+    for (size_t slot = 0; slot < Slots; slot++) {
+      m_slots[level][slot] = nullptr;
+    }
+  }
+
+  m_tickTimer.expires_from_now(m_tick);
+  asyncTick();
+}
+
+TimerWheel::~TimerWheel()
+{
+  // timers still owned by others must not touch this wheel any more
+  for (size_t level = 0; level < Levels; level++) {
+    for (size_t slot = 0; slot < Slots; slot++) {
+      for (Timer* timer = m_slots[level][slot]; timer != nullptr; timer = timer->m_next) {
+        timer->m_wheel = nullptr;
+        timer->m_slot = nullptr;
+      }
+    }
+  }
+}
+
+shared_ptr<TimerWheel::Timer>
+TimerWheel::schedule(const time_duration& delay, const Callback& callback)
+{
+  shared_ptr<Timer> timer(new Timer(*this, callback));
+  reschedule(*timer, delay);
+  return timer;
+}
+
+void
+TimerWheel::reschedule(Timer& timer, const time_duration& delay)
+{
+  if (timer.m_slot != nullptr) {
+    unlink(timer);
+  }
+
+  if (delay.is_special()) {
+    timer.m_expiresAt = boost::posix_time::pos_infin;
+    return;
+  }
+
+  uint64_t ticks = (delay.ticks() + m_tick.ticks() - 1) / m_tick.ticks();
+  timer.m_expireTick = m_currentTick + std::max<uint64_t>(ticks, 1);
+  timer.m_expiresAt = boost::posix_time::microsec_clock::universal_time() + delay;
+  link(timer);
+}
+
+void
+TimerWheel::cancel(Timer& timer)
+{
+  if (timer.m_slot != nullptr) {
+    unlink(timer);
+  }
+  timer.m_expiresAt = boost::posix_time::pos_infin;
+}
+
+size_t
+TimerWheel::size() const
+{
+  return m_size;
+}
+
+size_t
+TimerWheel::lastExpiredCount() const
+{
+  return m_lastExpiredCount;
+}
+
+void
+TimerWheel::asyncTick()
+{
+  m_tickTimer.async_wait(boost::bind(&TimerWheel::onTick, this, placeholders::error));
+}
+
+void
+TimerWheel::onTick(const boost::system::error_code& error)
+{
+  if (error) {
+    return;
+  }
+
+  m_currentTick++;
+
+  // move timers of upper levels down when their range comes round
+  for (size_t level = 1; level < Levels; level++) {
+    if (((m_currentTick >> ((level - 1) * SlotBits)) & (Slots - 1)) != 0) {
+      break;
+    }
+    cascade(level);
+  }
+
+  size_t expired = 0;
+  Timer** slot = &m_slots[0][m_currentTick & (Slots - 1)];
+  while (*slot != nullptr) {
+    Timer* timer = *slot;
+    unlink(*timer);
+    timer->m_expiresAt = boost::posix_time::pos_infin;
+    expired++;
+    // the callback may destroy the timer
+    Callback callback = timer->m_callback;
+    callback();
+  }
+
+  m_lastExpiredCount = expired;
+  if (expired > 0) {
+    INFO("timer wheel tick=%llu: %lu entries expired, %lu entries remain", m_currentTick, expired, m_size);
+  }
+
+  m_tickTimer.expires_at(m_tickTimer.expires_at() + m_tick);
+  asyncTick();
+}
+
+void
+TimerWheel::link(Timer& timer)
+{
+  uint64_t delta = timer.m_expireTick - m_currentTick;
+
+  size_t level = 0;
+  while ((level < Levels - 1) && (delta >= (uint64_t(1) << ((level + 1) * SlotBits)))) {
+    level++;
+  }
+  if (delta >= (uint64_t(1) << (Levels * SlotBits))) {
+    // beyond the wheel range : park in the farthest slot and cascade again later
+    timer.m_expireTick = m_currentTick + (uint64_t(1) << (Levels * SlotBits)) - 1;
+  }
+
+  Timer** slot = &m_slots[level][(timer.m_expireTick >> (level * SlotBits)) & (Slots - 1)];
+  timer.m_slot = slot;
+  timer.m_prev = nullptr;
+  timer.m_next = *slot;
+  if (*slot != nullptr) {
+    (*slot)->m_prev = &timer;
+  }
+  *slot = &timer;
+  m_size++;
+}
+
+void
+TimerWheel::unlink(Timer& timer)
+{
+  if (timer.m_prev != nullptr) {
+    timer.m_prev->m_next = timer.m_next;
+  } else {
+    *timer.m_slot = timer.m_next;
+  }
+  if (timer.m_next != nullptr) {
+    timer.m_next->m_prev = timer.m_prev;
+  }
+  timer.m_prev = nullptr;
+  timer.m_next = nullptr;
+  timer.m_slot = nullptr;
+  m_size--;
+}
+
+void
+TimerWheel::cascade(size_t level)
+{
+  Timer** slot = &m_slots[level][(m_currentTick >> (level * SlotBits)) & (Slots - 1)];
+  Timer* timer = *slot;
+  *slot = nullptr;
+
+  while (timer != nullptr) {
+    Timer* next = timer->m_next;
+    timer->m_slot = nullptr;
+    m_size--;
+    link(*timer);
+    timer = next;
+  }
+}
+
+} // namespace router
+} // namespace fcopss
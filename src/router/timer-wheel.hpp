@@ -0,0 +1,119 @@
+/*
+  timer-wheel.hpp
+
+  Copyright (c) 2019 KOZO KEIKAKU ENGINEERING Inc.
+
+  This software is released under the MIT License
+
+  Permission is hereby granted, free of charge, to any person obtaining a copy
+  of this software and associated documentation files (the "Software"), to deal
+  in the Software without restriction, including without limitation the rights
+  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+  copies of the Software, and to permit persons to whom the Software is
+  furnished to do so, subject to the following conditions:
+
+  The above copyright notice and this permission notice shall be included in all
+  copies or substantial portions of the Software.
+
+  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+  SOFTWARE.
+*/
+#ifndef _FCOPSS_ROUTER_TIMER_WHEEL_HPP_
+#define _FCOPSS_ROUTER_TIMER_WHEEL_HPP_
+
+#include <fcopss/common.hpp>
+
+namespace fcopss {
+namespace router {
+
+// Hierarchical timer wheel for coarse-grained soft-state expiry.
+//
+// All timers share one deadline_timer ticking every `tick`.  Arming,
+// rescheduling, cancelling and expiring a timer are O(1); timers further than
+// one wheel revolution away are kept on upper levels and cascaded down as the
+// wheel turns.  Expiry is rounded up to the next tick.
+class TimerWheel final : noncopyable
+{
+public:
+  using Callback = function<void()>;
+
+  class Timer final : noncopyable
+  {
+  public:
+    ~Timer();
+
+    const boost::posix_time::ptime&
+    expiresAt() const;
+
+  private:
+    Timer(TimerWheel& wheel, const Callback& callback);
+
+  private:
+    friend class TimerWheel;
+
+    TimerWheel* m_wheel;
+    Callback m_callback;
+    boost::posix_time::ptime m_expiresAt;
+    uint64_t m_expireTick;
+    Timer* m_prev;
+    Timer* m_next;
+    Timer** m_slot;
+  };
+
+  TimerWheel(io_service& ioService, const time_duration& tick);
+
+  ~TimerWheel();
+
+  shared_ptr<Timer>
+  schedule(const time_duration& delay, const Callback& callback);
+
+  void
+  reschedule(Timer& timer, const time_duration& delay);
+
+  void
+  cancel(Timer& timer);
+
+  size_t
+  size() const;
+
+  size_t
+  lastExpiredCount() const;
+
+private:
+  void
+  asyncTick();
+
+  void
+  onTick(const boost::system::error_code& error);
+
+  void
+  link(Timer& timer);
+
+  void
+  unlink(Timer& timer);
+
+  void
+  cascade(size_t level);
+
+private:
+  static const size_t Levels = 4;
+  static const size_t SlotBits = 8;
+  static const size_t Slots = 1 << SlotBits;
+
+  deadline_timer m_tickTimer;
+  time_duration m_tick;
+  uint64_t m_currentTick;
+  size_t m_size;
+  size_t m_lastExpiredCount;
+  Timer* m_slots[Levels][Slots];
+};
+
+} // namespace router
+} // namespace fcopss
+
+#endif // _FCOPSS_ROUTER_TIMER_WHEEL_HPP_
@@ -36,6 +36,9 @@ class Face;
 class Transport : noncopyable
 {
 public:
+  // most packets a transport hands to its face per receive
+  static const size_t MaxReceiveBatch = 64;
+
   Transport();
 
   virtual
@@ -68,6 +71,10 @@ public:
   virtual void
   shutdown() = 0;
 
+  // io_service running the socket, the only thread that may use the transport once started
+  virtual io_service&
+  getIoService() = 0;
+
 protected:
   weak_ptr<Face> m_face;
 };
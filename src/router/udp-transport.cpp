@@ -118,6 +118,12 @@ UdpTransport::getRemotePort() const
   return remote.port();
 }
 
+io_service&
+UdpTransport::getIoService()
+{
+  return m_socket.get_io_service();
+}
+
 void
 UdpTransport::shutdown()
 {
@@ -163,23 +169,33 @@ UdpTransport::handleReceive()
     if (m_receivedBufferSize == 0) {
       asyncReceive();
     } else {
-      bool ok = false;
-      Block block;
-      tie(ok, block) = Block::fromBuffer(m_receiveBuffer, m_receivedBufferSize);
+      bool ok = parseReceived();
+
+      // drain the datagrams already queued on the socket, without blocking
+      boost::system::error_code error;
+      while (ok && (m_receivedPackets.size() < MaxReceiveBatch) && (m_socket.available(error) > 0)) {
+        m_receivedBufferSize = m_socket.receive(boost::asio::buffer(m_receiveBuffer, sizeof (m_receiveBuffer)), 0, error);
+        if (error) {
+          break;
+        }
+        ok = (m_receivedBufferSize == 0) || parseReceived();
+      }
+
+      auto face = m_face.lock();
+      if (face) {
+        face->onPacketsReceived(m_receivedPackets);
+      }
+      m_receivedPackets.clear();
+
       if (!ok) {
-        ERROR("packet parse error");
         shutdown();
         return;
       }
-      if (block.size() < m_receivedBufferSize) {
-        ERROR("packet has %lu bytes trailer", m_receivedBufferSize - block.size());
+      if (error) {
+        ERROR("%s", error.message().c_str());
         shutdown();
         return;
       }
-      auto face = m_face.lock();
-      if (face) {
-        face->onPacketReceived(std::move(block));
-      }
       asyncReceive();
     }
   } else if (m_receiveError == boost::asio::error::operation_aborted) {
@@ -190,6 +206,24 @@ UdpTransport::handleReceive()
   }
 }
 
+bool
+UdpTransport::parseReceived()
+{
+  bool ok = false;
+  Block block;
+  tie(ok, block) = Block::fromBuffer(m_receiveBuffer, m_receivedBufferSize);
+  if (!ok) {
+    ERROR("packet parse error");
+    return false;
+  }
+  if (block.size() < m_receivedBufferSize) {
+    ERROR("packet has %lu bytes trailer", m_receivedBufferSize - block.size());
+    return false;
+  }
+  m_receivedPackets.push_back(std::move(block));
+  return true;
+}
+
 void
 UdpTransport::handleSend(const boost::system::error_code& error, size_t bytes_transferred)
 {
@@ -66,6 +66,9 @@ public:
   void
   shutdown() override;
 
+  io_service&
+  getIoService() override;
+
 private:
   UdpTransport(udp::socket&& s, const uint8_t* receiveBuffer, size_t receivedBufferSize, const boost::system::error_code& error);
 
@@ -83,6 +86,10 @@ private:
   void
   handleReceive();
 
+  // parses the datagram in m_receiveBuffer into m_receivedPackets
+  bool
+  parseReceived();
+
   void
   handleSend(const boost::system::error_code& error, size_t bytes_transferred);
 
@@ -91,6 +98,8 @@ private:
   size_t m_receivedBufferSize;
   boost::system::error_code m_receiveError;
   udp::socket m_socket;
+  // datagrams read by one receive, handed to the face together
+  vector<Block> m_receivedPackets;
 };
 
 } // namespace router
@@ -0,0 +1,126 @@
+/*
+  worker.cpp
+
+  Copyright (c) 2019 KOZO KEIKAKU ENGINEERING Inc.
+
+  This software is released under the MIT License
+
+  Permission is hereby granted, free of charge, to any person obtaining a copy
+  of this software and associated documentation files (the "Software"), to deal
+  in the Software without restriction, including without limitation the rights
+  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+  copies of the Software, and to permit persons to whom the Software is
+  furnished to do so, subject to the following conditions:
+
+  The above copyright notice and this permission notice shall be included in all
+  copies or substantial portions of the Software.
+
+  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+  SOFTWARE.
+*/
+
+#include "worker.hpp"
+#include "transport.hpp"
+
+#include <fcopss/log.hpp>
+
+namespace fcopss {
+namespace router {
+
+static thread_local Worker* CurrentWorker = nullptr;
+
+Worker::Worker(size_t index, uint16_t port, const time_duration& receiveTimeout, FaceManager& faceManager)
+  : m_index(index),
+    m_work(new io_service::work(m_ioService)),
+    m_tcpServer(m_ioService, port, receiveTimeout, faceManager),
+    m_udpServer(m_ioService, port, faceManager)
+{
+}
+
+Worker::~Worker()
+{
+  stop();
+}
+
+Worker*
+Worker::current()
+{
+  return CurrentWorker;
+}
+
+size_t
+Worker::getIndex() const
+{
+  return m_index;
+}
+
+io_service&
+Worker::getIoService()
+{
+  return m_ioService;
+}
+
+void
+Worker::start()
+{
+  m_tcpServer.start();
+  m_udpServer.start();
+  m_thread = std::thread([this] { run(); });
+}
+
+void
+Worker::stop()
+{
+  m_work.reset();
+  m_ioService.stop();
+  if (m_thread.joinable()) {
+    m_thread.join();
+  }
+}
+
+void
+Worker::send(const shared_ptr<Transport>& transport, Block&& packet)
+{
+  bool isDrainPosted;
+  {
+    std::lock_guard<std::mutex> lock(m_queueMutex);
+    isDrainPosted = !m_queue.empty();
+    m_queue.emplace_back(transport, std::move(packet));
+  }
+
+  if (!isDrainPosted) {
+    m_ioService.post([this] { drain(); });
+  }
+}
+
+void
+Worker::run()
+{
+  CurrentWorker = this;
+  INFO("worker %lu start", m_index);
+  m_ioService.run();
+  INFO("worker %lu end", m_index);
+  CurrentWorker = nullptr;
+}
+
+void
+Worker::drain()
+{
+  {
+    std::lock_guard<std::mutex> lock(m_queueMutex);
+    m_draining.swap(m_queue);
+  }
+
+  for (auto message = m_draining.begin(); message != m_draining.end(); message++) {
+    message->first->send(std::move(message->second));
+  }
+  m_draining.clear();
+}
+
+} // namespace router
+} // namespace fcopss
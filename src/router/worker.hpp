@@ -0,0 +1,105 @@
+/*
+  worker.hpp
+
+  Copyright (c) 2019 KOZO KEIKAKU ENGINEERING Inc.
+
+  This software is released under the MIT License
+
+  Permission is hereby granted, free of charge, to any person obtaining a copy
+  of this software and associated documentation files (the "Software"), to deal
+  in the Software without restriction, including without limitation the rights
+  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+  copies of the Software, and to permit persons to whom the Software is
+  furnished to do so, subject to the following conditions:
+
+  The above copyright notice and this permission notice shall be included in all
+  copies or substantial portions of the Software.
+
+  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+  SOFTWARE.
+*/
+#ifndef _FCOPSS_ROUTER_WORKER_HPP_
+#define _FCOPSS_ROUTER_WORKER_HPP_
+
+#include <fcopss/common.hpp>
+
+#include "tcp-server.hpp"
+#include "udp-server.hpp"
+
+#include <mutex>
+#include <thread>
+
+namespace fcopss {
+namespace router {
+
+class FaceManager;
+class Transport;
+
+// Forwarding thread with an io_service of its own.
+//
+// Every worker listens on the router port with its own TCP and UDP sockets,
+// SO_REUSEPORT lets the kernel spread connections and datagrams over them.
+// A face stays pinned to the worker whose io_service runs its transport, and
+// only that thread touches the transport: packets other threads send to it
+// go through the queue of the worker, which the worker drains in batches.
+class Worker final : noncopyable
+{
+public:
+  Worker(size_t index, uint16_t port, const time_duration& receiveTimeout, FaceManager& faceManager);
+
+  ~Worker();
+
+  // worker running the calling thread, nullptr on the control thread
+  static Worker*
+  current();
+
+  size_t
+  getIndex() const;
+
+  io_service&
+  getIoService();
+
+  // starts listening and the thread
+  void
+  start();
+
+  // stops the thread, handlers still pending are dropped
+  void
+  stop();
+
+  // any thread, `packet` is sent on the worker thread, in order per transport
+  void
+  send(const shared_ptr<Transport>& transport, Block&& packet);
+
+private:
+  void
+  run();
+
+  void
+  drain();
+
+private:
+  using Message = std::pair<shared_ptr<Transport>, Block>;
+
+  size_t m_index;
+  io_service m_ioService;
+  unique_ptr<io_service::work> m_work;
+  TcpServer m_tcpServer;
+  UdpServer m_udpServer;
+  std::thread m_thread;
+  std::mutex m_queueMutex;
+  // filled by other threads, a drain is posted when it stops being empty
+  vector<Message> m_queue;
+  // worker thread only, swapped with m_queue
+  vector<Message> m_draining;
+};
+
+} // namespace router
+} // namespace fcopss
+
+#endif // _FCOPSS_ROUTER_WORKER_HPP_
@@ -25,6 +25,8 @@
 */
 #include "cmd-fibadd.hpp"
 
+#include <cstdlib>
+
 namespace fcopss {
 namespace rtctrl {
 
@@ -51,119 +53,19 @@ CmdFibAdd::parse(int argc, char* argv[])
 void
 CmdFibAdd::parseFromFile(const string& path)
 {
-  Request first;
-  first.m_cmd = "FIB-DEL";
-  m_requests.push_back(first);
-  
-  try {
-    boost::property_tree::ptree tree;
-    boost::property_tree::read_ini(path, tree);
-
-    for (uint16_t x = 0; x <= std::numeric_limits<uint16_t>::max(); x++) {
-      string pathName = string("FIB.Name") + std::to_string(x);
-      boost::optional<string> name = tree.get_optional<string>(pathName);
-      if (!name) {
-        if (x == 0) {
-          BOOST_THROW_EXCEPTION(Error("FIB file error (Name nothing)"));
-        }
-        break;
-      }
-
-      vector<string> faces;
-      getFaces(faces, tree, x);
-
-      vector<string> costs;
-      getCosts(costs, tree, x);
-
-      if (faces.size() != costs.size()) {
-        BOOST_THROW_EXCEPTION(Error("FIB file error (NextHop and Cost count differ"));
-      }
-
-      for (size_t i = 0 ; i < faces.size(); i++) {
-        string remote;
-        string type;
-        findTypeRemote(faces[i], tree, type, remote);
-
-        Request request;
-        request.m_cmd = "FIB-ADD";
-        setParamName(request, *name);
-        setParamType(request, type);
-        setParamRemote(request, remote, m_routerPort);
-        setParamCost(request, costs[i]);
-
-        m_requests.push_back(request);
-      }
-    }
-  } catch (const boost::property_tree::ini_parser_error& e) {
-    string msg = e.message() + " (line=" + std::to_string(e.line()) + ")";
-    BOOST_THROW_EXCEPTION(Error(msg));
-  } catch (const boost::property_tree::ptree_bad_path& e) {
-    BOOST_THROW_EXCEPTION(Error(e.what()));
-  } catch (const boost::property_tree::ptree_bad_data& e) {
-    BOOST_THROW_EXCEPTION(Error(e.what()));
-  } catch (const Error& error) {
-    BOOST_THROW_EXCEPTION(error);
-  } catch (...) {
-    BOOST_THROW_EXCEPTION(Error("FIB file error"));
-  }
-}
-
-void
-CmdFibAdd::getFaces(vector<string>& faces, boost::property_tree::ptree& tree, uint16_t x)
-{
-  string pathName = string("FIB.NextHop") + std::to_string(x);
-  string csv = tree.get<string>(pathName);
-  splitCsv(faces, csv);
-}
-
-void
-CmdFibAdd::getCosts(vector<string>& costs, boost::property_tree::ptree& tree, uint16_t x)
-{
-  string pathName = string("FIB.Cost") + std::to_string(x);
-  string csv = tree.get<string>(pathName);
-  splitCsv(costs, csv);
-}
-
-void
-CmdFibAdd::splitCsv(vector<string>& params, string& csv)
-{
-  std::remove_if(csv.begin(), csv.end(), [](const char& c){return isspace(c);});
-  if (csv.empty()) {
-    BOOST_THROW_EXCEPTION(Error("FIB file error"));
+  // the router reads the file itself and swaps the whole FIB at once,
+  // it runs on this host so an absolute path names the same file
+  char* absolute = realpath(path.c_str(), nullptr);
+  if (absolute == nullptr) {
+    BOOST_THROW_EXCEPTION(Error("cannot open FIB file: " + path));
   }
 
-  boost::split(params, csv, boost::is_any_of(","));
-  if (params.empty()) {
-    BOOST_THROW_EXCEPTION(Error("FIB file error"));
-  }
-  for (auto it = params.begin(); it != params.end(); it++) {
-    if (it->empty()) {
-      BOOST_THROW_EXCEPTION(Error("FIB file error"));
-    }
-  }
-}
+  Request request;
+  request.m_cmd = "FIB-LOAD";
+  request.m_param["FILE"] = absolute;
+  free(absolute);
 
-void
-CmdFibAdd::findTypeRemote(const string& face, boost::property_tree::ptree& tree, string& type, string& remote)
-{
-  for (uint16_t x = 0; x <= std::numeric_limits<uint16_t>::max(); x++) {
-    try {
-      string pathName = string("FACES.FaceId") + std::to_string(x);
-      string id = tree.get<string>(pathName);
-      boost::trim(id);
-      if (face == id) {
-        pathName = string("FACES.Protocol") + std::to_string(x);
-        type = tree.get<string>(pathName);
-        pathName = string("FACES.Remote") + std::to_string(x);
-        remote = tree.get<string>(pathName);
-        return;
-      }
-    } catch (const boost::property_tree::ptree_bad_path& e) {
-      break;
-    }
-  }
-  string msg = "No match [FACES] section data for [FIB] FaceID " + face;
-  BOOST_THROW_EXCEPTION(Error(msg));
+  m_requests.push_back(request);
 }
 
 void
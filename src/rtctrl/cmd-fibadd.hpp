@@ -28,10 +28,6 @@
 
 #include <fcopss/common.hpp>
 
-#include <boost/property_tree/ptree.hpp>
-#include <boost/property_tree/ini_parser.hpp>
-#include <boost/optional.hpp>
-
 #include "cmd.hpp"
 
 namespace fcopss {
@@ -49,18 +45,6 @@ private:
   void
   parseFromFile(const string& path);
 
-  void
-  getFaces(vector<string>& faces, boost::property_tree::ptree& tree, uint16_t x);
-
-  void
-  getCosts(vector<string>& costs, boost::property_tree::ptree& tree, uint16_t x);
-
-  void
-  splitCsv(vector<string>& params, string& csv);
-
-  void
-  findTypeRemote(const string& face, boost::property_tree::ptree& tree, string& type, string& remote);
-
   void
   parseFromArg(int argc, char* argv[]);
 
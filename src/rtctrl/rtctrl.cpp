@@ -67,6 +67,10 @@ Rtctrl::createCmd(int argc, char* argv[])
     cmd = new CmdFibDump(argc, argv, m_ctrlPort);
   } else if (cmdType == FaceDump) {
     cmd = new CmdFaceDump(argc, argv, m_ctrlPort);
+  } else if (cmdType == CacheDump) {
+    cmd = new CmdCacheDump(argc, argv, m_ctrlPort);
+  } else if (cmdType == StStat) {
+    cmd = new CmdStStat(argc, argv, m_ctrlPort);
   }
  
   return cmd;
@@ -96,6 +100,10 @@ Rtctrl::parseCmdType(int argc, char* argv[])
     cmdType = FaceDel;
   } else if (typeArg == "facedump") {
     cmdType = FaceDump;
+  } else if (typeArg == "cachedump") {
+    cmdType = CacheDump;
+  } else if (typeArg == "ststat") {
+    cmdType = StStat;
   } else {
     BOOST_THROW_EXCEPTION(Error("unkown cmd type"));
   }
@@ -118,9 +126,9 @@ Rtctrl::usage() const
   std::cerr << "      COST: cost of this route" << std::endl;
   std::cerr << std::endl;
 
-  std::cerr << "  For add FIB entries from file..." << std::endl;
+  std::cerr << "  For replace all FIB entries with those of a file..." << std::endl;
   std::cerr << "    rtctrl fibadd -f FILE" << std::endl;
-  std::cerr << "      FILE: path of FIB file" << std::endl;
+  std::cerr << "      FILE: path of FIB file, read by the router" << std::endl;
   std::cerr << std::endl;
 
   std::cerr << "  For delete a FIB entry..." << std::endl;
@@ -155,6 +163,14 @@ Rtctrl::usage() const
   std::cerr << "  For print all Face entry..." << std::endl;
   std::cerr << "    rtctrl facedump" << std::endl;
   std::cerr << std::endl;
+
+  std::cerr << "  For print match cache counters..." << std::endl;
+  std::cerr << "    rtctrl cachedump" << std::endl;
+  std::cerr << std::endl;
+
+  std::cerr << "  For print ST entry count, memory usage and rejected Subs..." << std::endl;
+  std::cerr << "    rtctrl ststat" << std::endl;
+  std::cerr << std::endl;
 }
 
 } // namespace rtctrl
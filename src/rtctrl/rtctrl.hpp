@@ -37,6 +37,8 @@
 #include "cmd-stdump.hpp"
 #include "cmd-facedel.hpp"
 #include "cmd-facedump.hpp"
+#include "cmd-cachedump.hpp"
+#include "cmd-ststat.hpp"
 
 namespace fcopss {
 namespace rtctrl {
@@ -53,6 +55,8 @@ public:
     FibDump = 5,
     FaceDel = 6,
     FaceDump = 7,
+    CacheDump = 8,
+    StStat = 9,
   };
 
   Rtctrl(const Config& config);